@@ -106,9 +106,7 @@ struct CalcGravity{
 #else
         PS::S32 devid = 0;
 #endif
-        g5_set_xmjMC(devid, 0, nj, xj, mj);
-        g5_set_nMC(devid, nj);
-        g5_calculate_force_on_xMC(devid, xi, ai, pi, ni);
+        g5_calculate_force_on_xjMC(devid, xi, ai, pi, ni, xj, mj, nj);
 
         for(PS::S32 i = 0; i < ni; i++) {
             force[i].acc[0] += ai[i][0];
@@ -0,0 +1,173 @@
+#pragma once
+
+#include<vector>
+
+namespace ParticleSimulator{
+
+    // Building blocks of ParticleSystem::writeParticleCompressed and
+    // readParticleCompressed.
+    //
+    // File: CompressedSnapshotPreamble, CompressedChunkIndex[n_chunk_], then
+    // the chunks. Each process sorts its particles by their Morton key in the
+    // global box quantized to n_bit_pos_ bits per axis, and cuts them into
+    // chunks. A chunk holds
+    //   the keys, the first one as it is and the others as differences (LEB128),
+    //   the velocities quantized to n_bit_vel_ bits with the scale of the chunk,
+    //   n_extra_byte_ bytes per particle given by the codec.
+    // The key range of a chunk bounds its particles, so that a subvolume is
+    // read by skipping the chunks outside of it.
+    //
+    // Codec (user defined):
+    //   S32 getNumberOfExtraByte() const;
+    //   F64vec getVel(const Tptcl &) const;        (if n_bit_vel > 0)
+    //   void setVel(Tptcl &, const F64vec &) const;
+    //   void packExtra(const Tptcl &, char *) const;
+    //   void unpackExtra(Tptcl &, const char *) const;
+    // The position is taken by getPos() and restored by setPos() at the
+    // centre of its cell.
+
+    struct CompressedSnapshotPreamble{
+        char magic_[8];
+        S64 n_ptcl_;
+        S64 n_chunk_;
+        S32 dimension_;
+        S32 n_bit_pos_;
+        S32 n_bit_vel_;
+        S32 n_extra_byte_;
+        F64ort box_;
+    };
+
+    struct CompressedChunkIndex{
+        U64 key_min_;
+        U64 key_max_;
+        S64 offset_; // from the end of the index
+        S64 n_byte_;
+        S64 n_ptcl_;
+        F64 vel_scale_;
+    };
+
+    class CompressedKey{
+    public:
+        static U64 encode(const F64vec & pos, const F64ort & box, const S32 n_bit){
+            const U64 n_cell = (U64)1 << n_bit;
+            U64 u[DIMENSION];
+            for(S32 d=0; d<DIMENSION; d++){
+                const F64 x = (pos[d] - box.low_[d]) / (box.high_[d] - box.low_[d]) * (F64)n_cell;
+                u[d] = (x <= 0.0) ? 0 : ( (x >= (F64)n_cell) ? n_cell-1 : (U64)x );
+            }
+            U64 key = 0;
+            for(S32 b=n_bit-1; b>=0; b--){
+                for(S32 d=0; d<DIMENSION; d++) key = (key<<1) | ((u[d]>>b) & 1);
+            }
+            return key;
+        }
+        static void split(const U64 key, const S32 n_bit, U64 u[]){
+            for(S32 d=0; d<DIMENSION; d++) u[d] = 0;
+            for(S32 b=0; b<n_bit; b++){
+                for(S32 d=0; d<DIMENSION; d++){
+                    u[d] |= ((key >> (b*DIMENSION + DIMENSION-1-d)) & 1) << b;
+                }
+            }
+        }
+        // centre of the cell
+        static F64vec decode(const U64 key, const F64ort & box, const S32 n_bit){
+            U64 u[DIMENSION];
+            split(key, n_bit, u);
+            const F64 n_cell = (F64)((U64)1 << n_bit);
+            F64vec pos = box.low_;
+            for(S32 d=0; d<DIMENSION; d++){
+                pos[d] += ((F64)u[d] + 0.5) * (box.high_[d] - box.low_[d]) / n_cell;
+            }
+            return pos;
+        }
+        // the smallest cell which contains all the keys in [key_min, key_max]
+        static F64ort getCell(const U64 key_min, const U64 key_max, const F64ort & box, const S32 n_bit){
+            S32 lev = 0;
+            while(lev < n_bit){
+                const S32 shift = (n_bit-lev-1)*DIMENSION;
+                if( (key_min >> shift) != (key_max >> shift) ) break;
+                lev++;
+            }
+            U64 u[DIMENSION];
+            split(key_min, n_bit, u);
+            F64ort cell;
+            for(S32 d=0; d<DIMENSION; d++){
+                const F64 len = (box.high_[d] - box.low_[d]) / (F64)((U64)1 << lev);
+                cell.low_[d] = box.low_[d] + (F64)(u[d] >> (n_bit-lev)) * len;
+                cell.high_[d] = cell.low_[d] + len;
+            }
+            return cell;
+        }
+    };
+
+    inline void PutVarint(std::vector<char> & buf, U64 val){
+        while(val >= 0x80){
+            buf.push_back( (char)((val & 0x7f) | 0x80) );
+            val >>= 7;
+        }
+        buf.push_back( (char)val );
+    }
+    inline U64 GetVarint(const char * & p){
+        U64 val = 0;
+        for(S32 shift=0; ; shift+=7){
+            const unsigned char c = (unsigned char)*p++;
+            val |= (U64)(c & 0x7f) << shift;
+            if(c < 0x80) break;
+        }
+        return val;
+    }
+
+    class BitWriter{
+    private:
+        std::vector<char> & buf_;
+        U64 acc_;
+        S32 n_acc_;
+    public:
+        BitWriter(std::vector<char> & buf) : buf_(buf), acc_(0), n_acc_(0) {}
+        void put(const U32 val, const S32 n_bit){
+            acc_ |= (U64)val << n_acc_;
+            n_acc_ += n_bit;
+            while(n_acc_ >= 8){
+                buf_.push_back( (char)(acc_ & 0xff) );
+                acc_ >>= 8;
+                n_acc_ -= 8;
+            }
+        }
+        void flush(){
+            if(n_acc_ > 0) buf_.push_back( (char)(acc_ & 0xff) );
+            acc_ = 0;
+            n_acc_ = 0;
+        }
+    };
+
+    class BitReader{
+    private:
+        const unsigned char * p_;
+        U64 acc_;
+        S32 n_acc_;
+    public:
+        BitReader(const char * p) : p_((const unsigned char *)p), acc_(0), n_acc_(0) {}
+        U32 get(const S32 n_bit){
+            while(n_acc_ < n_bit){
+                acc_ |= (U64)(*p_++) << n_acc_;
+                n_acc_ += 8;
+            }
+            const U32 val = (U32)(acc_ & (((U64)1 << n_bit) - 1));
+            acc_ >>= n_bit;
+            n_acc_ -= n_bit;
+            return val;
+        }
+        const char * end() const { return (const char *)p_; }
+    };
+
+    // no velocity, no extra field (positions only)
+    template<class Tptcl>
+    struct CompressedCodecPosition{
+        S32 getNumberOfExtraByte() const { return 0; }
+        F64vec getVel(const Tptcl &) const { return F64vec(0.0); }
+        void setVel(Tptcl &, const F64vec &) const {}
+        void packExtra(const Tptcl &, char *) const {}
+        void unpackExtra(Tptcl &, const char *) const {}
+    };
+
+}
@@ -477,6 +477,79 @@ namespace  ParticleSimulator{
             for(S32 i=0; i<DIMENSION; i++) pa[i] = periodic_axis_[i];
         }
 
+        // checkpoint of the decomposition. All the processes hold the same
+        // data, so that it is written by one process.
+        void writeCheckpoint(FILE * fp) const {
+            const S32 n_proc = Comm::getNumberOfProc();
+            const S32 first = first_call_by_decomposeDomain ? 1 : 0;
+            fwrite(&n_proc, sizeof(n_proc), 1, fp);
+            fwrite(&coef_ema_, sizeof(coef_ema_), 1, fp);
+            fwrite(n_domain_, sizeof(n_domain_[0]), DIMENSION_LIMIT, fp);
+            fwrite(&pos_root_domain_, sizeof(pos_root_domain_), 1, fp);
+            fwrite(&boundary_condition_, sizeof(boundary_condition_), 1, fp);
+            fwrite(periodic_axis_, sizeof(periodic_axis_[0]), DIMENSION_LIMIT, fp);
+            fwrite(&first, sizeof(first), 1, fp);
+            fwrite(pos_domain_, sizeof(pos_domain_[0]), n_proc, fp);
+        }
+
+        // Reads on one process, to be followed by broadcastCheckpoint. If the
+        // number of processes has changed, the domains are not restored (false
+        // is returned) and have to be decomposed again.
+        bool readCheckpoint(FILE * fp){
+            const S32 n_proc = Comm::getNumberOfProc();
+            S32 n_proc_file, first;
+            S32 n_domain[DIMENSION_LIMIT];
+            bool success = (fread(&n_proc_file, sizeof(n_proc_file), 1, fp) == 1);
+            success = success && (fread(&coef_ema_, sizeof(coef_ema_), 1, fp) == 1);
+            success = success && (fread(n_domain, sizeof(n_domain[0]), DIMENSION_LIMIT, fp) == DIMENSION_LIMIT);
+            success = success && (fread(&pos_root_domain_, sizeof(pos_root_domain_), 1, fp) == 1);
+            success = success && (fread(&boundary_condition_, sizeof(boundary_condition_), 1, fp) == 1);
+            success = success && (fread(periodic_axis_, sizeof(periodic_axis_[0]), DIMENSION_LIMIT, fp) == DIMENSION_LIMIT);
+            success = success && (fread(&first, sizeof(first), 1, fp) == 1);
+            if(!success || n_proc_file <= 0){
+                PARTICLE_SIMULATOR_PRINT_ERROR("can not read the domains of the checkpoint");
+                Abort(-1);
+            }
+            std::vector<F64ort> pos_domain(n_proc_file);
+            if(fread(&pos_domain[0], sizeof(pos_domain[0]), n_proc_file, fp) != (size_t)n_proc_file){
+                PARTICLE_SIMULATOR_PRINT_ERROR("can not read the domains of the checkpoint");
+                std::cerr<<"n_proc_file: "<<n_proc_file<<std::endl;
+                Abort(-1);
+            }
+            if(n_proc_file != n_proc){
+                first_call_by_decomposeDomain = true;
+                return false;
+            }
+            for(S32 i=0; i<DIMENSION_LIMIT; i++) n_domain_[i] = n_domain[i];
+            for(S32 i=0; i<n_proc; i++) pos_domain_[i] = pos_domain[i];
+            first_call_by_decomposeDomain = (first != 0);
+            return true;
+        }
+
+        // copies the state read by readCheckpoint on rank 0 to all the processes
+        bool broadcastCheckpoint(const bool restored){
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            const S32 n_proc = Comm::getNumberOfProc();
+            S32 flag[2+DIMENSION_LIMIT];
+            flag[0] = restored ? 1 : 0;
+            flag[1] = first_call_by_decomposeDomain ? 1 : 0;
+            for(S32 i=0; i<DIMENSION_LIMIT; i++) flag[2+i] = periodic_axis_[i] ? 1 : 0;
+            MPI::COMM_WORLD.Bcast(flag, 2+DIMENSION_LIMIT, GetDataType<S32>(), 0);
+            MPI::COMM_WORLD.Bcast(&coef_ema_, 1, GetDataType<F32>(), 0);
+            MPI::COMM_WORLD.Bcast(&boundary_condition_, 1, GetDataType<S32>(), 0);
+            MPI::COMM_WORLD.Bcast(&pos_root_domain_, 1, GetDataType<F64ort>(), 0);
+            first_call_by_decomposeDomain = (flag[1] != 0);
+            for(S32 i=0; i<DIMENSION_LIMIT; i++) periodic_axis_[i] = (flag[2+i] != 0);
+            if(flag[0]){
+                MPI::COMM_WORLD.Bcast(n_domain_, DIMENSION_LIMIT, GetDataType<S32>(), 0);
+                MPI::COMM_WORLD.Bcast(pos_domain_, n_proc, GetDataType<F64ort>(), 0);
+            }
+            return flag[0] != 0;
+#else
+            return restored;
+#endif
+        }
+
         template<class Tpsys>
         bool checkCollectSampleParticleSubset(Tpsys & psys);
         template<class Tpsys>
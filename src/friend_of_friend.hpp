@@ -0,0 +1,276 @@
+#pragma once
+
+#include<vector>
+#include<algorithm>
+
+namespace ParticleSimulator{
+
+    // In situ friends-of-friends group finder.
+    //
+    // The particles (getPos() and getCharge() of Tptcl) are copied to an
+    // internal ParticleSystem and the pairs closer than the linking length
+    // are found with a TreeForForceShort::Scatter tree, whose LET brings the
+    // ghost particles of the neighbouring domains. The local pairs are
+    // joined by union-find; the groups which span domains are merged by
+    // sending the labels across the pairs with a ghost until nothing
+    // changes. A particle is identified globally by (rank, index), and a
+    // group by the smallest one of its members. The catalogue of a group is
+    // kept by the process owning that member.
+    struct FoFGroup{
+        S64 id_;
+        S64 n_ptcl_;
+        F64 mass_;
+        F64vec pos_; // centre of mass
+    };
+
+    class FriendOfFriend{
+    public:
+        struct Force{
+            void clear(){}
+        };
+        struct Particle{
+            F64vec pos_;
+            F64 mass_;
+            F64 r_search_;
+            S32 adr_;
+            S32 rank_;
+            F64vec getPos() const { return pos_; }
+            void setPos(const F64vec & pos){ pos_ = pos; }
+            void copyFromForce(const Force &){}
+        };
+        struct EP{
+            F64vec pos_;
+            F64 r_search_;
+            S32 adr_;
+            S32 rank_;
+            F64vec getPos() const { return pos_; }
+            void setPos(const F64vec & pos){ pos_ = pos; }
+            F64 getRSearch() const { return r_search_; }
+            void copyFromFP(const Particle & p){
+                pos_ = p.pos_;
+                r_search_ = p.r_search_;
+                adr_ = p.adr_;
+                rank_ = p.rank_;
+            }
+        };
+
+    private:
+        struct Link{
+            S32 adr_i_;
+            S32 rank_j_;
+            S32 adr_j_;
+            bool operator < (const Link & rhs) const {
+                if(adr_i_ != rhs.adr_i_) return adr_i_ < rhs.adr_i_;
+                if(rank_j_ != rhs.rank_j_) return rank_j_ < rhs.rank_j_;
+                return adr_j_ < rhs.adr_j_;
+            }
+            bool operator == (const Link & rhs) const {
+                return adr_i_ == rhs.adr_i_ && rank_j_ == rhs.rank_j_ && adr_j_ == rhs.adr_j_;
+            }
+        };
+        // the pairs are collected by the threads calling the kernel. A
+        // local pair is kept once, from the larger address; the periodic
+        // images of local particles (shifted positions) are always kept.
+        struct LinkFinder{
+            std::vector< std::vector<Link> > * link_;
+            const ParticleSystem<Particle> * psys_;
+            F64 r2_;
+            S32 rank_;
+            void operator () (const EP * epi, const S32 n_ip, const EP * epj, const S32 n_jp, Force *){
+                std::vector<Link> & link = (*link_)[Comm::getThreadNum()];
+                for(S32 i=0; i<n_ip; i++){
+                    for(S32 j=0; j<n_jp; j++){
+                        const F64vec dr = epi[i].pos_ - epj[j].pos_;
+                        if(dr*dr > r2_) continue;
+                        if( epj[j].rank_ == rank_ && epj[j].adr_ <= epi[i].adr_
+                            && epj[j].pos_ == (*psys_)[epj[j].adr_].pos_ ) continue;
+                        Link l;
+                        l.adr_i_ = epi[i].adr_;
+                        l.rank_j_ = epj[j].rank_;
+                        l.adr_j_ = epj[j].adr_;
+                        link.push_back(l);
+                    }
+                }
+            }
+        };
+        struct Label{
+            S32 adr_;
+            S64 label_;
+        };
+        struct Partial{
+            S64 id_;
+            S64 n_ptcl_;
+            F64 mass_;
+            F64vec mass_pos_;
+            bool operator < (const Partial & rhs) const { return id_ < rhs.id_; }
+        };
+
+        ParticleSystem<Particle> psys_;
+        TreeForForceShort<Force, EP, EP>::Scatter tree_;
+        bool is_tree_initialized_;
+        std::vector< std::vector<Link> > link_;
+        std::vector<S32> parent_;
+        std::vector<S64> label_;
+        std::vector<FoFGroup> group_;
+
+        S32 find(S32 i){
+            while(parent_[i] != i){
+                parent_[i] = parent_[parent_[i]];
+                i = parent_[i];
+            }
+            return i;
+        }
+        void unite(S32 i, S32 j){
+            i = find(i);
+            j = find(j);
+            if(i < j) parent_[j] = i;
+            else if(j < i) parent_[i] = j;
+        }
+        static S64 getGlobalIndex(const S32 rank, const S32 adr){
+            return ((S64)rank << 32) + (S64)adr;
+        }
+        template<class T>
+        static void exchange(const std::vector< std::vector<T> > & send, std::vector<T> & recv){
+            const S32 n_proc = Comm::getNumberOfProc();
+            std::vector<S32> n_send(n_proc), n_recv(n_proc), n_send_disp(n_proc+1, 0), n_recv_disp(n_proc+1, 0);
+            for(S32 r=0; r<n_proc; r++){
+                n_send[r] = send[r].size();
+                n_send_disp[r+1] = n_send_disp[r] + n_send[r];
+            }
+            std::vector<T> buf(n_send_disp[n_proc] + 1);
+            for(S32 r=0; r<n_proc; r++) std::copy(send[r].begin(), send[r].end(), buf.begin() + n_send_disp[r]);
+            Comm::allToAll(&n_send[0], 1, &n_recv[0]);
+            for(S32 r=0; r<n_proc; r++) n_recv_disp[r+1] = n_recv_disp[r] + n_recv[r];
+            recv.resize(n_recv_disp[n_proc] + 1);
+            Comm::allToAllV(&buf[0], &n_send[0], &n_send_disp[0], &recv[0], &n_recv[0], &n_recv_disp[0]);
+            recv.resize(n_recv_disp[n_proc]);
+        }
+
+    public:
+        FriendOfFriend() : is_tree_initialized_(false) {}
+
+        // Collective. Groups with fewer than n_ptcl_min members are not in
+        // the catalogue (but getGroupId still gives their id).
+        template<class Tpsys>
+        void calcGroup(const Tpsys & psys, DomainInfo & dinfo, const F64 link_length, const S64 n_ptcl_min = 2){
+            const S32 n_loc = psys.getNumberOfParticleLocal();
+            const S32 rank = Comm::getRank();
+            const S32 n_proc = Comm::getNumberOfProc();
+            const S32 n_thread = Comm::getNumberOfThread();
+            if(!is_tree_initialized_){
+                psys_.initialize();
+                tree_.initialize(psys.getNumberOfParticleGlobal());
+                is_tree_initialized_ = true;
+            }
+            psys_.setNumberOfParticleLocal(n_loc);
+#pragma omp parallel for
+            for(S32 i=0; i<n_loc; i++){
+                psys_[i].pos_ = psys[i].getPos();
+                psys_[i].mass_ = psys[i].getCharge();
+                psys_[i].r_search_ = link_length;
+                psys_[i].adr_ = i;
+                psys_[i].rank_ = rank;
+            }
+            link_.assign(n_thread, std::vector<Link>());
+            LinkFinder finder;
+            finder.link_ = &link_;
+            finder.psys_ = &psys_;
+            finder.r2_ = link_length * link_length;
+            finder.rank_ = rank;
+            tree_.calcForceAll(finder, psys_, dinfo);
+
+            // local pairs
+            parent_.resize(n_loc);
+            for(S32 i=0; i<n_loc; i++) parent_[i] = i;
+            std::vector<Link> link_remote;
+            for(S32 ith=0; ith<n_thread; ith++){
+                for(size_t k=0; k<link_[ith].size(); k++){
+                    const Link & l = link_[ith][k];
+                    if(l.rank_j_ == rank) unite(l.adr_i_, l.adr_j_);
+                    else link_remote.push_back(l);
+                }
+                std::vector<Link>().swap(link_[ith]);
+            }
+            label_.resize(n_loc);
+            for(S32 i=0; i<n_loc; i++){
+                if(parent_[i] == i) label_[i] = getGlobalIndex(rank, i);
+            }
+            for(size_t k=0; k<link_remote.size(); k++) link_remote[k].adr_i_ = find(link_remote[k].adr_i_);
+            std::sort(link_remote.begin(), link_remote.end());
+            link_remote.erase(std::unique(link_remote.begin(), link_remote.end()), link_remote.end());
+
+            // groups across the domains: the smallest label wins
+            std::vector< std::vector<Label> > label_send(n_proc);
+            std::vector<Label> label_recv;
+            while(true){
+                for(S32 r=0; r<n_proc; r++) label_send[r].clear();
+                for(size_t k=0; k<link_remote.size(); k++){
+                    Label l;
+                    l.adr_ = link_remote[k].adr_j_;
+                    l.label_ = label_[link_remote[k].adr_i_];
+                    label_send[link_remote[k].rank_j_].push_back(l);
+                }
+                exchange(label_send, label_recv);
+                bool changed = false;
+                for(size_t k=0; k<label_recv.size(); k++){
+                    const S32 root = find(label_recv[k].adr_);
+                    if(label_recv[k].label_ < label_[root]){
+                        label_[root] = label_recv[k].label_;
+                        changed = true;
+                    }
+                }
+                if(!Comm::synchronizeConditionalBranchOR(changed)) break;
+            }
+
+            // catalogue: the partial sums go to the owner of the group id
+            std::vector<Partial> partial;
+            std::vector<S32> adr_partial(n_loc, -1);
+            for(S32 i=0; i<n_loc; i++){
+                const S32 root = find(i);
+                if(adr_partial[root] < 0){
+                    adr_partial[root] = partial.size();
+                    Partial p;
+                    p.id_ = label_[root];
+                    p.n_ptcl_ = 0;
+                    p.mass_ = 0.0;
+                    p.mass_pos_ = 0.0;
+                    partial.push_back(p);
+                }
+                Partial & p = partial[adr_partial[root]];
+                p.n_ptcl_++;
+                p.mass_ += psys_[i].mass_;
+                p.mass_pos_ += psys_[i].mass_ * psys_[i].pos_;
+            }
+            std::vector< std::vector<Partial> > partial_send(n_proc);
+            for(size_t k=0; k<partial.size(); k++) partial_send[partial[k].id_ >> 32].push_back(partial[k]);
+            std::vector<Partial> partial_recv;
+            exchange(partial_send, partial_recv);
+            std::sort(partial_recv.begin(), partial_recv.end());
+            group_.clear();
+            for(size_t k=0; k<partial_recv.size(); ){
+                FoFGroup g;
+                g.id_ = partial_recv[k].id_;
+                g.n_ptcl_ = 0;
+                g.mass_ = 0.0;
+                g.pos_ = 0.0;
+                for( ; k<partial_recv.size() && partial_recv[k].id_ == g.id_; k++){
+                    g.n_ptcl_ += partial_recv[k].n_ptcl_;
+                    g.mass_ += partial_recv[k].mass_;
+                    g.pos_ += partial_recv[k].mass_pos_;
+                }
+                if(g.n_ptcl_ < n_ptcl_min) continue;
+                if(g.mass_ > 0.0) g.pos_ = g.pos_ / g.mass_;
+                group_.push_back(g);
+            }
+        }
+
+        // the group of psys[i] of the last calcGroup
+        S64 getGroupId(const S32 i){ return label_[find(i)]; }
+        // the groups owned by this process
+        S32 getNumberOfGroupLocal() const { return group_.size(); }
+        S64 getNumberOfGroupGlobal() const { return Comm::getSum((S64)group_.size()); }
+        const FoFGroup & getGroup(const S32 i) const { return group_[i]; }
+        const std::vector<FoFGroup> & getGroups() const { return group_; }
+    };
+
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include<cstdio>
+#include<cstring>
+#include<string>
+#include<vector>
+
+namespace ParticleSimulator{
+
+    // Building blocks of ParticleSystem::readParticleGadget and
+    // writeParticleGadget.
+    //
+    // A Gadget file is a sequence of Fortran records (int size, data, int
+    // size): HEAD (GadgetSnapshotHeader), POS (float[3]), VEL (float[3]), ID
+    // (int or long long) and MASS (float, only for the types whose Massarr_
+    // is 0), with the particles ordered by type. In the format 2, every
+    // record is preceded by an 8 byte record holding its 4 character label.
+    // Files in either byte order are read. A set of NumFiles_ files is named
+    // basename.0, basename.1, ...
+    //
+    // Accessor (user defined, the values are those stored in the file):
+    //   void setPos(Tptcl &, const F64vec &) const;  F64vec getPos(const Tptcl &) const;
+    //   void setVel(Tptcl &, const F64vec &) const;  F64vec getVel(const Tptcl &) const;
+    //   void setId(Tptcl &, const S64) const;        S64 getId(const Tptcl &) const;
+    //   void setMass(Tptcl &, const F64) const;      F64 getMass(const Tptcl &) const;
+    //   void setType(Tptcl &, const S32) const;      S32 getType(const Tptcl &) const;
+
+    struct GadgetSnapshotHeader{
+        S32 Npart_[6];
+        F64 Massarr_[6];
+        F64 Time_;
+        F64 Redshift_;
+        S32 FlagSfr_;
+        S32 FlagFeedback_;
+        U32 Nall_[6];
+        S32 FlagCooling_;
+        S32 NumFiles_;
+        F64 BoxSize_;
+        F64 Omega0_;
+        F64 OmegaLambda_;
+        F64 HubbleParam_;
+        S32 FlagStellarAge_;
+        S32 FlagMetals_;
+        U32 NallHW_[6];
+        S32 flag_entr_ics_;
+        char unused_[256 - 6*4 - 6*8 - 2*8 - 2*4 - 6*4 - 2*4 - 4*8 - 9*4];
+        GadgetSnapshotHeader(){
+            memset(this, 0, sizeof(*this));
+            NumFiles_ = 1;
+        }
+        S64 getNumberOfParticleFile() const {
+            S64 n = 0;
+            for(S32 k=0; k<6; k++) n += Npart_[k];
+            return n;
+        }
+        S64 getNumberOfParticleGlobal(const S32 k) const {
+            return ((S64)NallHW_[k] << 32) + (S64)Nall_[k];
+        }
+    };
+
+    inline void GadgetSwapByte(void * p, const size_t size, const size_t n){
+        char * c = (char *)p;
+        for(size_t i=0; i<n; i++, c+=size){
+            for(size_t j=0; j<size/2; j++) std::swap(c[j], c[size-1-j]);
+        }
+    }
+
+    inline void GadgetSwapByte(GadgetSnapshotHeader & h){
+        GadgetSwapByte(h.Npart_, 4, 6);
+        GadgetSwapByte(h.Massarr_, 8, 6);
+        GadgetSwapByte(&h.Time_, 8, 1);
+        GadgetSwapByte(&h.Redshift_, 8, 1);
+        GadgetSwapByte(&h.FlagSfr_, 4, 1);
+        GadgetSwapByte(&h.FlagFeedback_, 4, 1);
+        GadgetSwapByte(h.Nall_, 4, 6);
+        GadgetSwapByte(&h.FlagCooling_, 4, 1);
+        GadgetSwapByte(&h.NumFiles_, 4, 1);
+        GadgetSwapByte(&h.BoxSize_, 8, 1);
+        GadgetSwapByte(&h.Omega0_, 8, 1);
+        GadgetSwapByte(&h.OmegaLambda_, 8, 1);
+        GadgetSwapByte(&h.HubbleParam_, 8, 1);
+        GadgetSwapByte(&h.FlagStellarAge_, 4, 1);
+        GadgetSwapByte(&h.FlagMetals_, 4, 1);
+        GadgetSwapByte(h.NallHW_, 4, 6);
+        GadgetSwapByte(&h.flag_entr_ics_, 4, 1);
+    }
+
+    inline F64vec GadgetToVector(const float v[3]){
+#ifdef PARTICLE_SIMULATOR_TWO_DIMENSION
+        return F64vec(v[0], v[1]);
+#else
+        return F64vec(v[0], v[1], v[2]);
+#endif
+    }
+
+    inline void GadgetFromVector(const F64vec & v, float f[3]){
+        f[0] = v.x;
+        f[1] = v.y;
+#ifdef PARTICLE_SIMULATOR_TWO_DIMENSION
+        f[2] = 0.0;
+#else
+        f[2] = v.z;
+#endif
+    }
+
+    // One file opened for reading: the header is read and the records are
+    // located, so that any range of particles is read from each block.
+    class GadgetFile{
+    private:
+        FILE * fp_;
+        bool swap_;
+        bool format2_;
+        S64 offset_[4]; // POS, VEL, ID, MASS (-1: none)
+        S32 size_id_;
+        S64 n_ptcl_;
+        S64 head_type_[7];
+        S64 head_mass_[6]; // index of the first particle of the type in MASS
+        S32 readInt(){
+            S32 i = 0;
+            if(fread(&i, 4, 1, fp_) != 1) return -1;
+            if(swap_) GadgetSwapByte(&i, 4, 1);
+            return i;
+        }
+        // the size of the next record, fp_ at its data. In the format 2,
+        // the label of the record must be label.
+        S64 nextRecord(const char * const label){
+            if(format2_){
+                char name[4];
+                if(readInt() != 8 || fread(name, 1, 4, fp_) != 4) return -1;
+                if(strncmp(name, label, 4) != 0){
+                    PARTICLE_SIMULATOR_PRINT_ERROR("unexpected block in the Gadget file");
+                    std::cerr<<"label: "<<std::string(name, 4)<<" expected: "<<label<<std::endl;
+                    Abort(-1);
+                }
+                fseek(fp_, 8, SEEK_CUR);
+            }
+            return readInt();
+        }
+        void read(const S64 offset, void * buf, const size_t size, const size_t n){
+            fseek(fp_, offset, SEEK_SET);
+            if(fread(buf, size, n, fp_) != n){
+                PARTICLE_SIMULATOR_PRINT_ERROR("unexpected end of the Gadget file");
+                Abort(-1);
+            }
+            if(swap_) GadgetSwapByte(buf, size, n);
+        }
+    public:
+        GadgetSnapshotHeader header_;
+        GadgetFile(const char * const filename) : fp_(NULL), swap_(false), format2_(false), size_id_(4){
+            fp_ = fopen(filename, "rb");
+            if(fp_ == NULL){
+                PARTICLE_SIMULATOR_PRINT_ERROR("can not open input file");
+                std::cerr<<"filename: "<<filename<<std::endl;
+                Abort(-1);
+            }
+            S32 first = 0;
+            fread(&first, 4, 1, fp_);
+            if(first != 256 && first != 8){
+                GadgetSwapByte(&first, 4, 1);
+                swap_ = true;
+            }
+            if(first != 256 && first != 8){
+                PARTICLE_SIMULATOR_PRINT_ERROR("not a Gadget snapshot");
+                std::cerr<<"filename: "<<filename<<std::endl;
+                Abort(-1);
+            }
+            format2_ = (first == 8);
+            rewind(fp_);
+            nextRecord("HEAD");
+            fread(&header_, sizeof(header_), 1, fp_);
+            if(swap_) GadgetSwapByte(header_);
+            readInt();
+            n_ptcl_ = header_.getNumberOfParticleFile();
+            head_type_[0] = 0;
+            S64 n_mass = 0;
+            for(S32 k=0; k<6; k++){
+                head_type_[k+1] = head_type_[k] + header_.Npart_[k];
+                head_mass_[k] = n_mass;
+                if(header_.Massarr_[k] == 0.0) n_mass += header_.Npart_[k];
+            }
+            const char * const label[4] = {"POS ", "VEL ", "ID  ", "MASS"};
+            for(S32 b=0; b<4; b++){
+                offset_[b] = -1;
+                if(b == 3 && n_mass == 0) break;
+                const S64 size = nextRecord(label[b]);
+                if(size < 0) break;
+                offset_[b] = ftell(fp_);
+                if(b == 2 && n_ptcl_ > 0) size_id_ = size / n_ptcl_;
+                fseek(fp_, size + 4, SEEK_CUR);
+            }
+            if(n_ptcl_ > 0 && (offset_[0] < 0 || offset_[1] < 0 || offset_[2] < 0 || (n_mass > 0 && offset_[3] < 0))){
+                PARTICLE_SIMULATOR_PRINT_ERROR("the Gadget file has too few blocks");
+                std::cerr<<"filename: "<<filename<<std::endl;
+                Abort(-1);
+            }
+        }
+        ~GadgetFile(){
+            if(fp_ != NULL) fclose(fp_);
+        }
+        S64 getNumberOfParticle() const { return n_ptcl_; }
+        S32 getType(const S64 i) const {
+            S32 k = 0;
+            while(i >= head_type_[k+1]) k++;
+            return k;
+        }
+        void readPos(const S64 head, const S64 n, float * buf){ read(offset_[0] + head*12, buf, 4, n*3); }
+        void readVel(const S64 head, const S64 n, float * buf){ read(offset_[1] + head*12, buf, 4, n*3); }
+        void readId(const S64 head, const S64 n, S64 * buf){
+            if(size_id_ == 8){
+                read(offset_[2] + head*8, buf, 8, n);
+            }
+            else{
+                S32 * ibuf = (S32 *)buf;
+                read(offset_[2] + head*4, ibuf, 4, n);
+                for(S64 i=n-1; i>=0; i--) buf[i] = (U32)ibuf[i];
+            }
+        }
+        // the particles of [head, head+n) are of type k
+        void readMass(const S32 k, const S64 head, const S64 n, float * buf){
+            read(offset_[3] + (head_mass_[k] + head - head_type_[k]) * 4, buf, 4, n);
+        }
+        S64 getHeadOfType(const S32 k) const { return head_type_[k]; }
+    };
+
+    // no mass, no type (dark matter only ICs)
+    template<class Tptcl>
+    struct GadgetAccessorDefault{
+        void setPos(Tptcl & p, const F64vec & x) const { p.setPos(x); }
+        F64vec getPos(const Tptcl & p) const { return p.getPos(); }
+        void setVel(Tptcl &, const F64vec &) const {}
+        F64vec getVel(const Tptcl &) const { return F64vec(0.0); }
+        void setId(Tptcl &, const S64) const {}
+        S64 getId(const Tptcl &) const { return 0; }
+        void setMass(Tptcl &, const F64) const {}
+        F64 getMass(const Tptcl &) const { return 0.0; }
+        void setType(Tptcl &, const S32) const {}
+        S32 getType(const Tptcl &) const { return 1; }
+    };
+
+}
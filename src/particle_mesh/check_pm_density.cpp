@@ -0,0 +1,112 @@
+/*
+  Checks assignDensityTSCColumn (the OpenMP path of
+  PMForce::setLocalMeshDensity) against the serial TSC assignment.
+  Needs no FFTW: make check
+*/
+#include "pm_density.h"
+
+using namespace ParticleSimulator::ParticleMesh;
+
+
+
+static void assignDensityTSCSerial( const Particle *particle, const int npart,
+				    const double uniform_mass, const float *g_pos_f,
+				    const int *l_msize, const int size_mesh, float *rho){
+
+  for( int p=0; p<npart; p++){
+    float pos[3];
+    getPos2( &particle[p], pos);
+    pos[0] -= g_pos_f[0];
+    pos[1] -= g_pos_f[1];
+    pos[2] -= g_pos_f[2];
+    float mass = getMass( &particle[p], uniform_mass);
+
+    float wi[3][3];
+    int iw[3][3];
+
+    for( int j=0; j<3; j++){
+      float xt1  = pos[j] * (float)size_mesh;
+      iw[1][j] = (int)(xt1 + 0.5);
+      float dx1 = xt1 - (float)(iw[1][j]);
+      wi[0][j] = 0.5 * (0.5-dx1) * (0.5-dx1);
+      wi[1][j] = 0.75 - dx1*dx1;
+      wi[2][j] = 0.5 * (0.5 + dx1) * (0.5 + dx1);
+      iw[0][j] = iw[1][j] - 1;
+      iw[2][j] = iw[1][j] + 1;
+    }
+
+    for( int i=0; i<3; i++){
+      for( int j=0; j<3; j++){
+	for( int k=0; k<3; k++){
+	  int ii = iw[k][2] + l_msize[2]*( iw[j][1] + l_msize[1]*iw[i][0]);
+	  rho[ii] += mass*wi[i][0]*wi[j][1]*wi[k][2];
+	}
+      }
+    }
+  }
+
+}
+
+
+
+int main( int argc, char **argv){
+
+  const int size_mesh = 64;
+  const int l_msize[3] = { 23, 31, 17};
+  const float g_pos_f[3] = { 0.25, 0.5, 0.125};
+  const int npart = 200000;
+  const int ln_total = l_msize[0]*l_msize[1]*l_msize[2];
+
+  /* half uniform, half in a clump, one mesh spacing away from the edges */
+  Particle *particle = new Particle[npart];
+  srand48(1);
+  for( int p=0; p<npart; p++){
+    double x[3];
+    for( int d=0; d<3; d++){
+      double lo = 1.0;
+      double hi = l_msize[d] - 2.0;
+      if( p % 2 == 1){
+	lo = 0.5 * l_msize[d] - 2.0;
+	hi = 0.5 * l_msize[d] + 2.0;
+      }
+      x[d] = g_pos_f[d] + (lo + (hi - lo) * drand48()) / size_mesh;
+    }
+    particle[p].xpos = x[0];
+    particle[p].ypos = x[1];
+    particle[p].zpos = x[2];
+    particle[p].id = p;
+#ifndef UNIFORM
+    particle[p].mass = 1.0 + drand48();
+#endif
+  }
+
+  float *rho_ref = new float[ln_total];
+  float *rho = new float[ln_total];
+  memset( rho_ref, 0, sizeof(float)*ln_total);
+  assignDensityTSCSerial( particle, npart, 1.0, g_pos_f, l_msize, size_mesh, rho_ref);
+
+  int error = 0;
+  const int nthread[3] = { 1, 3, 8};
+  for( int t=0; t<3; t++){
+    memset( rho, 0, sizeof(float)*ln_total);
+    assignDensityTSCColumn( particle, npart, 1.0, g_pos_f, l_msize, size_mesh, nthread[t], rho);
+    double sum_ref = 0.0, sum = 0.0, err_max = 0.0;
+    for( int i=0; i<ln_total; i++){
+      sum_ref += rho_ref[i];
+      sum += rho[i];
+      double err = fabs( rho[i] - rho_ref[i]) / (fabs( rho_ref[i]) + 1e-3);
+      if( err > err_max) err_max = err;
+    }
+    fprintf( stderr, "nthread %d: max relative error %e, mass %e %e\n", nthread[t], err_max, sum, sum_ref);
+    if( err_max > 1e-4 || fabs( sum - sum_ref) > 1e-5 * sum_ref) error = 1;
+  }
+
+  delete [] particle;
+  delete [] rho_ref;
+  delete [] rho;
+
+  if( error == 0) fprintf( stderr, "SUCCESS: assignDensityTSCColumn\n");
+  else fprintf( stderr, "ERROR: assignDensityTSCColumn\n");
+
+  return error;
+}
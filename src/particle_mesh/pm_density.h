@@ -0,0 +1,143 @@
+#ifndef _PM_DENSITY_INCLUDED
+#define _PM_DENSITY_INCLUDED
+
+#include "treepm_header.h"
+
+
+
+namespace ParticleSimulator{
+    namespace ParticleMesh{
+
+#ifdef _OPENMP
+/*
+  TSC assignment of the particles to the local mesh rho (size l_msize,
+  origin g_pos_f, size_mesh cells per unit length) by nthread threads,
+  without a private mesh per thread (PMForce::setLocalMeshDensity).
+
+  The particles are sorted by the (x,y) column of their nearest mesh
+  point. The TSC stencil of column (ix,iy) covers the columns ix-1..ix+1,
+  iy-1..iy+1, so that columns three apart in x or in y never write the
+  same cell: the columns are assigned in nine phases (ix%3, iy%3), the
+  columns of a phase in parallel, directly to rho.
+*/
+inline void assignDensityTSCColumn( const Particle *particle, const int npart,
+				    const double uniform_mass, const float *g_pos_f,
+				    const int *l_msize, const int size_mesh,
+				    const int nthread, float *rho){
+
+  const int nx = l_msize[0];
+  const int ny = l_msize[1];
+  const int ncol = nx * ny;
+  int *col = new int[npart];
+  int *adr_ptcl = new int[npart];
+  int *adr_col = new int[ncol+1];
+  int *ncol_thread = new int[ncol*nthread];
+  memset( ncol_thread, 0, sizeof(int)*ncol*nthread);
+
+#pragma omp parallel num_threads(nthread)
+  {
+    int *ncol_own = &ncol_thread[omp_get_thread_num()*ncol];
+#pragma omp for schedule(static)
+    for( int p=0; p<npart; p++){
+      float pos[3];
+      getPos2( &particle[p], pos);
+      int ix = (int)((pos[0] - g_pos_f[0]) * (float)size_mesh + 0.5);
+      int iy = (int)((pos[1] - g_pos_f[1]) * (float)size_mesh + 0.5);
+      if( ix < 0)   ix = 0;
+      if( ix >= nx) ix = nx - 1;
+      if( iy < 0)   iy = 0;
+      if( iy >= ny) iy = ny - 1;
+      col[p] = ix*ny + iy;
+      ncol_own[col[p]]++;
+    }
+  }
+
+  /* ncol_thread: head of the particles of (column, thread) */
+  int nsum = 0;
+  for( int ic=0; ic<ncol; ic++){
+    adr_col[ic] = nsum;
+    for( int i=0; i<nthread; i++){
+      int n = ncol_thread[i*ncol + ic];
+      ncol_thread[i*ncol + ic] = nsum;
+      nsum += n;
+    }
+  }
+  adr_col[ncol] = nsum;
+
+#pragma omp parallel num_threads(nthread)
+  {
+    int *ncol_own = &ncol_thread[omp_get_thread_num()*ncol];
+#pragma omp for schedule(static)
+    for( int p=0; p<npart; p++){
+      adr_ptcl[ncol_own[col[p]]++] = p;
+    }
+  }
+
+  const int NBLOCK = 64;
+  for( int color=0; color<9; color++){
+    const int cx = color / 3;
+    const int cy = color % 3;
+    const int mx = (nx - cx + 2) / 3;
+    const int my = (ny - cy + 2) / 3;
+#pragma omp parallel for num_threads(nthread) CHUNK_PM
+    for( int m=0; m<mx*my; m++){
+      const int icol = (cx + 3*(m/my))*ny + cy + 3*(m%my);
+      float pos[3][NBLOCK];
+      float mass[NBLOCK];
+      float wi[3][3][NBLOCK];
+      int iw[3][NBLOCK];
+      for( int head=adr_col[icol]; head<adr_col[icol+1]; head+=NBLOCK){
+	int n = adr_col[icol+1] - head;
+	if( n > NBLOCK) n = NBLOCK;
+
+	for( int p=0; p<n; p++){
+	  float pos_p[3];
+	  const Particle *ptcl = &particle[adr_ptcl[head+p]];
+	  getPos2( ptcl, pos_p);
+	  pos[0][p] = pos_p[0] - g_pos_f[0];
+	  pos[1][p] = pos_p[1] - g_pos_f[1];
+	  pos[2][p] = pos_p[2] - g_pos_f[2];
+	  mass[p] = getMass( ptcl, uniform_mass);
+	}
+
+	/* TSC weights, vectorized over the block */
+	for( int j=0; j<3; j++){
+	  for( int p=0; p<n; p++){
+	    float xt1  = pos[j][p] * (float)size_mesh;
+	    int ic = (int)(xt1 + 0.5);
+	    float dx1 = xt1 - (float)ic;
+	    wi[0][j][p] = 0.5 * (0.5-dx1) * (0.5-dx1);
+	    wi[1][j][p] = 0.75 - dx1*dx1;
+	    wi[2][j][p] = 0.5 * (0.5 + dx1) * (0.5 + dx1);
+	    iw[j][p] = ic;
+	  }
+	}
+
+	for( int p=0; p<n; p++){
+	  for( int i=0; i<3; i++){
+	    for( int j=0; j<3; j++){
+	      int iwxy = l_msize[2]*( iw[1][p] + j - 1 + l_msize[1]*(iw[0][p] + i - 1));
+	      float wixy = mass[p]*wi[i][0][p]*wi[j][1][p];
+	      int k0 = iw[2][p] - 1 + iwxy;
+	      rho[k0]   += wixy*wi[0][2][p];
+	      rho[k0+1] += wixy*wi[1][2][p];
+	      rho[k0+2] += wixy*wi[2][2][p];
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  delete [] col;
+  delete [] adr_ptcl;
+  delete [] adr_col;
+  delete [] ncol_thread;
+
+}
+#endif
+
+    } // namespace ParticleMesh
+}     // namespace ParticleSimulator
+
+#endif
@@ -1,4 +1,5 @@
 #include "pm_parallel.h"
+#include "pm_density.h"
 
 namespace ParticleSimulator{
     namespace ParticleMesh{
@@ -938,7 +939,18 @@ static inline int addr(int ix, int iy, int iz,
 
 void PMForce::setLocalMeshDensity( const Particle *particle, const int npart){
 
-#ifdef _OPENMP
+#if defined(_OPENMP) && !defined(THREAD_PRIVATE_MESH_DENSITY)
+  /*
+    Column-sorted assignment in nine phases, no private mesh and no
+    reduction (see pm_density.h).
+    (-DTHREAD_PRIVATE_MESH_DENSITY: one mesh per thread, as before)
+  */
+  omp_set_num_threads(NUMBER_OF_OMP_THREADS);
+  assignDensityTSCColumn( particle, npart, this_run->uniform_mass, g_pos_f,
+			  l_msize, SIZE_MESH, NUMBER_OF_OMP_THREADS,
+			  mesh_density_local);
+
+#elif defined(_OPENMP)
   omp_set_num_threads(NUMBER_OF_OMP_THREADS);
 
   int chunk_size = ln_total * NUMBER_OF_OMP_THREADS;
@@ -4,6 +4,8 @@
 #include<domain_info.hpp>
 #include<particle_system.hpp>
 #include<tree_for_force.hpp>
+#include<friend_of_friend.hpp>
+#include<projected_density.hpp>
 
 namespace PS = ParticleSimulator;
 
@@ -1,10 +1,20 @@
 #pragma once
 
 #include<cassert>
+#include<cstring>
 #include<fstream>
+#include<pthread.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
 
 #include "MT.hpp"
 #include"ps_defs.hpp"
+#include"sort.hpp"
+#include"tree.hpp"
+#include"compressed_snapshot.hpp"
+#include"gadget_snapshot.hpp"
 
 namespace ParticleSimulator{
     template<class Tptcl>
@@ -15,6 +25,15 @@ namespace ParticleSimulator{
         ReallocatableArray<Tptcl> ptcl_;
         ReallocatableArray<Tptcl> ptcl_send_;
         ReallocatableArray<Tptcl> ptcl_recv_;
+        // for sortByKey
+        ReallocatableArray<TreeParticle> tp_;
+        ReallocatableArray<TreeParticle> tp_buf_;
+        RadixSort<U64, 8> rs_;
+        // for removeParticle
+        ReallocatableArray<S32> adr_hole_;
+        ReallocatableArray<S32> adr_fill_;
+        ReallocatableArray<S32> flag_keep_;
+        S64 n_modification_; // # of calls which added, removed, reordered or exchanged particles
         //S32 n_ptcl_limit_;
         //S32 n_ptcl_;
         S32 n_smp_ptcl_tot_;
@@ -68,6 +87,95 @@ namespace ParticleSimulator{
 //        template<class Tvec, class Tdinfo>
 //        S32 whereToGo(const Tvec & pos, const Tdinfo & dinfo);
 
+        // for writeParticleBinaryAsync
+        struct WriteAsyncArg{
+            int fd_;
+            const char * data_;
+            size_t size_;
+            off_t offset_;
+            bool error_;
+        };
+        ReallocatableArray<Tptcl> ptcl_async_;
+        WriteAsyncArg write_async_;
+        pthread_t thread_async_;
+        bool is_writing_async_;
+        static void * writeAsyncThread(void * arg){
+            WriteAsyncArg * wa = (WriteAsyncArg *)arg;
+            size_t n_done = 0;
+            while(n_done < wa->size_){
+                const ssize_t n = pwrite(wa->fd_, wa->data_+n_done, wa->size_-n_done, wa->offset_+n_done);
+                if(n <= 0){
+                    wa->error_ = true;
+                    break;
+                }
+                n_done += n;
+            }
+            if(close(wa->fd_) != 0) wa->error_ = true;
+            return NULL;
+        }
+        template <class Theader>
+        void writeParticleBinaryAsyncImpl(const char * const filename, const Theader * const header){
+            waitParticleBinaryAsync();
+            const S32 n_loc = ptcl_.size();
+            ptcl_async_.resizeNoInitialize(n_loc);
+#pragma omp parallel for
+            for(S32 i=0; i<n_loc; i++) ptcl_async_[i] = ptcl_[i];
+            const S64 offset = createBinarySnapshot(filename, header);
+            write_async_.fd_ = open(filename, O_WRONLY);
+            if(write_async_.fd_ < 0){
+                PARTICLE_SIMULATOR_PRINT_ERROR("can not open output file");
+                std::cerr<<"output file: "<<filename<<std::endl;
+                Abort(-1);
+            }
+            write_async_.data_ = (const char *)ptcl_async_.getPointer();
+            write_async_.size_ = (size_t)n_loc * sizeof(Tptcl);
+            write_async_.offset_ = offset;
+            write_async_.error_ = false;
+            if(pthread_create(&thread_async_, NULL, writeAsyncThread, &write_async_) != 0){
+                PARTICLE_SIMULATOR_PRINT_ERROR("can not create the thread for the asynchronous write");
+                Abort(-1);
+            }
+            is_writing_async_ = true;
+        }
+
+        // stream compaction through ptcl_send_: each block of ptcl_ is copied
+        // to the offset given by the survivors of the preceding blocks
+        void removeParticleKeepOrder(const S32 idx[], const S32 n_remove){
+            const S32 n_old = ptcl_.size();
+            flag_keep_.resizeNoInitialize(n_old);
+#pragma omp parallel for
+            for(S32 i=0; i<n_old; i++) flag_keep_[i] = 1;
+#pragma omp parallel for
+            for(S32 i=0; i<n_remove; i++) flag_keep_[idx[i]] = 0;
+            const S32 n_block = Comm::getNumberOfThread();
+            ReallocatableArray<S32> n_keep_disp;
+            n_keep_disp.resizeNoInitialize(n_block+1);
+#pragma omp parallel for
+            for(S32 ib=0; ib<n_block; ib++){
+                const S32 head = (S64)n_old * ib / n_block;
+                const S32 tail = (S64)n_old * (ib+1) / n_block;
+                S32 n_keep = 0;
+                for(S32 i=head; i<tail; i++) n_keep += flag_keep_[i];
+                n_keep_disp[ib+1] = n_keep;
+            }
+            n_keep_disp[0] = 0;
+            for(S32 ib=0; ib<n_block; ib++) n_keep_disp[ib+1] += n_keep_disp[ib];
+            const S32 n_new = n_keep_disp[n_block];
+            ptcl_send_.resizeNoInitialize(n_new);
+#pragma omp parallel for
+            for(S32 ib=0; ib<n_block; ib++){
+                const S32 head = (S64)n_old * ib / n_block;
+                const S32 tail = (S64)n_old * (ib+1) / n_block;
+                S32 adr = n_keep_disp[ib];
+                for(S32 i=head; i<tail; i++){
+                    if(flag_keep_[i]) ptcl_send_[adr++] = ptcl_[i];
+                }
+            }
+            ptcl_.resizeNoInitialize(n_new);
+#pragma omp parallel for
+            for(S32 i=0; i<n_new; i++) ptcl_[i] = ptcl_send_[i];
+        }
+
     public:
         ParticleSystem() {
             first_call_by_setAverageTargetNumberOfSampleParticlePerProcess = true;
@@ -75,6 +183,12 @@ namespace ParticleSimulator{
             first_call_by_DomainInfo_collect_sample_particle = true;
             //n_smp_ptcl_tot_ = 30 * Comm::getNumberOfProc();
             n_smp_ptcl_tot_ = n_smp_ave_ * Comm::getNumberOfProc();
+            n_modification_ = 0;
+            is_writing_async_ = false;
+        }
+
+        ~ParticleSystem(){
+            waitParticleBinaryAsync();
         }
 	
         void initialize() {
@@ -115,7 +229,69 @@ namespace ParticleSimulator{
             //15/02/20 Hosono bug(?) fix.
             //ptcl_.reserve(n*3+1000);
             ptcl_.resizeNoInitialize(n);
+            n_modification_++;
+        }
+
+        // Appends the particles at the end of ptcl_. The capacity grows
+        // geometrically, so that repeated additions are amortized.
+        void addOneParticle(const Tptcl & fp){
+            ptcl_.push_back(fp);
+            n_modification_++;
+        }
+        void addParticle(const Tptcl ptcl[], const S32 n_add){
+            const S32 n_old = ptcl_.size();
+            ptcl_.resizeNoInitialize(n_old + n_add);
+#pragma omp parallel for
+            for(S32 i=0; i<n_add; i++){
+                ptcl_[n_old+i] = ptcl[i];
+            }
+            n_modification_++;
         }
+
+        // Removes ptcl_[idx[0..n_remove-1]] (distinct indices). By default the
+        // holes are filled with the surviving particles at the tail, which is
+        // O(n_remove) and changes the order. With keep_order=true the survivors
+        // are compacted in parallel and keep their order (O(n)).
+        void removeParticle(const S32 idx[], const S32 n_remove, const bool keep_order=false){
+            const S32 n_old = ptcl_.size();
+            const S32 n_new = n_old - n_remove;
+            for(S32 i=0; i<n_remove; i++){
+                if(idx[i] < 0 || idx[i] >= n_old){
+                    PARTICLE_SIMULATOR_PRINT_ERROR("The index of the particle to be removed is out of range");
+                    std::cerr<<"idx["<<i<<"]="<<idx[i]<<" n_ptcl="<<n_old<<std::endl;
+                    Abort(-1);
+                }
+            }
+            if(n_remove <= 0) return;
+            if(keep_order) removeParticleKeepOrder(idx, n_remove);
+            else{
+                // the particles removed from the tail
+                flag_keep_.resizeNoInitialize(n_remove);
+#pragma omp parallel for
+                for(S32 i=0; i<n_remove; i++) flag_keep_[i] = 1;
+                adr_hole_.resizeNoInitialize(0);
+                for(S32 i=0; i<n_remove; i++){
+                    if(idx[i] >= n_new) flag_keep_[idx[i]-n_new] = 0;
+                    else adr_hole_.push_back(idx[i]);
+                }
+                adr_fill_.resizeNoInitialize(0);
+                for(S32 i=0; i<n_remove; i++){
+                    if(flag_keep_[i]) adr_fill_.push_back(n_new+i);
+                }
+                assert(adr_hole_.size() == adr_fill_.size());
+                const S32 n_hole = adr_hole_.size();
+#pragma omp parallel for
+                for(S32 i=0; i<n_hole; i++){
+                    ptcl_[adr_hole_[i]] = ptcl_[adr_fill_[i]];
+                }
+                ptcl_.resizeNoInitialize(n_new);
+            }
+            n_modification_++;
+        }
+
+        // incremented whenever particles are added, removed, reordered or
+        // exchanged; used to invalidate the Verlet lists
+        S64 getNumberOfModification() const { return n_modification_; }
         ////////////////
         // 05/01/30 Hosono From
         ////////////////
@@ -133,6 +309,165 @@ namespace ParticleSimulator{
                 return -1;
             }
         };
+        // user header followed by the state of DomainInfo
+        template <class Theader, class Tdinfo>
+        struct CheckpointHeader{
+            const Theader * header_write_;
+            Theader * header_read_;
+            const Tdinfo * dinfo_write_;
+            Tdinfo * dinfo_read_;
+            bool restored_;
+            CheckpointHeader(const Theader * hw, Theader * hr, const Tdinfo * dw, Tdinfo * dr=NULL)
+                : header_write_(hw), header_read_(hr), dinfo_write_(dw), dinfo_read_(dr), restored_(false) {}
+            void writeBinary(FILE* fp) const{
+                if(header_write_ != NULL) header_write_->writeBinary(fp);
+                dinfo_write_->writeCheckpoint(fp);
+            }
+            int readBinary(FILE* fp){
+                if(header_read_ != NULL) header_read_->readBinary(fp);
+                restored_ = dinfo_read_->readCheckpoint(fp);
+                return -1;
+            }
+        };
+        template <class Theader, class Tdinfo>
+        void readCheckpointImpl(const char * const filename, Tdinfo & dinfo, Theader * const header){
+            CheckpointHeader<Theader, Tdinfo> ch(NULL, header, NULL, &dinfo);
+            readParticleBinaryImpl(filename, &ch);
+            if(!dinfo.broadcastCheckpoint(ch.restored_)){
+                dinfo.decomposeDomainAll(*this);
+            }
+            exchangeParticle(dinfo);
+        }
+        // appends the particles [head, tail) of the file
+        template <class Taccessor>
+        void readGadgetRange(GadgetFile & gf, const Taccessor & acc, const S64 head, const S64 tail, const S32 n_ptcl_buf){
+            std::vector<float> pos(n_ptcl_buf * 3), vel(n_ptcl_buf * 3), mass(n_ptcl_buf);
+            std::vector<S64> id(n_ptcl_buf);
+            std::vector<S32> type(n_ptcl_buf);
+            for(S64 i_head=head; i_head<tail; i_head+=n_ptcl_buf){
+                const S32 n = std::min((S64)n_ptcl_buf, tail-i_head);
+                gf.readPos(i_head, n, &pos[0]);
+                gf.readVel(i_head, n, &vel[0]);
+                gf.readId(i_head, n, &id[0]);
+                for(S32 k=gf.getType(i_head); k<6 && gf.getHeadOfType(k)<i_head+n; k++){
+                    const S64 k_head = std::max(i_head, gf.getHeadOfType(k));
+                    const S64 k_tail = std::min(i_head+n, gf.getHeadOfType(k+1));
+                    if(k_tail <= k_head) continue;
+                    if(gf.header_.Massarr_[k] == 0.0){
+                        gf.readMass(k, k_head, k_tail-k_head, &mass[k_head-i_head]);
+                    }
+                    for(S64 j=k_head; j<k_tail; j++){
+                        type[j-i_head] = k;
+                        if(gf.header_.Massarr_[k] != 0.0) mass[j-i_head] = gf.header_.Massarr_[k];
+                    }
+                }
+                const S32 n_old = ptcl_.size();
+                ptcl_.resizeNoInitialize(n_old + n);
+#pragma omp parallel for
+                for(S32 j=0; j<n; j++){
+                    Tptcl & p = ptcl_[n_old+j];
+                    p = Tptcl();
+                    acc.setPos(p, GadgetToVector(&pos[3*j]));
+                    acc.setVel(p, GadgetToVector(&vel[3*j]));
+                    acc.setId(p, id[j]);
+                    acc.setMass(p, mass[j]);
+                    acc.setType(p, type[j]);
+                }
+            }
+        }
+
+        template <class Tcodec>
+        void readParticleCompressedImpl(const char * const filename, const Tcodec & codec, const F64ort * const region){
+            CompressedSnapshotPreamble pre;
+            std::vector<CompressedChunkIndex> index;
+            S64 offset = 0;
+            if(Comm::getRank() == 0){
+                FILE * fp = fopen(filename, "rb");
+                if(fp == NULL){
+                    PARTICLE_SIMULATOR_PRINT_ERROR("can not open input file");
+                    std::cerr<<"filename: "<<filename<<std::endl;
+                    Abort(-1);
+                }
+                if(fread(&pre, sizeof(pre), 1, fp) != 1 || strncmp(pre.magic_, "FDPSCMP1", 8) != 0
+                   || pre.dimension_ != DIMENSION){
+                    PARTICLE_SIMULATOR_PRINT_ERROR("not a compressed FDPS snapshot of this dimension");
+                    Abort(-1);
+                }
+                index.resize(pre.n_chunk_);
+                if(pre.n_chunk_ > 0) fread(&index[0], sizeof(index[0]), pre.n_chunk_, fp);
+                offset = ftell(fp);
+                fclose(fp);
+            }
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            MPI::COMM_WORLD.Bcast(&pre, 1, GetDataType<CompressedSnapshotPreamble>(), 0);
+            MPI::COMM_WORLD.Bcast(&offset, 1, GetDataType<S64>(), 0);
+            index.resize(pre.n_chunk_);
+            if(pre.n_chunk_ > 0) MPI::COMM_WORLD.Bcast(&index[0], pre.n_chunk_, GetDataType<CompressedChunkIndex>(), 0);
+#endif
+            std::vector<S32> adr_chunk;
+            for(S32 ic=0; ic<pre.n_chunk_; ic++){
+                if(region == NULL
+                   || region->overlapped(CompressedKey::getCell(index[ic].key_min_, index[ic].key_max_,
+                                                                pre.box_, pre.n_bit_pos_)) ){
+                    adr_chunk.push_back(ic);
+                }
+            }
+            const S32 n_proc = Comm::getNumberOfProc();
+            const S32 rank = Comm::getRank();
+            const S32 n_sel = adr_chunk.size();
+            const S32 head = (S64)n_sel * rank / n_proc;
+            const S32 tail = (S64)n_sel * (rank+1) / n_proc;
+            const S32 n_bit_vel = pre.n_bit_vel_;
+            const S32 n_extra = pre.n_extra_byte_;
+            const F64 q_max = (n_bit_vel > 0) ? (F64)(((U64)1 << (n_bit_vel-1)) - 1) : 0.0;
+            ptcl_.resizeNoInitialize(0);
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            MPI::File fh = MPI::File::Open(MPI::COMM_WORLD, filename, MPI::MODE_RDONLY, MPI::INFO_NULL);
+#else
+            FILE * fp = fopen(filename, "rb");
+#endif
+            // the particles are decoded chunk by chunk straight into ptcl_
+            std::vector<char> buf;
+            for(S32 k=head; k<tail; k++){
+                const CompressedChunkIndex & ci = index[adr_chunk[k]];
+                const S32 n = ci.n_ptcl_;
+                buf.resize(ci.n_byte_ + 8);
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+                fh.Read_at((MPI::Offset)(offset + ci.offset_), &buf[0], ci.n_byte_, MPI::BYTE);
+#else
+                fseek(fp, offset + ci.offset_, SEEK_SET);
+                fread(&buf[0], 1, ci.n_byte_, fp);
+#endif
+                // keys, velocities and extra bytes are walked side by side
+                const char * p_key = &buf[0];
+                const char * p_vel = p_key;
+                for(S32 i=0; i<n; i++) GetVarint(p_vel);
+                const char * p_extra = &buf[0] + ci.n_byte_ - (S64)n*n_extra;
+                BitReader br(p_vel);
+                U64 key = 0;
+                for(S32 i=0; i<n; i++){
+                    key += GetVarint(p_key);
+                    F64vec vel(0.0);
+                    if(n_bit_vel > 0){
+                        for(S32 d=0; d<DIMENSION; d++) vel[d] = ((F64)br.get(n_bit_vel) - q_max) * ci.vel_scale_;
+                    }
+                    const F64vec pos = CompressedKey::decode(key, pre.box_, pre.n_bit_pos_);
+                    if(region != NULL && region->notOverlapped(pos)) continue;
+                    Tptcl fp_new = Tptcl();
+                    fp_new.setPos(pos);
+                    codec.setVel(fp_new, vel);
+                    if(n_extra > 0) codec.unpackExtra(fp_new, p_extra + (size_t)i*n_extra);
+                    ptcl_.push_back(fp_new);
+                }
+            }
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            fh.Close();
+#else
+            fclose(fp);
+#endif
+            n_modification_++;
+        }
+
         template <class Theader>
         void writeParticleAsciiImpl(const char * const filename, const char * const format, const Theader * const header){
             if(format == NULL){
@@ -333,6 +668,742 @@ namespace ParticleSimulator{
         void readParticleAscii(const char * const filename){
             readParticleAsciiImpl<DummyHeader>(filename, NULL, NULL);
         }
+
+        ////////////////
+        // binary snapshot (one file, collective MPI-IO)
+        // layout: BinarySnapshotPreamble, typeid(Tptcl).name(),
+        // Tptcl::getBinaryLayout() (if defined), user header
+        // (Theader::writeBinary), then the particles as raw Tptcl records in
+        // the order of the ranks.
+        // The reader aborts if the byte order, the dimension or the size of
+        // the particle differ, or if the class does not match: by the layout
+        // strings if both of the writer and the reader define one (e.g.
+        // "S64 id; F64vec pos; F64 mass;"), by the type name otherwise.
+        struct BinarySnapshotPreamble{
+            char magic_[8];
+            U32 byte_order_;
+            S32 dimension_;
+            S64 n_ptcl_;
+            S64 size_ptcl_;
+            S64 n_char_type_name_;
+            S64 n_char_layout_;
+        };
+        static const char * getBinaryLayout(TagBinaryLayout){ return Tptcl::getBinaryLayout(); }
+        static const char * getBinaryLayout(TagNoBinaryLayout){ return ""; }
+        // the offset of the particles is returned
+        template <class Theader>
+        S64 writeBinarySnapshotHeader(FILE * fp, const S64 n_ptcl_glb, const Theader * const header){
+            BinarySnapshotPreamble pre;
+            const char magic[8] = {'F','D','P','S','B','I','N','1'};
+            for(S32 i=0; i<8; i++) pre.magic_[i] = magic[i];
+            const char * type_name = typeid(Tptcl).name();
+            const char * layout = getBinaryLayout(typename HasBinaryLayout<Tptcl>::type());
+            pre.byte_order_ = 0x01020304;
+            pre.dimension_ = DIMENSION;
+            pre.n_ptcl_ = n_ptcl_glb;
+            pre.size_ptcl_ = sizeof(Tptcl);
+            pre.n_char_type_name_ = strlen(type_name);
+            pre.n_char_layout_ = strlen(layout);
+            fwrite(&pre, sizeof(pre), 1, fp);
+            fwrite(type_name, 1, pre.n_char_type_name_, fp);
+            fwrite(layout, 1, pre.n_char_layout_, fp);
+            if(header != NULL) header->writeBinary(fp);
+            return ftell(fp);
+        }
+        template <class Theader>
+        S64 readBinarySnapshotHeader(FILE * fp, S64 & n_ptcl_glb, Theader * const header){
+            BinarySnapshotPreamble pre;
+            if(fread(&pre, sizeof(pre), 1, fp) != 1 || strncmp(pre.magic_, "FDPSBIN1", 8) != 0){
+                PARTICLE_SIMULATOR_PRINT_ERROR("not an FDPS binary snapshot");
+                Abort(-1);
+            }
+            if(pre.byte_order_ != 0x01020304 || pre.dimension_ != DIMENSION){
+                PARTICLE_SIMULATOR_PRINT_ERROR("the snapshot was written with another byte order or dimension");
+                Abort(-1);
+            }
+            if(pre.size_ptcl_ != (S64)sizeof(Tptcl)){
+                PARTICLE_SIMULATOR_PRINT_ERROR("the size of the particle in the snapshot differs from sizeof(Tptcl)");
+                std::cerr<<"size in the file: "<<pre.size_ptcl_<<" sizeof(Tptcl): "<<sizeof(Tptcl)<<std::endl;
+                Abort(-1);
+            }
+            std::vector<char> type_name(pre.n_char_type_name_+1, '\0');
+            std::vector<char> layout(pre.n_char_layout_+1, '\0');
+            if(fread(&type_name[0], 1, pre.n_char_type_name_, fp) != (size_t)pre.n_char_type_name_
+               || fread(&layout[0], 1, pre.n_char_layout_, fp) != (size_t)pre.n_char_layout_){
+                PARTICLE_SIMULATOR_PRINT_ERROR("unexpected end of the binary snapshot");
+                Abort(-1);
+            }
+            const char * layout_own = getBinaryLayout(typename HasBinaryLayout<Tptcl>::type());
+            const bool match = (pre.n_char_layout_ > 0 && strlen(layout_own) > 0)
+                ? (strcmp(&layout[0], layout_own) == 0)
+                : (strcmp(&type_name[0], typeid(Tptcl).name()) == 0);
+            if(!match){
+                PARTICLE_SIMULATOR_PRINT_ERROR("the snapshot was written with another particle class");
+                std::cerr<<"class in the file: "<<&type_name[0]<<" "<<&layout[0]<<std::endl;
+                std::cerr<<"Tptcl: "<<typeid(Tptcl).name()<<" "<<layout_own<<std::endl;
+                Abort(-1);
+            }
+            if(header != NULL) header->readBinary(fp);
+            n_ptcl_glb = pre.n_ptcl_;
+            return ftell(fp);
+        }
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+        // Write_at_all/Read_at_all of n_byte bytes in pieces of at most 1 GiB,
+        // so that the count fits in int. All the processes make the same
+        // number of calls, also those with nothing to write.
+        static void writeAtAllByte(MPI::File & fh, const S64 offset, const void * const buf, const S64 n_byte){
+            const S64 n_max = (S64)1 << 30;
+            const S64 n_piece_loc = (n_byte + n_max - 1) / n_max;
+            S64 n_piece = n_piece_loc;
+            MPI::COMM_WORLD.Allreduce(&n_piece_loc, &n_piece, 1, GetDataType<S64>(), MPI::MAX);
+            for(S64 k=0; k<n_piece; k++){
+                const S64 head = std::min(k * n_max, n_byte);
+                const S64 n = std::min(n_max, n_byte - head);
+                fh.Write_at_all((MPI::Offset)(offset + head), (const char *)buf + head, (int)n, MPI::BYTE);
+            }
+        }
+        static void readAtAllByte(MPI::File & fh, const S64 offset, void * const buf, const S64 n_byte){
+            const S64 n_max = (S64)1 << 30;
+            const S64 n_piece_loc = (n_byte + n_max - 1) / n_max;
+            S64 n_piece = n_piece_loc;
+            MPI::COMM_WORLD.Allreduce(&n_piece_loc, &n_piece, 1, GetDataType<S64>(), MPI::MAX);
+            for(S64 k=0; k<n_piece; k++){
+                const S64 head = std::min(k * n_max, n_byte);
+                const S64 n = std::min(n_max, n_byte - head);
+                fh.Read_at_all((MPI::Offset)(offset + head), (char *)buf + head, (int)n, MPI::BYTE);
+            }
+        }
+#endif
+
+        // Rank 0 creates the file and writes the header. The offset of the
+        // particles of this process in the file is returned (collective).
+        template <class Theader>
+        S64 createBinarySnapshot(const char * const filename, const Theader * const header){
+            const S64 n_loc = ptcl_.size();
+            S64 n_glb = n_loc;
+            S64 n_disp = 0;
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            MPI::COMM_WORLD.Allreduce(&n_loc, &n_glb, 1, GetDataType<S64>(), MPI::SUM);
+            MPI::COMM_WORLD.Exscan(&n_loc, &n_disp, 1, GetDataType<S64>(), MPI::SUM);
+            if(Comm::getRank() == 0) n_disp = 0;
+#endif
+            S64 offset = 0;
+            if(Comm::getRank() == 0){
+                FILE * fp = fopen(filename, "wb");
+                if(fp == NULL){
+                    PARTICLE_SIMULATOR_PRINT_ERROR("can not open output file");
+                    std::cerr<<"output file: "<<filename<<std::endl;
+                    Abort(-1);
+                }
+                offset = writeBinarySnapshotHeader(fp, n_glb, header);
+                fclose(fp);
+            }
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            MPI::COMM_WORLD.Bcast(&offset, 1, GetDataType<S64>(), 0);
+#endif
+            return offset + n_disp * (S64)sizeof(Tptcl);
+        }
+
+        template <class Theader>
+        void writeParticleBinaryImpl(const char * const filename, const Theader * const header){
+            const S64 n_loc = ptcl_.size();
+            const S64 offset = createBinarySnapshot(filename, header);
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            MPI::File fh = MPI::File::Open(MPI::COMM_WORLD, filename, MPI::MODE_WRONLY, MPI::INFO_NULL);
+            writeAtAllByte(fh, offset, ptcl_.getPointer(), n_loc * (S64)sizeof(Tptcl));
+            fh.Close();
+#else
+            FILE * fp = fopen(filename, "r+b");
+            fseek(fp, offset, SEEK_SET);
+            fwrite(ptcl_.getPointer(), sizeof(Tptcl), n_loc, fp);
+            fclose(fp);
+#endif
+        }
+
+        // Rank 0 reads the header (the user header on rank 0 only, as in
+        // readParticleAscii). ptcl_ is resized to the equal share of this
+        // process, which starts at the head-th particle of the file; the
+        // offset of the first particle is returned (collective).
+        template <class Theader>
+        S64 openBinarySnapshot(const char * const filename, Theader * const header, S64 & n_glb, S64 & head){
+            n_glb = 0;
+            S64 offset = 0;
+            if(Comm::getRank() == 0){
+                FILE * fp = fopen(filename, "rb");
+                if(fp == NULL){
+                    PARTICLE_SIMULATOR_PRINT_ERROR("can not open input file");
+                    std::cerr<<"filename: "<<filename<<std::endl;
+                    Abort(-1);
+                }
+                offset = readBinarySnapshotHeader(fp, n_glb, header);
+                fclose(fp);
+            }
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            MPI::COMM_WORLD.Bcast(&n_glb, 1, GetDataType<S64>(), 0);
+            MPI::COMM_WORLD.Bcast(&offset, 1, GetDataType<S64>(), 0);
+#endif
+            const S32 n_proc = Comm::getNumberOfProc();
+            const S32 rank = Comm::getRank();
+            head = n_glb * rank / n_proc;
+            const S64 n_loc = n_glb * (rank+1) / n_proc - head;
+            this->createParticle(n_loc << 2);//Magic shift
+            ptcl_.resizeNoInitialize(n_loc);
+            return offset;
+        }
+
+        // Every process reads an equal share of the particles.
+        template <class Theader>
+        void readParticleBinaryImpl(const char * const filename, Theader * const header){
+            S64 n_glb, head;
+            const S64 offset = openBinarySnapshot(filename, header, n_glb, head);
+            const S64 n_loc = ptcl_.size();
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            MPI::File fh = MPI::File::Open(MPI::COMM_WORLD, filename, MPI::MODE_RDONLY, MPI::INFO_NULL);
+            readAtAllByte(fh, offset + head * (S64)sizeof(Tptcl), ptcl_.getPointer(), n_loc * (S64)sizeof(Tptcl));
+            fh.Close();
+#else
+            FILE * fp = fopen(filename, "rb");
+            fseek(fp, offset, SEEK_SET);
+            fread(ptcl_.getPointer(), sizeof(Tptcl), n_loc, fp);
+            fclose(fp);
+#endif
+            n_modification_++;
+        }
+
+        // Same as readParticleBinaryImpl, but every process maps its own byte
+        // range of the file and the threads copy it in blocks, so that the
+        // pages are faulted in concurrently without going through MPI-IO. If
+        // mmap fails, the blocks are read with pread.
+        template <class Theader>
+        void readParticleBinaryMappedImpl(const char * const filename, Theader * const header){
+            S64 n_glb, head;
+            const S64 offset = openBinarySnapshot(filename, header, n_glb, head);
+            const S64 n_loc = ptcl_.size();
+            n_modification_++;
+            if(n_loc == 0) return;
+            const int fd = open(filename, O_RDONLY);
+            if(fd < 0){
+                PARTICLE_SIMULATOR_PRINT_ERROR("can not open input file");
+                std::cerr<<"filename: "<<filename<<std::endl;
+                Abort(-1);
+            }
+            // a mapped page beyond the end of the file raises SIGBUS
+            struct stat st;
+            if(fstat(fd, &st) != 0 || offset + n_glb * (S64)sizeof(Tptcl) > (S64)st.st_size){
+                PARTICLE_SIMULATOR_PRINT_ERROR("the binary snapshot is truncated");
+                std::cerr<<"filename: "<<filename<<" expected size: "<<offset + n_glb * (S64)sizeof(Tptcl)<<std::endl;
+                Abort(-1);
+            }
+            const S64 n_byte = n_loc * (S64)sizeof(Tptcl);
+            const S64 byte_head = offset + head * (S64)sizeof(Tptcl);
+            const S64 page = sysconf(_SC_PAGESIZE);
+            const S64 map_head = byte_head / page * page;
+            const size_t map_len = byte_head - map_head + n_byte;
+            void * map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, map_head);
+            char * dst = (char *)ptcl_.getPointer();
+            const S32 n_block = std::max((S64)Comm::getNumberOfThread(), n_byte / (S64)(1<<24) + 1);
+            bool fail = false;
+            if(map != MAP_FAILED){
+                madvise(map, map_len, MADV_SEQUENTIAL);
+                const char * src = (const char *)map + (byte_head - map_head);
+#pragma omp parallel for schedule(dynamic)
+                for(S32 ib=0; ib<n_block; ib++){
+                    const S64 b_head = n_byte * ib / n_block;
+                    const S64 b_tail = n_byte * (ib+1) / n_block;
+                    memcpy(dst + b_head, src + b_head, b_tail - b_head);
+                }
+                munmap(map, map_len);
+            }
+            else{
+#pragma omp parallel for schedule(dynamic) reduction(||:fail)
+                for(S32 ib=0; ib<n_block; ib++){
+                    S64 b_head = n_byte * ib / n_block;
+                    const S64 b_tail = n_byte * (ib+1) / n_block;
+                    while(b_head < b_tail){
+                        const ssize_t n_read = pread(fd, dst + b_head, b_tail - b_head, byte_head + b_head);
+                        if(n_read <= 0){
+                            fail = true;
+                            break;
+                        }
+                        b_head += n_read;
+                    }
+                }
+            }
+            close(fd);
+            if(fail){
+                PARTICLE_SIMULATOR_PRINT_ERROR("failed to read the binary snapshot");
+                std::cerr<<"filename: "<<filename<<std::endl;
+                Abort(-1);
+            }
+        }
+        template <class Theader>
+        void writeParticleBinary(const char * const filename, const Theader& header){
+            writeParticleBinaryImpl(filename, &header);
+        }
+        void writeParticleBinary(const char * const filename){
+            writeParticleBinaryImpl<DummyHeader>(filename, NULL);
+        }
+        template <class Theader>
+        void readParticleBinary(const char * const filename, Theader& header){
+            readParticleBinaryImpl(filename, &header);
+        }
+        void readParticleBinary(const char * const filename){
+            readParticleBinaryImpl<DummyHeader>(filename, NULL);
+        }
+        // the particles are sent to the domains decomposed from the read ones
+        template <class Theader, class Tdinfo>
+        void readParticleBinary(const char * const filename, Theader& header, Tdinfo & dinfo){
+            readParticleBinaryImpl(filename, &header);
+            dinfo.decomposeDomainAll(*this);
+            exchangeParticle(dinfo);
+        }
+        // mmap/pread versions of readParticleBinary. With dinfo, the domains
+        // are decomposed from the particles as they are read, and one
+        // exchangeParticle sends them to their owners, so no process reads or
+        // scatters on behalf of the others.
+        template <class Theader>
+        void readParticleBinaryMapped(const char * const filename, Theader& header){
+            readParticleBinaryMappedImpl(filename, &header);
+        }
+        void readParticleBinaryMapped(const char * const filename){
+            readParticleBinaryMappedImpl<DummyHeader>(filename, NULL);
+        }
+        template <class Theader, class Tdinfo>
+        void readParticleBinaryMapped(const char * const filename, Theader& header, Tdinfo & dinfo){
+            readParticleBinaryMappedImpl(filename, &header);
+            dinfo.decomposeDomainAll(*this);
+            exchangeParticle(dinfo);
+        }
+
+        // Asynchronous version of writeParticleBinary. The particles are
+        // copied to a staging buffer and written by a background thread with
+        // pwrite, so that the simulation can go on. A new call (or
+        // waitParticleBinaryAsync) waits for the previous write to finish.
+        template <class Theader>
+        void writeParticleBinaryAsync(const char * const filename, const Theader& header){
+            writeParticleBinaryAsyncImpl(filename, &header);
+        }
+        void writeParticleBinaryAsync(const char * const filename){
+            writeParticleBinaryAsyncImpl<DummyHeader>(filename, NULL);
+        }
+        void waitParticleBinaryAsync(){
+            if(!is_writing_async_) return;
+            pthread_join(thread_async_, NULL);
+            is_writing_async_ = false;
+            if(write_async_.error_){
+                PARTICLE_SIMULATOR_PRINT_ERROR("asynchronous write of the snapshot failed");
+                Abort(-1);
+            }
+        }
+        bool isWritingParticleBinaryAsync() const { return is_writing_async_; }
+
+        // Checkpoint of the particles and the domain decomposition, in the
+        // format of writeParticleBinary (the state of DomainInfo follows the
+        // user header). readCheckpoint needs an initialized DomainInfo; it
+        // restores the domains if the number of processes is unchanged and
+        // decomposes them again otherwise, then sends the particles to them.
+        template <class Theader, class Tdinfo>
+        void writeCheckpoint(const char * const filename, const Tdinfo & dinfo, const Theader & header){
+            CheckpointHeader<Theader, Tdinfo> ch(&header, NULL, &dinfo);
+            writeParticleBinaryImpl(filename, &ch);
+        }
+        template <class Tdinfo>
+        void writeCheckpoint(const char * const filename, const Tdinfo & dinfo){
+            CheckpointHeader<DummyHeader, Tdinfo> ch(NULL, NULL, &dinfo);
+            writeParticleBinaryImpl(filename, &ch);
+        }
+        template <class Theader, class Tdinfo>
+        void readCheckpoint(const char * const filename, Tdinfo & dinfo, Theader & header){
+            readCheckpointImpl(filename, dinfo, &header);
+        }
+        template <class Tdinfo>
+        void readCheckpoint(const char * const filename, Tdinfo & dinfo){
+            readCheckpointImpl<DummyHeader>(filename, dinfo, NULL);
+        }
+
+        // Compressed snapshot in Morton order (see compressed_snapshot.hpp).
+        // The positions are quantized to n_bit_pos bits per axis of the box of
+        // all the particles (DIMENSION*n_bit_pos <= 63), the velocities to
+        // n_bit_vel bits (0: not stored). Collective.
+        template <class Tcodec>
+        void writeParticleCompressed(const char * const filename,
+                                     const Tcodec & codec,
+                                     const S32 n_bit_pos = 20,
+                                     const S32 n_bit_vel = 16,
+                                     const S32 n_ptcl_chunk = 65536){
+            if(n_bit_pos*DIMENSION > 63 || n_bit_vel < 0 || n_bit_vel > 32){
+                PARTICLE_SIMULATOR_PRINT_ERROR("invalid number of bits for the compressed snapshot");
+                Abort(-1);
+            }
+            const S32 n_loc = ptcl_.size();
+            F64ort box = GetMinBox(ptcl_.getPointer(), n_loc);
+            for(S32 d=0; d<DIMENSION; d++){
+                const F64 margin = (box.high_[d] > box.low_[d]) ? (box.high_[d] - box.low_[d]) * 1e-6 : 0.5;
+                box.low_[d] -= margin;
+                box.high_[d] += margin;
+            }
+            std::vector< std::pair<U64, S32> > key(n_loc);
+#pragma omp parallel for
+            for(S32 i=0; i<n_loc; i++){
+                key[i] = std::make_pair(CompressedKey::encode(ptcl_[i].getPos(), box, n_bit_pos), i);
+            }
+            std::sort(key.begin(), key.end());
+            const S32 n_extra = codec.getNumberOfExtraByte();
+            const F64 q_max = (n_bit_vel > 0) ? (F64)(((U64)1 << (n_bit_vel-1)) - 1) : 0.0;
+            const S32 n_chunk_loc = (n_loc + n_ptcl_chunk - 1) / n_ptcl_chunk;
+            std::vector<CompressedChunkIndex> index(n_chunk_loc);
+            std::vector< std::vector<char> > chunk(n_chunk_loc);
+#pragma omp parallel for schedule(dynamic)
+            for(S32 ic=0; ic<n_chunk_loc; ic++){
+                const S32 head = ic * n_ptcl_chunk;
+                const S32 n = std::min(n_ptcl_chunk, n_loc-head);
+                std::vector<char> & buf = chunk[ic];
+                U64 key_prev = 0;
+                for(S32 i=0; i<n; i++){
+                    PutVarint(buf, key[head+i].first - key_prev);
+                    key_prev = key[head+i].first;
+                }
+                F64 scale = 1.0;
+                if(n_bit_vel > 0){
+                    F64 v_max = 0.0;
+                    for(S32 i=0; i<n; i++){
+                        const F64vec v = codec.getVel(ptcl_[key[head+i].second]);
+                        for(S32 d=0; d<DIMENSION; d++) v_max = std::max(v_max, std::fabs(v[d]));
+                    }
+                    if(v_max > 0.0) scale = v_max / q_max;
+                    BitWriter bw(buf);
+                    for(S32 i=0; i<n; i++){
+                        const F64vec v = codec.getVel(ptcl_[key[head+i].second]);
+                        for(S32 d=0; d<DIMENSION; d++){
+                            F64 q = std::floor(v[d] / scale + 0.5);
+                            q = std::min(std::max(q, -q_max), q_max);
+                            bw.put( (U32)(q + q_max), n_bit_vel);
+                        }
+                    }
+                    bw.flush();
+                }
+                if(n_extra > 0){
+                    const size_t off = buf.size();
+                    buf.resize(off + (size_t)n*n_extra);
+                    for(S32 i=0; i<n; i++) codec.packExtra(ptcl_[key[head+i].second], &buf[off + (size_t)i*n_extra]);
+                }
+                index[ic].key_min_ = key[head].first;
+                index[ic].key_max_ = key[head+n-1].first;
+                index[ic].n_byte_ = buf.size();
+                index[ic].n_ptcl_ = n;
+                index[ic].vel_scale_ = scale;
+            }
+            std::vector< std::pair<U64, S32> >().swap(key);
+            S64 n_byte_loc = 0;
+            for(S32 ic=0; ic<n_chunk_loc; ic++){
+                index[ic].offset_ = n_byte_loc;
+                n_byte_loc += index[ic].n_byte_;
+            }
+            S64 n_glb = n_loc;
+            std::vector<CompressedChunkIndex> index_glb;
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            const S32 n_proc = Comm::getNumberOfProc();
+            S64 n_byte_disp = 0;
+            const S64 n_loc_64 = n_loc;
+            MPI::COMM_WORLD.Allreduce(&n_loc_64, &n_glb, 1, GetDataType<S64>(), MPI::SUM);
+            MPI::COMM_WORLD.Exscan(&n_byte_loc, &n_byte_disp, 1, GetDataType<S64>(), MPI::SUM);
+            if(Comm::getRank() == 0) n_byte_disp = 0;
+            for(S32 ic=0; ic<n_chunk_loc; ic++) index[ic].offset_ += n_byte_disp;
+            std::vector<S32> n_chunk(n_proc), n_chunk_disp(n_proc+1, 0);
+            MPI::COMM_WORLD.Allgather(&n_chunk_loc, 1, GetDataType<S32>(), &n_chunk[0], 1, GetDataType<S32>());
+            for(S32 i=0; i<n_proc; i++) n_chunk_disp[i+1] = n_chunk_disp[i] + n_chunk[i];
+            index_glb.resize(n_chunk_disp[n_proc]);
+            MPI::COMM_WORLD.Gatherv(index.empty() ? NULL : &index[0], n_chunk_loc, GetDataType<CompressedChunkIndex>(),
+                                    index_glb.empty() ? NULL : &index_glb[0], &n_chunk[0], &n_chunk_disp[0],
+                                    GetDataType<CompressedChunkIndex>(), 0);
+#else
+            index_glb = index;
+#endif
+            S64 offset = 0;
+            if(Comm::getRank() == 0){
+                FILE * fp = fopen(filename, "wb");
+                if(fp == NULL){
+                    PARTICLE_SIMULATOR_PRINT_ERROR("can not open output file");
+                    std::cerr<<"output file: "<<filename<<std::endl;
+                    Abort(-1);
+                }
+                CompressedSnapshotPreamble pre;
+                const char magic[8] = {'F','D','P','S','C','M','P','1'};
+                for(S32 i=0; i<8; i++) pre.magic_[i] = magic[i];
+                pre.n_ptcl_ = n_glb;
+                pre.n_chunk_ = index_glb.size();
+                pre.dimension_ = DIMENSION;
+                pre.n_bit_pos_ = n_bit_pos;
+                pre.n_bit_vel_ = n_bit_vel;
+                pre.n_extra_byte_ = n_extra;
+                pre.box_ = box;
+                if( fwrite(&pre, sizeof(pre), 1, fp) != 1
+                    || ( !index_glb.empty()
+                         && fwrite(&index_glb[0], sizeof(index_glb[0]), index_glb.size(), fp) != index_glb.size() ) ){
+                    PARTICLE_SIMULATOR_PRINT_ERROR("can not write the header of the compressed snapshot");
+                    std::cerr<<"output file: "<<filename<<std::endl;
+                    Abort(-1);
+                }
+                offset = ftell(fp);
+                fclose(fp);
+            }
+            // the chunks are written in place, one per process at a time,
+            // and freed once written
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            MPI::COMM_WORLD.Bcast(&offset, 1, GetDataType<S64>(), 0);
+            S32 n_chunk_max = n_chunk_loc;
+            MPI::COMM_WORLD.Allreduce(&n_chunk_loc, &n_chunk_max, 1, GetDataType<S32>(), MPI::MAX);
+            MPI::File fh = MPI::File::Open(MPI::COMM_WORLD, filename, MPI::MODE_WRONLY, MPI::INFO_NULL);
+            for(S32 ic=0; ic<n_chunk_max; ic++){
+                if(ic < n_chunk_loc){
+                    writeAtAllByte(fh, offset + index[ic].offset_, &chunk[ic][0], index[ic].n_byte_);
+                    std::vector<char>().swap(chunk[ic]);
+                }
+                else writeAtAllByte(fh, offset, NULL, 0);
+            }
+            fh.Close();
+#else
+            FILE * fp = fopen(filename, "r+b");
+            if(fp == NULL){
+                PARTICLE_SIMULATOR_PRINT_ERROR("can not open output file");
+                std::cerr<<"output file: "<<filename<<std::endl;
+                Abort(-1);
+            }
+            if(fseek(fp, offset, SEEK_SET) != 0){
+                PARTICLE_SIMULATOR_PRINT_ERROR("can not seek in output file");
+                std::cerr<<"output file: "<<filename<<" offset: "<<offset<<std::endl;
+                Abort(-1);
+            }
+            for(S32 ic=0; ic<n_chunk_loc; ic++){
+                if(fwrite(&chunk[ic][0], 1, index[ic].n_byte_, fp) != (size_t)index[ic].n_byte_){
+                    PARTICLE_SIMULATOR_PRINT_ERROR("can not write the compressed snapshot");
+                    std::cerr<<"output file: "<<filename<<" chunk: "<<ic<<std::endl;
+                    Abort(-1);
+                }
+                std::vector<char>().swap(chunk[ic]);
+            }
+            if(fclose(fp) != 0){
+                PARTICLE_SIMULATOR_PRINT_ERROR("can not write the compressed snapshot");
+                std::cerr<<"output file: "<<filename<<std::endl;
+                Abort(-1);
+            }
+#endif
+        }
+        // The chunks are shared out among the processes; with region, only the
+        // chunks overlapping it are read and only the particles inside it are
+        // kept. Use exchangeParticle to send them to their domains.
+        template <class Tcodec>
+        void readParticleCompressed(const char * const filename, const Tcodec & codec){
+            readParticleCompressedImpl(filename, codec, NULL);
+        }
+        template <class Tcodec>
+        void readParticleCompressed(const char * const filename, const Tcodec & codec, const F64ort & region){
+            readParticleCompressedImpl(filename, codec, &region);
+        }
+
+        ////////////////
+        // Gadget-1/2 snapshots (see gadget_snapshot.hpp). If filename does
+        // not exist, the set filename.0, filename.1, ... is read. The files
+        // are shared out among the processes; if there are fewer files than
+        // processes, a group of processes reads each file, every one of them
+        // its own range of the particles in pieces of n_ptcl_buf. The header
+        // of the (first) file is returned on all the processes.
+        template <class Taccessor>
+        void readParticleGadget(const char * const filename, const Taccessor & acc,
+                                GadgetSnapshotHeader & header, const S32 n_ptcl_buf = 65536){
+            S32 multi = 0;
+            char name[1024];
+            if(Comm::getRank() == 0){
+                FILE * fp = fopen(filename, "rb");
+                if(fp != NULL) fclose(fp);
+                else multi = 1;
+                if(multi) snprintf(name, sizeof(name), "%s.0", filename);
+                else snprintf(name, sizeof(name), "%s", filename);
+                GadgetFile gf(name);
+                header = gf.header_;
+            }
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            MPI::COMM_WORLD.Bcast(&multi, 1, GetDataType<S32>(), 0);
+            MPI::COMM_WORLD.Bcast(&header, 1, GetDataType<GadgetSnapshotHeader>(), 0);
+#endif
+            const S32 n_file = multi ? header.NumFiles_ : 1;
+            const S32 n_proc = Comm::getNumberOfProc();
+            const S32 rank = Comm::getRank();
+            ptcl_.resizeNoInitialize(0);
+            for(S32 f=0; f<n_file; f++){
+                S32 rank_head = f % n_proc;
+                S32 rank_tail = rank_head + 1;
+                if(n_file < n_proc){
+                    rank_head = (S64)f * n_proc / n_file;
+                    rank_tail = (S64)(f+1) * n_proc / n_file;
+                }
+                if(rank < rank_head || rank >= rank_tail) continue;
+                if(multi) snprintf(name, sizeof(name), "%s.%d", filename, f);
+                else snprintf(name, sizeof(name), "%s", filename);
+                GadgetFile gf(name);
+                const S64 n_ptcl_file = gf.getNumberOfParticle();
+                const S32 n_group = rank_tail - rank_head;
+                const S64 head = n_ptcl_file * (rank - rank_head) / n_group;
+                const S64 tail = n_ptcl_file * (rank - rank_head + 1) / n_group;
+                readGadgetRange(gf, acc, head, tail, n_ptcl_buf);
+            }
+            n_modification_++;
+        }
+        template <class Taccessor, class Tdinfo>
+        void readParticleGadget(const char * const filename, const Taccessor & acc,
+                                GadgetSnapshotHeader & header, Tdinfo & dinfo){
+            readParticleGadget(filename, acc, header);
+            dinfo.decomposeDomainAll(*this);
+            exchangeParticle(dinfo);
+        }
+
+        // One file in the Gadget-1 format. Npart_, Nall_, NallHW_ and
+        // NumFiles_ of the header are set here, the other fields are taken
+        // as given. The masses are written only for the types whose Massarr_
+        // is 0. The particles are written collectively at their places in
+        // the type-ordered blocks.
+        template <class Taccessor>
+        void writeParticleGadget(const char * const filename, const Taccessor & acc,
+                                 const GadgetSnapshotHeader & header, const bool long_id = false){
+            const S32 n_loc = ptcl_.size();
+            std::vector<S32> order(n_loc);
+            S64 n_type_loc[6] = {0, 0, 0, 0, 0, 0};
+            S64 head_type_loc[7];
+            for(S32 i=0; i<n_loc; i++){
+                const S32 k = acc.getType(ptcl_[i]);
+                if(k < 0 || k >= 6){
+                    PARTICLE_SIMULATOR_PRINT_ERROR("the Gadget particle type must be in [0, 6)");
+                    std::cerr<<"type: "<<k<<std::endl;
+                    Abort(-1);
+                }
+                n_type_loc[k]++;
+            }
+            head_type_loc[0] = 0;
+            for(S32 k=0; k<6; k++) head_type_loc[k+1] = head_type_loc[k] + n_type_loc[k];
+            S64 adr_type[6];
+            for(S32 k=0; k<6; k++) adr_type[k] = head_type_loc[k];
+            for(S32 i=0; i<n_loc; i++) order[adr_type[acc.getType(ptcl_[i])]++] = i;
+            S64 n_type_glb[6];
+            S64 n_type_disp[6];
+            for(S32 k=0; k<6; k++){
+                n_type_glb[k] = n_type_loc[k];
+                n_type_disp[k] = 0;
+            }
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            MPI::COMM_WORLD.Allreduce(n_type_loc, n_type_glb, 6, GetDataType<S64>(), MPI::SUM);
+            MPI::COMM_WORLD.Exscan(n_type_loc, n_type_disp, 6, GetDataType<S64>(), MPI::SUM);
+            if(Comm::getRank() == 0){
+                for(S32 k=0; k<6; k++) n_type_disp[k] = 0;
+            }
+#endif
+            GadgetSnapshotHeader h = header;
+            h.NumFiles_ = 1;
+            S64 n_glb = 0;
+            S64 n_mass_glb = 0;
+            S64 head_type_glb[6];
+            S64 head_mass_glb[6];
+            for(S32 k=0; k<6; k++){
+                h.Npart_[k] = (S32)n_type_glb[k];
+                h.Nall_[k] = (U32)(n_type_glb[k] & 0xffffffff);
+                h.NallHW_[k] = (U32)(n_type_glb[k] >> 32);
+                head_type_glb[k] = n_glb;
+                head_mass_glb[k] = n_mass_glb;
+                n_glb += n_type_glb[k];
+                if(h.Massarr_[k] == 0.0) n_mass_glb += n_type_glb[k];
+            }
+            const S32 size_id = long_id ? 8 : 4;
+            const S32 n_record = (n_mass_glb > 0) ? 5 : 4;
+            const S64 size_record[5] = {(S64)sizeof(h), 12*n_glb, 12*n_glb, size_id*n_glb, 4*n_mass_glb};
+            if(size_record[1] > 0x7fffffff){
+                PARTICLE_SIMULATOR_PRINT_ERROR("a block of the Gadget file exceeds the 32 bit record size");
+                std::cerr<<"n_glb: "<<n_glb<<std::endl;
+                Abort(-1);
+            }
+            S64 offset[5];
+            offset[0] = 4;
+            for(S32 b=1; b<n_record; b++) offset[b] = offset[b-1] + size_record[b-1] + 8;
+            if(Comm::getRank() == 0){
+                FILE * fp = fopen(filename, "wb");
+                if(fp == NULL){
+                    PARTICLE_SIMULATOR_PRINT_ERROR("can not open output file");
+                    std::cerr<<"output file: "<<filename<<std::endl;
+                    Abort(-1);
+                }
+                // the block size markers around each block, and the header
+                for(S32 b=0; b<n_record; b++){
+                    const S32 size = (S32)size_record[b];
+                    bool success = (fseek(fp, offset[b] - 4, SEEK_SET) == 0);
+                    success = success && (fwrite(&size, 4, 1, fp) == 1);
+                    if(b == 0) success = success && (fwrite(&h, sizeof(h), 1, fp) == 1);
+                    success = success && (fseek(fp, offset[b] + size_record[b], SEEK_SET) == 0);
+                    success = success && (fwrite(&size, 4, 1, fp) == 1);
+                    if(!success){
+                        PARTICLE_SIMULATOR_PRINT_ERROR("can not write the block size markers of the Gadget file");
+                        std::cerr<<"output file: "<<filename<<" block: "<<b<<std::endl;
+                        Abort(-1);
+                    }
+                }
+                if(fclose(fp) != 0){
+                    PARTICLE_SIMULATOR_PRINT_ERROR("can not write the Gadget file");
+                    std::cerr<<"output file: "<<filename<<std::endl;
+                    Abort(-1);
+                }
+            }
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            MPI::COMM_WORLD.Barrier();
+            MPI::File fh = MPI::File::Open(MPI::COMM_WORLD, filename, MPI::MODE_WRONLY, MPI::INFO_NULL);
+#else
+            FILE * fh = fopen(filename, "r+b");
+            if(fh == NULL){
+                PARTICLE_SIMULATOR_PRINT_ERROR("can not open output file");
+                std::cerr<<"output file: "<<filename<<std::endl;
+                Abort(-1);
+            }
+#endif
+            std::vector<char> buf;
+            for(S32 b=1; b<n_record; b++){
+                const S32 size_elem = (b <= 2) ? 12 : ( (b == 3) ? size_id : 4 );
+                buf.resize((size_t)n_loc * size_elem + 1);
+#pragma omp parallel for
+                for(S32 i=0; i<n_loc; i++){
+                    const Tptcl & p = ptcl_[order[i]];
+                    char * dst = &buf[(size_t)i * size_elem];
+                    if(b == 1) GadgetFromVector(acc.getPos(p), (float *)dst);
+                    else if(b == 2) GadgetFromVector(acc.getVel(p), (float *)dst);
+                    else if(b == 3 && long_id) *(S64 *)dst = acc.getId(p);
+                    else if(b == 3) *(S32 *)dst = (S32)acc.getId(p);
+                    else *(float *)dst = acc.getMass(p);
+                }
+                for(S32 k=0; k<6; k++){
+                    S64 adr = head_type_glb[k] + n_type_disp[k];
+                    S64 n = n_type_loc[k];
+                    if(b == 4){
+                        adr = head_mass_glb[k] + n_type_disp[k];
+                        if(h.Massarr_[k] != 0.0) n = 0;
+                    }
+                    const char * src = &buf[(size_t)head_type_loc[k] * size_elem];
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+                    writeAtAllByte(fh, offset[b] + adr * size_elem, src, n * size_elem);
+#else
+                    if( fseek(fh, offset[b] + adr * size_elem, SEEK_SET) != 0
+                        || fwrite(src, size_elem, n, fh) != (size_t)n ){
+                        PARTICLE_SIMULATOR_PRINT_ERROR("can not write the particles to the Gadget file");
+                        std::cerr<<"output file: "<<filename<<" block: "<<b<<" type: "<<k<<std::endl;
+                        Abort(-1);
+                    }
+#endif
+                }
+            }
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            fh.Close();
+#else
+            if(fclose(fh) != 0){
+                PARTICLE_SIMULATOR_PRINT_ERROR("can not write the Gadget file");
+                std::cerr<<"output file: "<<filename<<std::endl;
+                Abort(-1);
+            }
+#endif
+        }
         ////////////////
         // 05/01/30 Hosono To
         ////////////////
@@ -675,6 +1746,7 @@ namespace ParticleSimulator{
             for(S32 ip = 0; ip < nrecvtot; ip++) {
                 ptcl_.pushBackNoCheck(ptcl_recv_[ip]);
             }
+            if(nsendtot > 0 || nrecvtot > 0) n_modification_++;
 	    //std::cerr<<"ptcl_.size()="<<ptcl_.size()<<std::endl;
             // ****************************************************            
 
@@ -755,9 +1827,49 @@ namespace ParticleSimulator{
             }
         }
 
+        // Reorders ptcl_ along the Morton curve in the box of all the particles
+        // (collective), so that loops over the particles and setParticleLocalTree
+        // access the memory nearly in the order of the tree. Call it every few
+        // steps after exchangeParticle; the tree has to be made again afterwards.
+        void sortByKey(){
+            const S32 n = ptcl_.size();
+            const F64ort box = GetMinBox(ptcl_.getPointer(), n);
+            const F64vec center = box.getCenter();
+            const F64 half_len = (box.high_ - box.low_).getMax() * 0.5 * 1.001;
+            if(n <= 1 || !(half_len > 0.0)) return;
+            MortonKey::initialize(half_len, center);
+            tp_.resizeNoInitialize(n);
+            tp_buf_.resizeNoInitialize(n);
+#pragma omp parallel for
+            for(S32 i=0; i<n; i++){
+                tp_[i].setFromFP(ptcl_[i], i);
+            }
+            rs_.lsdSort(tp_.getPointer(), tp_buf_.getPointer(), 0, n-1);
+            ptcl_send_.resizeNoInitialize(n);
+#pragma omp parallel for
+            for(S32 i=0; i<n; i++){
+                ptcl_send_[i] = ptcl_[tp_[i].adr_ptcl_];
+            }
+#pragma omp parallel for
+            for(S32 i=0; i<n; i++){
+                ptcl_[i] = ptcl_send_[i];
+            }
+            n_modification_++;
+        }
+
         size_t getMemSizeUsed() const {
-            return ptcl_.getMemSize() + ptcl_send_.getMemSize() + ptcl_recv_.getMemSize();
+            return ptcl_.getMemSize() + ptcl_send_.getMemSize() + ptcl_recv_.getMemSize()
+                + tp_.getMemSize() + tp_buf_.getMemSize()
+                + adr_hole_.getMemSize() + adr_fill_.getMemSize() + flag_keep_.getMemSize();
         }
 	
     };
+
+    // used by the tree to notice additions and removals in any ParticleSystem
+    template<class Tpsys>
+    inline S64 GetNumberOfModification(const Tpsys & psys){ return 0; }
+    template<class Tptcl>
+    inline S64 GetNumberOfModification(const ParticleSystem<Tptcl> & psys){
+        return psys.getNumberOfModification();
+    }
 }
@@ -5,7 +5,7 @@
 extern "C" {
 #endif
 
-#define JMEMSIZE (1<<16) /* 64K */
+#define JMEMSIZE (1<<16) /* 64K, default chunk of g5_calculate_force_on_xj */
 
 void g5_set_xmjMC(int devid, int adr, int nj, double (*xj)[3], double *mj);
 void g5_set_xmjMC0(int devid, int adr, int nj, double (*xj)[3], double *mj, double *epsj);
@@ -17,11 +17,14 @@ void g5_runMC0(int devid);
 void g5_get_forceMC(int devid, int ni, double (*a)[3], double *p);
 void g5_calculate_force_on_xMC(int devid, double (*x)[3], double (*a)[3], double *p, int ni);
 void g5_calculate_force_on_xMC0(int devid, double (*x)[3], double (*a)[3], double *p, int ni, double *eps);
+void g5_calculate_force_on_xjMC(int devid, double (*x)[3], double (*a)[3], double *p, int ni, double (*xj)[3], double *mj, int nj);
+void g5_calculate_force_on_xj(double (*x)[3], double (*a)[3], double *p, int ni, double (*xj)[3], double *mj, int nj);
 
 void g5_open(void);
 void g5_close(void);
 int  g5_get_number_of_pipelines(void);
 int  g5_get_jmemsize(void);
+void g5_set_jmemsize(int n);
 void g5_set_range(double xmin, double xmax, double mmin);
 void g5_set_n(int n);
 void g5_set_mj(int adr, int nj, double *mj);
@@ -0,0 +1,127 @@
+/* AVX-512F kernels, selected at run time in g5_open().
+   A zmm register holds 4 j-particles x the 4 i-particles (lane 4*j+i),
+   the tail of the j-list is masked. rsqrt14 is refined by one
+   Newton-Raphson step, so that the bias correction of rsqrt is not needed. */
+#include <immintrin.h>
+#include "avx_type.h"
+
+#define AVX512 __attribute__ ((target("avx512f")))
+
+static AVX512 inline __m512 rsqrt_nr(__m512 r2)
+{
+  /* y (3 - r2 y^2) / 2 */
+  __m512 y = _mm512_rsqrt14_ps(r2);
+  __m512 t = _mm512_fnmadd_ps(_mm512_mul_ps(r2, y), y, _mm512_set1_ps(3.0f));
+  return _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(0.5f), y), t);
+}
+
+static AVX512 inline __mmask16 jmask(int nj, int j)
+{
+  return nj - j >= 4 ? (__mmask16)0xffff
+                     : (__mmask16)((1u << (4 * (nj - j))) - 1);
+}
+
+/* sum of the 4 j-groups */
+static AVX512 inline void reduce_store(__m512 v, float *p)
+{
+  __m128 s0 = _mm_add_ps(_mm512_castps512_ps128(v), _mm512_extractf32x4_ps(v, 1));
+  __m128 s1 = _mm_add_ps(_mm512_extractf32x4_ps(v, 2), _mm512_extractf32x4_ps(v, 3));
+  _mm_store_ps(p, _mm_add_ps(s0, s1));
+}
+
+/* accumulates the force of the 4 j-particles in jp (x, y, z, m) */
+static AVX512 inline void interact(__m512 jp, __m512 epj, __mmask16 mask,
+                                   __m512 xi, __m512 yi, __m512 zi,
+                                   __m512 *ax, __m512 *ay, __m512 *az, __m512 *phi)
+{
+  const __m512 dx = _mm512_sub_ps(_mm512_permute_ps(jp, 0x00), xi);
+  const __m512 dy = _mm512_sub_ps(_mm512_permute_ps(jp, 0x55), yi);
+  const __m512 dz = _mm512_sub_ps(_mm512_permute_ps(jp, 0xaa), zi);
+  const __m512 mj = _mm512_permute_ps(jp, 0xff);
+  __m512 r2 = _mm512_fmadd_ps(dx, dx, epj);
+  r2 = _mm512_fmadd_ps(dy, dy, r2);
+  r2 = _mm512_fmadd_ps(dz, dz, r2);
+  const __m512 rinv  = rsqrt_nr(r2);
+  const __m512 mrinv = _mm512_mul_ps(mj, rinv);
+  const __m512 mr3   = _mm512_mul_ps(mrinv, _mm512_mul_ps(rinv, rinv));
+  *phi = _mm512_mask_sub_ps(*phi, mask, *phi, mrinv);
+  *ax  = _mm512_mask3_fmadd_ps(mr3, dx, *ax, mask);
+  *ay  = _mm512_mask3_fmadd_ps(mr3, dy, *ay, mask);
+  *az  = _mm512_mask3_fmadd_ps(mr3, dz, *az, mask);
+}
+
+/* 4 j-particles of a Jpdata0 array, from two records */
+static AVX512 inline __m512 load_jpdata0(const float *p0, const float *p1)
+{
+  return _mm512_castpd_ps(_mm512_insertf64x4(
+      _mm512_castpd256_pd512(_mm256_load_pd((const double *)p0)),
+      _mm256_load_pd((const double *)p1), 1));
+}
+
+/* two sets of accumulators (8 j-particles per iteration) hide the latency
+   of the fma chains */
+AVX512 void GravityKernel_avx512(pIpdata ipdata, pFodata fodata, pJpdata jpdata, int nj)
+{
+  int j;
+  const __m512 xi   = _mm512_broadcast_f32x4(_mm_load_ps(ipdata->x));
+  const __m512 yi   = _mm512_broadcast_f32x4(_mm_load_ps(ipdata->y));
+  const __m512 zi   = _mm512_broadcast_f32x4(_mm_load_ps(ipdata->z));
+  const __m512 eps2 = _mm512_broadcast_f32x4(_mm_load_ps(ipdata->eps2));
+  __m512 ax0 = _mm512_setzero_ps(), ax1 = _mm512_setzero_ps();
+  __m512 ay0 = _mm512_setzero_ps(), ay1 = _mm512_setzero_ps();
+  __m512 az0 = _mm512_setzero_ps(), az1 = _mm512_setzero_ps();
+  __m512 ph0 = _mm512_setzero_ps(), ph1 = _mm512_setzero_ps();
+
+  for(j = 0; j + 8 <= nj; j += 8) {
+    interact(_mm512_loadu_ps((const float *)(jpdata + j)), eps2, 0xffff,
+             xi, yi, zi, &ax0, &ay0, &az0, &ph0);
+    interact(_mm512_loadu_ps((const float *)(jpdata + j + 4)), eps2, 0xffff,
+             xi, yi, zi, &ax1, &ay1, &az1, &ph1);
+  }
+  for(; j < nj; j += 4) {
+    const __mmask16 mask = jmask(nj, j);
+    interact(_mm512_maskz_loadu_ps(mask, (const float *)(jpdata + j)), eps2, mask,
+             xi, yi, zi, &ax0, &ay0, &az0, &ph0);
+  }
+
+  reduce_store(_mm512_add_ps(ax0, ax1), fodata->ax);
+  reduce_store(_mm512_add_ps(ay0, ay1), fodata->ay);
+  reduce_store(_mm512_add_ps(az0, az1), fodata->az);
+  reduce_store(_mm512_add_ps(ph0, ph1), fodata->phi);
+}
+
+/* individual softening, eps2_i + eps2_j. The j-memory is padded to a
+   multiple of 4 by g5_set_xmjMC0. */
+AVX512 void GravityKernel0_avx512(pIpdata ipdata, pFodata fodata, pJpdata0 jpdata, int nj)
+{
+  int j;
+  const __m512 xi   = _mm512_broadcast_f32x4(_mm_load_ps(ipdata->x));
+  const __m512 yi   = _mm512_broadcast_f32x4(_mm_load_ps(ipdata->y));
+  const __m512 zi   = _mm512_broadcast_f32x4(_mm_load_ps(ipdata->z));
+  const __m512 eps2 = _mm512_broadcast_f32x4(_mm_load_ps(ipdata->eps2));
+  __m512 ax0 = _mm512_setzero_ps(), ax1 = _mm512_setzero_ps();
+  __m512 ay0 = _mm512_setzero_ps(), ay1 = _mm512_setzero_ps();
+  __m512 az0 = _mm512_setzero_ps(), az1 = _mm512_setzero_ps();
+  __m512 ph0 = _mm512_setzero_ps(), ph1 = _mm512_setzero_ps();
+
+  for(j = 0; j + 8 <= nj; j += 8) {
+    const pJpdata0 jp0 = jpdata + j / 2;
+    interact(load_jpdata0(jp0[0].xm[0], jp0[1].xm[0]),
+             _mm512_add_ps(eps2, load_jpdata0(jp0[0].ep[0], jp0[1].ep[0])), 0xffff,
+             xi, yi, zi, &ax0, &ay0, &az0, &ph0);
+    interact(load_jpdata0(jp0[2].xm[0], jp0[3].xm[0]),
+             _mm512_add_ps(eps2, load_jpdata0(jp0[2].ep[0], jp0[3].ep[0])), 0xffff,
+             xi, yi, zi, &ax1, &ay1, &az1, &ph1);
+  }
+  for(; j < nj; j += 4) {
+    const pJpdata0 jp0 = jpdata + j / 2;
+    interact(load_jpdata0(jp0[0].xm[0], jp0[1].xm[0]),
+             _mm512_add_ps(eps2, load_jpdata0(jp0[0].ep[0], jp0[1].ep[0])), jmask(nj, j),
+             xi, yi, zi, &ax0, &ay0, &az0, &ph0);
+  }
+
+  reduce_store(_mm512_add_ps(ax0, ax1), fodata->ax);
+  reduce_store(_mm512_add_ps(ay0, ay1), fodata->ay);
+  reduce_store(_mm512_add_ps(az0, az1), fodata->az);
+  reduce_store(_mm512_add_ps(ph0, ph1), fodata->phi);
+}
@@ -1,7 +1,12 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
 #include <immintrin.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <xmmintrin.h>
 #include <emmintrin.h>
 
@@ -10,8 +15,10 @@
 
 #define NUM_PIPE (4)
 
+/* max # of devices (threads); only a table of pointers, the memory of a
+   device is allocated at its first use and the j-memory grows on demand */
 #ifndef MAXDEV
-#define MAXDEV (24)
+#define MAXDEV (1024)
 #endif /* MAXDEV */
 
 static double Eps;
@@ -19,10 +26,25 @@ static double Eps;
 static struct Ptcl_Mem {
   Ipdata iptcl;
   Fodata fout;
-  Jpdata jptcl[JMEMSIZE];
-  Jpdata0 jptcl0[JMEMSIZE/2];
-  int nbody, pad[15];
-} ptcl_mem[MAXDEV] ALIGN64;
+  pJpdata jptcl;
+  pJpdata0 jptcl0;
+  int jmemsize, jmemsize0; /* capacity of jptcl, jptcl0 (in j-particles) */
+  int nbody, pad[9];
+} *ptcl_mem[MAXDEV];
+
+/* j-particles sent at once by g5_calculate_force_on_xjMC */
+static int Jchunk = JMEMSIZE;
+
+void GravityKernel(pIpdata, pFodata, pJpdata, int);
+void GravityKernel0(pIpdata, pFodata, pJpdata0, int);
+#ifndef DISABLE_AVX512
+void GravityKernel_avx512(pIpdata, pFodata, pJpdata, int);
+void GravityKernel0_avx512(pIpdata, pFodata, pJpdata0, int);
+#endif
+
+/* selected in g5_open() from the instruction sets of the CPU */
+static void (*Kernel)(pIpdata, pFodata, pJpdata, int) = GravityKernel;
+static void (*Kernel0)(pIpdata, pFodata, pJpdata0, int) = GravityKernel0;
 
 static float Acc_correct = 1.0;
 static float Pot_correct = -1.0;
@@ -36,7 +58,59 @@ int g5_get_number_of_pipelines(void)
 
 int g5_get_jmemsize(void) 
 {
-  return JMEMSIZE;
+  return Jchunk;
+}
+
+void g5_set_jmemsize(int n)
+{
+  assert(n > 0);
+  Jchunk = n;
+}
+
+/* called only by the thread which owns devid */
+static struct Ptcl_Mem *get_ptcl_mem(int devid)
+{
+  assert(devid >= 0 && devid < MAXDEV);
+  if(ptcl_mem[devid] == NULL) {
+    void *p;
+    int ret = posix_memalign(&p, 64, sizeof(struct Ptcl_Mem));
+    assert(ret == 0);
+    memset(p, 0, sizeof(struct Ptcl_Mem));
+    ptcl_mem[devid] = (struct Ptcl_Mem *)p;
+  }
+  return ptcl_mem[devid];
+}
+
+static void reserve_jmem(struct Ptcl_Mem *pm, int n)
+{
+  if(n > pm->jmemsize) {
+    void *p;
+    int n_new = n + n / 4 + NUNROLL;
+    int ret = posix_memalign(&p, 64, sizeof(Jpdata) * n_new);
+    assert(ret == 0);
+    if(pm->jptcl != NULL) {
+      memcpy(p, pm->jptcl, sizeof(Jpdata) * pm->jmemsize);
+      free(pm->jptcl);
+    }
+    pm->jptcl = (pJpdata)p;
+    pm->jmemsize = n_new;
+  }
+}
+
+static void reserve_jmem0(struct Ptcl_Mem *pm, int n)
+{
+  if(n > pm->jmemsize0) {
+    void *p;
+    int n_new = (n + n / 4 + NUNROLL + 1) & ~1;
+    int ret = posix_memalign(&p, 64, sizeof(Jpdata0) * (n_new / 2));
+    assert(ret == 0);
+    if(pm->jptcl0 != NULL) {
+      memcpy(p, pm->jptcl0, sizeof(Jpdata0) * (pm->jmemsize0 / 2));
+      free(pm->jptcl0);
+    }
+    pm->jptcl0 = (pJpdata0)p;
+    pm->jmemsize0 = n_new;
+  }
 }
 
 void g5_open(void)
@@ -44,7 +118,16 @@ void g5_open(void)
   static int init_call = 1;
   if(init_call) {
     double rsqrt_bias();
-    double bias = rsqrt_bias();
+    double bias;
+#ifndef DISABLE_AVX512
+    if(__builtin_cpu_supports("avx512f")) {
+      /* rsqrt is refined in the kernel */
+      Kernel  = GravityKernel_avx512;
+      Kernel0 = GravityKernel0_avx512;
+      bias = 0.0;
+    } else
+#endif
+    bias = rsqrt_bias();
     float acc_corr = 1.0 - 3.0*bias;
     float pot_corr = -(1.0-bias);
     Acc_correct = acc_corr;
@@ -58,6 +141,14 @@ void g5_open(void)
 
 void g5_close() 
 {
+  int devid;
+  for(devid=0;devid<MAXDEV;devid++) {
+    if(ptcl_mem[devid] == NULL) continue;
+    free(ptcl_mem[devid]->jptcl);
+    free(ptcl_mem[devid]->jptcl0);
+    free(ptcl_mem[devid]);
+    ptcl_mem[devid] = NULL;
+  }
   return;
 }
 
@@ -73,7 +164,7 @@ void g5_set_range(double xmin, double xmax, double mmin)
 
 void g5_set_nMC(int devid, int n)
 {
-  struct Ptcl_Mem *pm = ptcl_mem + devid;
+  struct Ptcl_Mem *pm = get_ptcl_mem(devid);
   pm->nbody = n;
 }
 
@@ -85,7 +176,7 @@ void g5_set_n(int n)
 void g5_set_xiMC(int devid, int ni, double (*xi)[3])
 {
   int i;
-  struct Ptcl_Mem *pm = ptcl_mem + devid;
+  struct Ptcl_Mem *pm = get_ptcl_mem(devid);
 
   assert(ni <= NUM_PIPE);
   for(i=0;i<ni;i++) {
@@ -101,7 +192,7 @@ void g5_set_xiMC0(int devid, int ni, double (*xi)[3],
 		  double *eps2)
 {
   int i;
-  struct Ptcl_Mem *pm = ptcl_mem + devid;
+  struct Ptcl_Mem *pm = get_ptcl_mem(devid);
 
   assert(ni <= NUM_PIPE);
   for(i=0;i<ni;i++) {
@@ -120,8 +211,9 @@ void g5_set_xi(int ni, double (*xi)[3])
 void g5_set_xmjMC(int devid, int adr, int nj, double (*xj)[3], double *mj) 
 {
   int j;
-  struct Ptcl_Mem *pm = ptcl_mem + devid;
+  struct Ptcl_Mem *pm = get_ptcl_mem(devid);
 
+  reserve_jmem(pm, adr + nj + NUNROLL);
   for(j=adr;j<adr+nj;j++) {
     __m256d pd = {xj[j][0], xj[j][1], xj[j][2], mj[j]};
     __m128  ps = _mm256_cvtpd_ps(pd);
@@ -140,9 +232,10 @@ void g5_set_xmjMC0(int devid, int adr, int nj, double (*xj)[3],
 		   double *mj, double *epsj2) 
 {
   int j;
-  struct Ptcl_Mem *pm = ptcl_mem + devid;
+  struct Ptcl_Mem *pm = get_ptcl_mem(devid);
 
   assert(adr % 2 == 0);
+  reserve_jmem0(pm, adr + nj + NUNROLL);
   for(j=adr;j<adr+nj;j+=2) {
     int jadr = j / 2;
     pm->jptcl0[jadr].xm[0][0] = (float)xj[j][0];
@@ -196,16 +289,14 @@ void g5_set_xmj0(int adr, int nj, double (*xj)[3],
 
 void g5_runMC(int devid) 
 {
-  struct Ptcl_Mem *pm = ptcl_mem + devid;
-  void GravityKernel(pIpdata, pFodata, pJpdata, int);
-  GravityKernel(&(pm->iptcl), &(pm->fout), pm->jptcl, pm->nbody);
+  struct Ptcl_Mem *pm = get_ptcl_mem(devid);
+  Kernel(&(pm->iptcl), &(pm->fout), pm->jptcl, pm->nbody);
 }
 
 void g5_runMC0(int devid) 
 {
-  struct Ptcl_Mem *pm = ptcl_mem + devid;
-  void GravityKernel0(pIpdata, pFodata, pJpdata0, int);
-  GravityKernel0(&(pm->iptcl), &(pm->fout), pm->jptcl0, pm->nbody);
+  struct Ptcl_Mem *pm = get_ptcl_mem(devid);
+  Kernel0(&(pm->iptcl), &(pm->fout), pm->jptcl0, pm->nbody);
 }
 
 void g5_run(void) 
@@ -217,7 +308,7 @@ void g5_get_forceMC(int devid, int ni, double (*a)[3], double *pot)
 {
   assert(ni <= NUM_PIPE);
 
-  struct Ptcl_Mem *pm = ptcl_mem + devid;
+  struct Ptcl_Mem *pm = get_ptcl_mem(devid);
   int i;
 
 #if 1
@@ -272,6 +363,48 @@ void g5_calculate_force_on_xMC0(int devid, double (*x)[3],
   }
 }
 
+/* force from nj j-particles on ni i-particles in one call. The j-particles
+   are sent by chunks of g5_get_jmemsize(), so that nj is not limited. */
+void g5_calculate_force_on_xjMC(int devid, double (*x)[3], double (*a)[3],
+                                double *p, int ni,
+                                double (*xj)[3], double *mj, int nj)
+{
+  int i, k, off, joff;
+  const int np = g5_get_number_of_pipelines();
+  double atmp[NUM_PIPE][3], ptmp[NUM_PIPE];
+
+  for(i=0;i<ni;i++) {
+    a[i][0] = a[i][1] = a[i][2] = 0.0;
+    p[i] = 0.0;
+  }
+  for(joff=0;joff<nj;joff+=Jchunk) {
+    int njj = Jchunk < nj-joff ? Jchunk : nj-joff;
+    g5_set_xmjMC(devid, 0, njj, xj+joff, mj+joff);
+    g5_set_nMC(devid, njj);
+    for(off=0;off<ni;off+=np) {
+      int nii = np < ni-off ? np : ni-off;
+      g5_set_xiMC(devid, nii, x+off);
+      g5_runMC(devid);
+      g5_get_forceMC(devid, nii, atmp, ptmp);
+      for(i=0;i<nii;i++) {
+        for(k=0;k<3;k++) a[off+i][k] += atmp[i][k];
+        p[off+i] += ptmp[i];
+      }
+    }
+  }
+}
+
+/* same as g5_calculate_force_on_xjMC on the memory of the calling thread */
+void g5_calculate_force_on_xj(double (*x)[3], double (*a)[3], double *p, int ni,
+                              double (*xj)[3], double *mj, int nj)
+{
+#ifdef _OPENMP
+  g5_calculate_force_on_xjMC(omp_get_thread_num(), x, a, p, ni, xj, mj, nj);
+#else
+  g5_calculate_force_on_xjMC(0, x, a, p, ni, xj, mj, nj);
+#endif
+}
+
 #ifndef ENABLE_OPENMP
 void g5_calculate_force_on_x(double (*x)[3], double (*a)[3], double *p, int ni)
 {
@@ -296,12 +429,11 @@ void g5_calculate_force_on_x(double (*x)[3], double (*a)[3], double *p,
     int ni = np < nitot-off ? np : nitot-off;
     g5_set_xiMC(tid, ni, x+off);
     {
-      void GravityKernel(pIpdata, pFodata, pJpdata, int);
-      pIpdata ip = &ptcl_mem[tid].iptcl;
-      pFodata fo = &ptcl_mem[tid].fout;
-      pJpdata jp = ptcl_mem[0].jptcl;
-      int nbody  = ptcl_mem[0].nbody;
-      GravityKernel(ip, fo, jp, nbody);
+      pIpdata ip = &get_ptcl_mem(tid)->iptcl;
+      pFodata fo = &get_ptcl_mem(tid)->fout;
+      pJpdata jp = ptcl_mem[0]->jptcl;
+      int nbody  = ptcl_mem[0]->nbody;
+      Kernel(ip, fo, jp, nbody);
     }
     g5_get_forceMC(tid, ni, a+off, p+off);
   }
@@ -318,12 +450,11 @@ void g5_calculate_force_on_x0(double (*x)[3], double (*a)[3], double *p,
     int ni = np < nitot-off ? np : nitot-off;
     g5_set_xiMC0(tid, ni, x+off, eps2+off);
     {
-      void GravityKernel0(pIpdata, pFodata, pJpdata0, int);
-      pIpdata ip = &ptcl_mem[tid].iptcl;
-      pFodata fo = &ptcl_mem[tid].fout;
-      pJpdata0 jp = ptcl_mem[0].jptcl0;
-      int nbody  = ptcl_mem[0].nbody;
-      GravityKernel0(ip, fo, jp, nbody);
+      pIpdata ip = &get_ptcl_mem(tid)->iptcl;
+      pFodata fo = &get_ptcl_mem(tid)->fout;
+      pJpdata0 jp = ptcl_mem[0]->jptcl0;
+      int nbody  = ptcl_mem[0]->nbody;
+      Kernel0(ip, fo, jp, nbody);
     }
     g5_get_forceMC(tid, ni, a+off, p+off);
   }
@@ -0,0 +1,72 @@
+// AVX-512F version of gravity_kernel, selected at run time in g5_open().
+// A zmm register holds 4 j-particles x the 4 i-particles (lane 4*j+i);
+// the tail of the j-list is masked, so that the j-memory need not be padded.
+// The table is read by gathers, the interpolation is the same as in
+// gravity_kernel.c.
+#include <immintrin.h>
+#include "sse_type.h"
+#include "pg5_table.h"
+
+#define AVX512 __attribute__ ((target("avx512f")))
+
+// bit pattern of 2.0f, the first entry of the table
+#define TBL_OFFSET (1<<(30-(23-FRC_BIT)))
+
+static AVX512 inline __mmask16 jmask(int nj, int j)
+{
+	return nj - j >= 4 ? (__mmask16)0xffff
+	                   : (__mmask16)((1u << (4 * (nj - j))) - 1);
+}
+
+static AVX512 inline __m128 reduce(__m512 v)
+{
+	__m128 s0 = _mm_add_ps(_mm512_castps512_ps128(v), _mm512_extractf32x4_ps(v, 1));
+	__m128 s1 = _mm_add_ps(_mm512_extractf32x4_ps(v, 2), _mm512_extractf32x4_ps(v, 3));
+	return _mm_add_ps(s0, s1);
+}
+
+AVX512 void gravity_kernel_avx512(pIpdata ipdata, pJpdata jp, pFodata fodata,
+		int nj, float fcut[][2], v4sf r2cut, v4sf accscale)
+{
+	int j;
+	const __m512 xi    = _mm512_broadcast_f32x4(_mm_load_ps(ipdata->x));
+	const __m512 yi    = _mm512_broadcast_f32x4(_mm_load_ps(ipdata->y));
+	const __m512 zi    = _mm512_broadcast_f32x4(_mm_load_ps(ipdata->z));
+	const __m512 r2max = _mm512_broadcast_f32x4((__m128)r2cut);
+	const __m512 two   = _mm512_set1_ps(2.0f);
+	const __m512i offset = _mm512_set1_epi32(TBL_OFFSET);
+	const float *tbl = &fcut[0][0];
+	__m512 ax = _mm512_setzero_ps();
+	__m512 ay = _mm512_setzero_ps();
+	__m512 az = _mm512_setzero_ps();
+
+	for(j = 0; j < nj; j += 4){
+		const __mmask16 mask = jmask(nj, j);
+		const __m512 xj = _mm512_maskz_loadu_ps(mask, (const float *)(jp + j));
+		const __m512 dx = _mm512_sub_ps(_mm512_permute_ps(xj, 0x00), xi);
+		const __m512 dy = _mm512_sub_ps(_mm512_permute_ps(xj, 0x55), yi);
+		const __m512 dz = _mm512_sub_ps(_mm512_permute_ps(xj, 0xaa), zi);
+		const __m512 mj = _mm512_permute_ps(xj, 0xff);
+
+		// s = min(r2 + 2, r2cut): exponent and leading bits of the
+		// mantissa give the table index, the rest the interpolation
+		__m512 s = _mm512_fmadd_ps(dx, dx, two);
+		s = _mm512_fmadd_ps(dy, dy, s);
+		s = _mm512_fmadd_ps(dz, dz, s);
+		s = _mm512_min_ps(s, r2max);
+		const __m512i idx = _mm512_srli_epi32(_mm512_castps_si512(s), 23-FRC_BIT);
+		const __m512 s0 = _mm512_castsi512_ps(_mm512_slli_epi32(idx, 23-FRC_BIT));
+		const __m512i adr = _mm512_slli_epi32(_mm512_sub_epi32(idx, offset), 1);
+		const __m512 f0 = _mm512_i32gather_ps(adr, tbl, 4);
+		const __m512 f1 = _mm512_i32gather_ps(adr, tbl + 1, 4);
+		const __m512 f  = _mm512_mul_ps(mj, _mm512_fmadd_ps(_mm512_sub_ps(s, s0), f1, f0));
+
+		ax = _mm512_mask3_fmadd_ps(f, dx, ax, mask);
+		ay = _mm512_mask3_fmadd_ps(f, dy, ay, mask);
+		az = _mm512_mask3_fmadd_ps(f, dz, az, mask);
+	}
+
+	_mm_store_ps(fodata->ax, _mm_mul_ps(reduce(ax), (__m128)accscale));
+	_mm_store_ps(fodata->ay, _mm_mul_ps(reduce(ay), (__m128)accscale));
+	_mm_store_ps(fodata->az, _mm_mul_ps(reduce(az), (__m128)accscale));
+}
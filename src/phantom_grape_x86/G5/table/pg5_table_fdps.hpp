@@ -0,0 +1,268 @@
+// Force tables for arbitrary radial force laws (Lennard-Jones, Yukawa,
+// Ewald real space, SPH kernels, ...) and pair kernels on them, usable as
+// interaction functors of TreeForForceShort.
+//
+// The table is indexed as in pg5_table.c: s = 2 + r^2 * r2scale is a float
+// in [2, s_max], its exponent and leading Tfrc_bit bits of the mantissa give
+// the entry and the other bits the linear interpolation. The entry i holds
+// f, df/ds, phi, dphi/ds at the lower end of the bin, except the first one,
+// which is evaluated at the middle of its bin to avoid r = 0. f and phi are
+// saturated at +-1e30 so that the entries stay finite in single precision.
+//
+//   ForceTable<> table;
+//   table.generate(force, pot, rcut); // F64 force(F64 r), F64 pot(F64 r)
+//   tree.calcForceAllAndWriteBack(
+//       CalcForceEpEpTable<EPI, EPJ, Force, ForceTable<> >(table), psys, dinfo);
+//
+// force(r) is F(r)/r with F the radial force, positive for repulsion:
+//   f.acc += q_j force(r) (r_i - r_j),  f.pot += q_j pot(r)
+// for r_j within rcut, with q_j = epj.getCharge() (1 if Tcharge = false).
+// Tforce needs the members acc (F64vec) and pot (F64), which are added to.
+// Pairs at r = 0 (the i-particle itself) are skipped. The kernels are in
+// single precision with coordinates relative to the first i-particle; the
+// AVX-512 or AVX2 (with FMA) version is compiled when the corresponding
+// flags are given, the scalar one otherwise.
+#pragma once
+
+#include<cmath>
+#include<algorithm>
+#include<particle_simulator.hpp>
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include<immintrin.h>
+#endif
+
+namespace ParticleSimulator{
+
+    template<S32 Texp_bit=4, S32 Tfrc_bit=7>
+    class ForceTable{
+    public:
+        enum{
+            TBL_SIZE = 1 << (Texp_bit + Tfrc_bit),
+            SHIFT = 23 - Tfrc_bit,
+            OFFSET = 1 << (30 - (23 - Tfrc_bit)), // index of s = 2.0f
+        };
+        float r2scale;
+        float s_max;
+        F64 rcut;
+        float tbl[TBL_SIZE][4] __attribute__((aligned(64)));
+
+        ForceTable() : r2scale(0.0), s_max(2.0), rcut(0.0){}
+
+        template<class Tfunc_force, class Tfunc_pot>
+        void generate(Tfunc_force force, Tfunc_pot pot, const F64 _rcut){
+            union{ float f; U32 u; } m;
+            rcut = _rcut;
+            m.u = (1u << 30) | ((U32)(TBL_SIZE-1) << SHIFT);
+            s_max = m.f;
+            r2scale = (s_max - 2.0f) / (rcut * rcut);
+            for(S32 i=0; i<TBL_SIZE; i++){
+                m.u = (1u << 30) + ((U32)i << SHIFT);
+                F64 s = m.f;
+                if(i == 0){
+                    union{ float f; U32 u; } m1;
+                    m1.u = m.u + (1u << SHIFT);
+                    s = 0.5 * ((F64)m.f + (F64)m1.f);
+                }
+                const F64 r = sqrt((s - 2.0) / r2scale);
+                tbl[i][0] = Saturate(force(r));
+                tbl[i][2] = Saturate(pot(r));
+            }
+            for(S32 i=0; i<TBL_SIZE-1; i++){
+                union{ float f; U32 u; } m0, m1;
+                m0.u = (1u << 30) + ((U32)i << SHIFT);
+                m1.u = m0.u + (1u << SHIFT);
+                const F64 ds = (F64)m1.f - (F64)m0.f;
+                tbl[i][1] = (tbl[i+1][0] - tbl[i][0]) / ds;
+                tbl[i][3] = (tbl[i+1][2] - tbl[i][2]) / ds;
+            }
+            tbl[TBL_SIZE-1][1] = tbl[TBL_SIZE-1][3] = 0.0;
+        }
+
+        template<class Tfunc_force>
+        void generate(Tfunc_force force, const F64 _rcut){
+            generate(force, ZeroPot(), _rcut);
+        }
+
+        // f and phi at r^2 (< rcut^2)
+        void lookup(const float r2, float & f, float & phi) const {
+            union{ float f; U32 u; } s, s0;
+            s.f = std::min(2.0f + r2 * r2scale, s_max);
+            const U32 idx = s.u >> SHIFT;
+            s0.u = idx << SHIFT;
+            const float ds = s.f - s0.f;
+            const float * e = tbl[idx - OFFSET];
+            f   = e[0] + ds * e[1];
+            phi = e[2] + ds * e[3];
+        }
+
+    private:
+        struct ZeroPot{
+            F64 operator () (const F64 r) const { return 0.0; }
+        };
+        // steep laws (e.g. r^-12) overflow float at the smallest r
+        static F64 Saturate(const F64 x){
+            const F64 x_max = 1e30;
+            return std::max(std::min(x, x_max), -x_max);
+        }
+    };
+
+    template<class Tepi, class Tepj, class Tforce, class Ttable, bool Tcharge=true>
+    class CalcForceEpEpTable{
+    public:
+        const Ttable * table;
+        CalcForceEpEpTable(const Ttable & _table) : table(&_table){}
+
+        void operator () (const Tepi * epi,
+                          const S32 ni,
+                          const Tepj * epj,
+                          const S32 nj,
+                          Tforce * force){
+            enum{ NJ_CHUNK = 256 };
+            float xj[NJ_CHUNK] __attribute__((aligned(64)));
+            float yj[NJ_CHUNK] __attribute__((aligned(64)));
+            float zj[NJ_CHUNK] __attribute__((aligned(64)));
+            float qj[NJ_CHUNK] __attribute__((aligned(64)));
+            if(ni <= 0) return;
+            const F64vec origin = epi[0].getPos();
+            for(S32 j0=0; j0<nj; j0+=NJ_CHUNK){
+                const S32 njj = std::min(nj-j0, (S32)NJ_CHUNK);
+                const S32 njp = (njj + 15) & ~15;
+                for(S32 j=0; j<njj; j++){
+                    const F64vec rj = epj[j0+j].getPos() - origin;
+                    xj[j] = rj.x;
+                    yj[j] = rj.y;
+                    zj[j] = rj.z;
+                    qj[j] = Tcharge ? epj[j0+j].getCharge() : 1.0;
+                }
+                // far away, masked out by the cutoff
+                for(S32 j=njj; j<njp; j++){
+                    xj[j] = yj[j] = zj[j] = 1e18f;
+                    qj[j] = 0.0f;
+                }
+                for(S32 i=0; i<ni; i++){
+                    const F64vec ri = epi[i].getPos() - origin;
+                    float acc[3], pot;
+                    kernel(ri.x, ri.y, ri.z, xj, yj, zj, qj, njp, acc, pot);
+                    force[i].acc += F64vec(acc[0], acc[1], acc[2]);
+                    force[i].pot += pot;
+                }
+            }
+        }
+
+    private:
+#if defined(__AVX512F__)
+        void kernel(const float xi, const float yi, const float zi,
+                    const float * xj, const float * yj, const float * zj,
+                    const float * qj, const S32 nj,
+                    float acc[3], float & pot) const {
+            const float * tbl = &table->tbl[0][0];
+            const __m512 vxi = _mm512_set1_ps(xi);
+            const __m512 vyi = _mm512_set1_ps(yi);
+            const __m512 vzi = _mm512_set1_ps(zi);
+            const __m512 r2cut = _mm512_set1_ps(table->rcut * table->rcut);
+            const __m512 r2scale = _mm512_set1_ps(table->r2scale);
+            const __m512 s_max = _mm512_set1_ps(table->s_max);
+            const __m512 two = _mm512_set1_ps(2.0f);
+            const __m512 zero = _mm512_setzero_ps();
+            const __m512i offset = _mm512_set1_epi32(Ttable::OFFSET);
+            __m512 ax = zero, ay = zero, az = zero, ph = zero;
+            for(S32 j=0; j<nj; j+=16){
+                const __m512 dx = _mm512_sub_ps(vxi, _mm512_load_ps(xj+j));
+                const __m512 dy = _mm512_sub_ps(vyi, _mm512_load_ps(yj+j));
+                const __m512 dz = _mm512_sub_ps(vzi, _mm512_load_ps(zj+j));
+                const __m512 r2 = _mm512_fmadd_ps(dz, dz, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dx, dx)));
+                const __mmask16 mask = _mm512_cmp_ps_mask(r2, r2cut, _CMP_LT_OQ)
+                                     & _mm512_cmp_ps_mask(r2, zero, _CMP_GT_OQ);
+                const __m512 s = _mm512_min_ps(_mm512_fmadd_ps(r2, r2scale, two), s_max);
+                const __m512i idx = _mm512_srli_epi32(_mm512_castps_si512(s), Ttable::SHIFT);
+                const __m512 ds = _mm512_sub_ps(s, _mm512_castsi512_ps(_mm512_slli_epi32(idx, Ttable::SHIFT)));
+                const __m512i adr = _mm512_slli_epi32(_mm512_sub_epi32(idx, offset), 2);
+                const __m512 q = _mm512_load_ps(qj+j);
+                const __m512 f = _mm512_mul_ps(q, _mm512_fmadd_ps(ds, _mm512_i32gather_ps(adr, tbl+1, 4),
+                                                                  _mm512_i32gather_ps(adr, tbl, 4)));
+                const __m512 p = _mm512_mul_ps(q, _mm512_fmadd_ps(ds, _mm512_i32gather_ps(adr, tbl+3, 4),
+                                                                  _mm512_i32gather_ps(adr, tbl+2, 4)));
+                ax = _mm512_mask3_fmadd_ps(f, dx, ax, mask);
+                ay = _mm512_mask3_fmadd_ps(f, dy, ay, mask);
+                az = _mm512_mask3_fmadd_ps(f, dz, az, mask);
+                ph = _mm512_mask_add_ps(ph, mask, ph, p);
+            }
+            acc[0] = _mm512_reduce_add_ps(ax);
+            acc[1] = _mm512_reduce_add_ps(ay);
+            acc[2] = _mm512_reduce_add_ps(az);
+            pot    = _mm512_reduce_add_ps(ph);
+        }
+#elif defined(__AVX2__) && defined(__FMA__)
+        static float ReduceAdd(const __m256 v){
+            __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+            s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+            return _mm_cvtss_f32(s);
+        }
+        void kernel(const float xi, const float yi, const float zi,
+                    const float * xj, const float * yj, const float * zj,
+                    const float * qj, const S32 nj,
+                    float acc[3], float & pot) const {
+            const float * tbl = &table->tbl[0][0];
+            const __m256 vxi = _mm256_set1_ps(xi);
+            const __m256 vyi = _mm256_set1_ps(yi);
+            const __m256 vzi = _mm256_set1_ps(zi);
+            const __m256 r2cut = _mm256_set1_ps(table->rcut * table->rcut);
+            const __m256 r2scale = _mm256_set1_ps(table->r2scale);
+            const __m256 s_max = _mm256_set1_ps(table->s_max);
+            const __m256 two = _mm256_set1_ps(2.0f);
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256i offset = _mm256_set1_epi32(Ttable::OFFSET);
+            __m256 ax = zero, ay = zero, az = zero, ph = zero;
+            for(S32 j=0; j<nj; j+=8){
+                const __m256 dx = _mm256_sub_ps(vxi, _mm256_load_ps(xj+j));
+                const __m256 dy = _mm256_sub_ps(vyi, _mm256_load_ps(yj+j));
+                const __m256 dz = _mm256_sub_ps(vzi, _mm256_load_ps(zj+j));
+                const __m256 r2 = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+                const __m256 mask = _mm256_and_ps(_mm256_cmp_ps(r2, r2cut, _CMP_LT_OQ),
+                                                  _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+                const __m256 s = _mm256_min_ps(_mm256_fmadd_ps(r2, r2scale, two), s_max);
+                const __m256i idx = _mm256_srli_epi32(_mm256_castps_si256(s), Ttable::SHIFT);
+                const __m256 ds = _mm256_sub_ps(s, _mm256_castsi256_ps(_mm256_slli_epi32(idx, Ttable::SHIFT)));
+                const __m256i adr = _mm256_slli_epi32(_mm256_sub_epi32(idx, offset), 2);
+                const __m256 q = _mm256_load_ps(qj+j);
+                const __m256 f = _mm256_and_ps(mask, _mm256_mul_ps(q, _mm256_fmadd_ps(ds, _mm256_i32gather_ps(tbl+1, adr, 4),
+                                                                                      _mm256_i32gather_ps(tbl, adr, 4))));
+                const __m256 p = _mm256_and_ps(mask, _mm256_mul_ps(q, _mm256_fmadd_ps(ds, _mm256_i32gather_ps(tbl+3, adr, 4),
+                                                                                      _mm256_i32gather_ps(tbl+2, adr, 4))));
+                ax = _mm256_fmadd_ps(f, dx, ax);
+                ay = _mm256_fmadd_ps(f, dy, ay);
+                az = _mm256_fmadd_ps(f, dz, az);
+                ph = _mm256_add_ps(ph, p);
+            }
+            acc[0] = ReduceAdd(ax);
+            acc[1] = ReduceAdd(ay);
+            acc[2] = ReduceAdd(az);
+            pot    = ReduceAdd(ph);
+        }
+#else
+        void kernel(const float xi, const float yi, const float zi,
+                    const float * xj, const float * yj, const float * zj,
+                    const float * qj, const S32 nj,
+                    float acc[3], float & pot) const {
+            const float r2cut = table->rcut * table->rcut;
+            acc[0] = acc[1] = acc[2] = pot = 0.0f;
+            for(S32 j=0; j<nj; j++){
+                const float dx = xi - xj[j];
+                const float dy = yi - yj[j];
+                const float dz = zi - zj[j];
+                const float r2 = dx*dx + dy*dy + dz*dz;
+                if(r2 >= r2cut || r2 <= 0.0f) continue;
+                float f, p;
+                table->lookup(r2, f, p);
+                f *= qj[j];
+                acc[0] += f * dx;
+                acc[1] += f * dy;
+                acc[2] += f * dz;
+                pot += qj[j] * p;
+            }
+        }
+#endif
+    };
+
+}
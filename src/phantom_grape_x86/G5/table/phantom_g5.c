@@ -21,6 +21,14 @@ static struct Ptcl_Mem{
 static double Eps;
 static double Eta;
 
+void gravity_kernel(pIpdata, pJpdata, pFodata, int, float (*)[2], v4sf, v4sf);
+#ifndef DISABLE_AVX512
+void gravity_kernel_avx512(pIpdata, pJpdata, pFodata, int, float (*)[2], v4sf, v4sf);
+#endif
+// selected in g5_open() from the instruction sets of the CPU
+static void (*Kernel)(pIpdata, pJpdata, pFodata, int, float (*)[2], v4sf, v4sf)
+	= gravity_kernel;
+
 static double Xscale;
 static v4sf XMscale;
 static v4sf Ascale;
@@ -54,6 +62,9 @@ int g5_get_number_of_pipelines(void){
 }
 
 void g5_open(){
+#ifndef DISABLE_AVX512
+	if(__builtin_cpu_supports("avx512f")) Kernel = gravity_kernel_avx512;
+#endif
 #ifdef ALLOCATE_TABLE
 	Force_table = valloc(TBL_SIZE * sizeof(*Force_table));
 #endif
@@ -133,8 +144,7 @@ void g5_set_xmj(int adr, int nj, double (*xj)[3], double *mj){
 
 void g5_runMC(int devid){
 	struct Ptcl_Mem *pm = ptcl_mem + devid;
-	void gravity_kernel(pIpdata, pJpdata, pFodata, int, float (*)[2], v4sf, v4sf);
-	gravity_kernel(&pm->iptcl, pm->jptcl, &pm->fout, pm->Nbody, 
+	Kernel(&pm->iptcl, pm->jptcl, &pm->fout, pm->Nbody, 
 			Force_table, (v4sf)R2cut_xscale2, Ascale);
 }
 
@@ -187,12 +197,11 @@ void g5_calculate_force_on_x(double (*x)[3], double (*a)[3], double *p,
     int ni = np < nitot-off ? np : nitot-off;
     g5_set_xiMC(tid, ni, x+off);
     {
-      void gravity_kernel(pIpdata, pJpdata, pFodata, int, float (*)[2], v4sf, v4sf);
       pIpdata ip = &ptcl_mem[tid].iptcl;
       pFodata fo = &ptcl_mem[tid].fout;
       pJpdata jp = ptcl_mem[0].jptcl;
       int nbody  = ptcl_mem[0].Nbody;
-      gravity_kernel(ip, jp, fo, nbody,
+      Kernel(ip, jp, fo, nbody,
 		     Force_table, (v4sf)R2cut_xscale2, Ascale);
     }
     g5_get_forceMC(tid, ni, a+off, p+off);
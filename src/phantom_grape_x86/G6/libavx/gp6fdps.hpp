@@ -0,0 +1,106 @@
+// Interaction functors for TreeForForce built on the thread-safe entry
+// points of libg6avx (g6_set_j_particle_mc, g6calc_mc). Each thread of
+// calcForce uses its own j-memory (devid = thread number).
+//
+//   EPI: getPos(), getVel(), getId()
+//   EPJ: getPos(), getVel(), getCharge(), getId()
+//   SPJ: getPos(), getVel(), getCharge() (e.g. SPJMonopoleHermite)
+//   Tforce: acc, jrk (F64vec), pot (F64); with the neighbour search also
+//           id_nn (S64, -1 if none) and r_nn (F64), cleared to -1 and a
+//           large value. r_nn is the softened distance sqrt(r^2 + eps2)
+//           to the nearest neighbour (rnnb of the kernel, not squared).
+//
+// The ids are compared in single precision, so that they have to be
+// smaller than 2^24. The j-particles are taken as they are: use
+// setDtPrediction() of the tree to predict them.
+#pragma once
+
+#include<vector>
+#include<particle_simulator.hpp>
+
+extern "C"{
+#include"avx_type.h"
+#include"gp6util.h"
+}
+
+namespace ParticleSimulator{
+
+    template<class Tepj>
+    inline S32 GetIdG6(const Tepj & epj){ return (S32)epj.getId(); }
+    inline S32 GetIdG6(const SPJMonopoleHermite & spj){ return -1; }
+
+    template<bool search_neighbour>
+    struct SetNeighbourG6{
+        template<class Tforce>
+        void operator () (Tforce & f, const S32 id, const F64 r){}
+    };
+    template<>
+    struct SetNeighbourG6<true>{
+        template<class Tforce>
+        void operator () (Tforce & f, const S32 id, const F64 r){
+            if(id >= 0 && r < f.r_nn){
+                f.id_nn = id;
+                f.r_nn = r;
+            }
+        }
+    };
+
+    template<class Tepi, class Tepj, class Tforce, bool search_neighbour=false>
+    class CalcForceHermiteG6{
+    public:
+        F64 eps2;
+        CalcForceHermiteG6(const F64 _eps2=0.0) : eps2(_eps2){}
+        void operator () (const Tepi * epi,
+                          const S32 ni,
+                          const Tepj * epj,
+                          const S32 nj,
+                          Tforce * force){
+            const S32 devid = Comm::getThreadNum();
+            g6_set_nj_mc(devid, nj);
+            for(S32 j=0; j<nj; j++){
+                F64 pos[3], vel[3];
+                const F64vec pos_j = epj[j].getPos();
+                const F64vec vel_j = epj[j].getVel();
+                for(S32 k=0; k<3; k++){
+                    pos[k] = pos_j[k];
+                    vel[k] = vel_j[k];
+                }
+                g6_set_j_particle_mc(devid, j, GetIdG6(epj[j]), epj[j].getCharge(), pos, vel);
+            }
+            std::vector<S32> idx(ni), nnb(search_neighbour ? ni : 0);
+            std::vector<F32> rnnb(search_neighbour ? ni : 0);
+            std::vector<F64> pos(3*ni), vel(3*ni), acc(3*ni), jrk(3*ni), pot(ni);
+            for(S32 i=0; i<ni; i++){
+                const F64vec pos_i = epi[i].getPos();
+                const F64vec vel_i = epi[i].getVel();
+                for(S32 k=0; k<3; k++){
+                    pos[3*i+k] = pos_i[k];
+                    vel[3*i+k] = vel_i[k];
+                }
+                idx[i] = (S32)epi[i].getId();
+            }
+            // g6calc_mc splits the i-particles into blocks of NPIPES
+            if(ni > 0){
+                g6calc_mc(devid, nj, ni, &idx[0],
+                          reinterpret_cast<F64 (*)[3]>(&pos[0]),
+                          reinterpret_cast<F64 (*)[3]>(&vel[0]),
+                          eps2,
+                          reinterpret_cast<F64 (*)[3]>(&acc[0]),
+                          reinterpret_cast<F64 (*)[3]>(&jrk[0]),
+                          &pot[0],
+                          search_neighbour ? &nnb[0] : NULL,
+                          search_neighbour ? &rnnb[0] : NULL);
+            }
+            for(S32 i=0; i<ni; i++){
+                Tforce & f = force[i];
+                f.acc += F64vec(acc[3*i], acc[3*i+1], acc[3*i+2]);
+                f.jrk += F64vec(jrk[3*i], jrk[3*i+1], jrk[3*i+2]);
+                f.pot += pot[i];
+                if(search_neighbour){
+                    SetNeighbourG6<search_neighbour>()(f, nnb[i], rnnb[i]);
+                }
+            }
+        }
+    };
+
+}
@@ -99,3 +99,10 @@ void g6_debugfunc_double_(double *);
 
 void g6_dump(double, int, double *, double (*)[3], double (*)[3]);
 void g6_dump_(double *,int *, double *, double (*)[3], double (*)[3]);
+
+void g6_set_nj_mc(int, int);
+void g6_set_j_particle_mc(int, int, int, double, double *, double *);
+int g6calc_mc(int, int, int, int *,
+	      double (*)[3], double (*)[3], double,
+	      double (*)[3], double (*)[3], double *, int *, float *);
+void g6_close_mc(void);
@@ -5,9 +5,9 @@
 #include "avx.h"
 #include "avx_type.h"
 #include "gravity.h"
+#include "pred_mem.h"
 
 #define IPARA 2
-#define JPARA 4
 #define SEC 2.0
 #define THD 3.0
 
@@ -39,12 +39,7 @@ static struct Ptcl_Mem{
   int    pad[3];
 } ptcl_mem[JMEMSIZE] ALIGN128;
 
-typedef struct Pred_Mem * pPred_Mem;
-static struct Pred_Mem{
-  double xpos[NVECD], ypos[NVECD], zpos[NVECD];
-  float  indx[NVECS], mass[NVECS];
-  float  xvel[NVECS], yvel[NVECS], zvel[NVECS];
-} pred_mem[JMEMSIZE] ALIGN256;
+static struct Pred_Mem pred_mem[JMEMSIZE] ALIGN256;
 
 typedef struct NeighbourList * pNeighbourList;
 static struct NeighbourList{
@@ -257,11 +252,11 @@ void gravity_kernels(int nj, double eps2, pPrdPosVel posvel, pNewAccJrk accjerk)
   return;
 }
 
-void gravity_kernel(int nj, pPrdPosVel posvel, pNewAccJrk accjerk)
+static void gravity_kernel_jmem(int nj, pPred_Mem jmem, pPrdPosVel posvel, pNewAccJrk accjerk)
 {
   int ret;
   int j;
-  pPred_Mem jptr = pred_mem;
+  pPred_Mem jptr = jmem;
   pIparticle iptr;
 
   ret = posix_memalign((void **)&iptr, 32, NVAR_IP * 32);
@@ -452,12 +447,12 @@ void gravity_kernel(int nj, pPrdPosVel posvel, pNewAccJrk accjerk)
   return;
 }
 
-void gravity_kernel2(int nj, pPrdPosVel posvel, pNewAccJrk accjerk)
+static void gravity_kernel2_jmem(int nj, pPred_Mem jmem, pPrdPosVel posvel, pNewAccJrk accjerk)
 {
   int ret;
   int j;
   double true_rmin2;
-  pPred_Mem jptr = pred_mem;
+  pPred_Mem jptr = jmem;
   pIparticle iptr;
   float ten = 10.0, minusone = -1.0;
 
@@ -677,6 +672,30 @@ void gravity_kernel2(int nj, pPrdPosVel posvel, pNewAccJrk accjerk)
   return;
 }
 
+void gravity_kernel(int nj, pPrdPosVel posvel, pNewAccJrk accjerk)
+{
+  gravity_kernel_jmem(nj, pred_mem, posvel, accjerk);
+  return;
+}
+
+void gravity_kernel2(int nj, pPrdPosVel posvel, pNewAccJrk accjerk)
+{
+  gravity_kernel2_jmem(nj, pred_mem, posvel, accjerk);
+  return;
+}
+
+void gravity_kernel_mc(int devid, int nj, pPrdPosVel posvel, pNewAccJrk accjerk)
+{
+  gravity_kernel_jmem(nj, avx_get_jmem_mc(devid, nj), posvel, accjerk);
+  return;
+}
+
+void gravity_kernel2_mc(int devid, int nj, pPrdPosVel posvel, pNewAccJrk accjerk)
+{
+  gravity_kernel2_jmem(nj, avx_get_jmem_mc(devid, nj), posvel, accjerk);
+  return;
+}
+
 void gravity_kerneln(int nj, pPrdPosVel posvel, pNewAccJrk accjerk, int i, int ithread)
 {
   int ret;
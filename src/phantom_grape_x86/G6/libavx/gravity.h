@@ -13,3 +13,8 @@ void gravity_kernel(int, pPrdPosVel, pNewAccJrk);
 void gravity_kernel2(int, pPrdPosVel, pNewAccJrk);
 void gravity_kerneln(int, pPrdPosVel, pNewAccJrk, int, int);
 void gravity_kernel2n(int, pPrdPosVel, pNewAccJrk, int, int);
+void avx_set_nj_mc(int, int);
+void avx_set_j_particle_mc(int, int, int, double, double *, double *);
+void avx_close_mc(void);
+void gravity_kernel_mc(int, int, pPrdPosVel, pNewAccJrk);
+void gravity_kernel2_mc(int, int, pPrdPosVel, pNewAccJrk);
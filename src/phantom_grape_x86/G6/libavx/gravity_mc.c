@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "avx.h"
+#include "avx_type.h"
+#include "gravity.h"
+#include "pred_mem.h"
+
+#define MAXDEV 256
+
+// ----------------------------------------------------
+// j-memory private to each thread (devid), for callers which make their
+// own j-lists (e.g. tree codes). The j-particles are given already
+// predicted. Shared by the AVX and the AVX2 kernels.
+
+static struct Jmem_MC{
+  pPred_Mem pred;
+  int       nblock;
+  int       nj;
+} jmem_mc[MAXDEV];
+
+void avx_set_nj_mc(int devid, int nj)
+{
+  int ret, jj, jmod;
+  int nblock = (nj + JPARA - 1) / JPARA;
+  pPred_Mem jptr;
+
+  assert(devid >= 0 && devid < MAXDEV);
+  assert(nj >= 0);
+  if(nblock > jmem_mc[devid].nblock){
+    int nblock_new = nblock + nblock / 4 + 16;
+    free(jmem_mc[devid].pred);
+    ret = posix_memalign((void **)&jmem_mc[devid].pred, 256, sizeof(struct Pred_Mem) * nblock_new);
+    assert(ret == 0);
+    jmem_mc[devid].nblock = nblock_new;
+  }
+  jmem_mc[devid].nj = nj;
+
+  if((jmod = nj % JPARA) != 0){
+    jptr = jmem_mc[devid].pred + nj / JPARA;
+    for(jj = JPARA - 1; jj >= jmod; jj--){
+      jptr->xpos[jj]   = 1e3;
+      jptr->ypos[jj]   = 1e3;
+      jptr->zpos[jj]   = 1e3;
+      jptr->xvel[jj]   = jptr->xvel[jj+4] = 0.0;
+      jptr->yvel[jj]   = jptr->yvel[jj+4] = 0.0;
+      jptr->zvel[jj]   = jptr->zvel[jj+4] = 0.0;
+      jptr->indx[jj]   = jptr->indx[jj+4] = -1.0;
+      jptr->mass[jj]   = 0.0;
+      jptr->mass[jj+4] = 0.0;
+    }
+  }
+
+  return;
+}
+
+// padr has to be smaller than nj of the last avx_set_nj_mc()
+void avx_set_j_particle_mc(int devid, int padr, int pidx, double mss,
+			   double *pos, double *vel)
+{
+  pPred_Mem jptr;
+  int jj;
+
+  assert(devid >= 0 && devid < MAXDEV);
+  if(padr < 0 || padr >= jmem_mc[devid].nj){
+    fprintf(stderr, "avx_set_j_particle_mc: padr=%d out of range [0, %d) of devid=%d\n",
+	    padr, jmem_mc[devid].nj, devid);
+    exit(1);
+  }
+  jptr = jmem_mc[devid].pred + padr / JPARA;
+  jj = padr % JPARA;
+
+  jptr->xpos[jj] = pos[0];
+  jptr->ypos[jj] = pos[1];
+  jptr->zpos[jj] = pos[2];
+  jptr->indx[jj] = jptr->indx[jj+4] = (float)pidx;
+  jptr->mass[jj] = jptr->mass[jj+4] = (float)mss;
+  jptr->xvel[jj] = jptr->xvel[jj+4] = (float)vel[0];
+  jptr->yvel[jj] = jptr->yvel[jj+4] = (float)vel[1];
+  jptr->zvel[jj] = jptr->zvel[jj+4] = (float)vel[2];
+
+  return;
+}
+
+pPred_Mem avx_get_jmem_mc(int devid, int nj)
+{
+  assert(devid >= 0 && devid < MAXDEV);
+  assert(nj <= jmem_mc[devid].nj);
+  return jmem_mc[devid].pred;
+}
+
+void avx_close_mc(void)
+{
+  int devid;
+
+  for(devid = 0; devid < MAXDEV; devid++){
+    free(jmem_mc[devid].pred);
+    jmem_mc[devid].pred   = NULL;
+    jmem_mc[devid].nblock = 0;
+    jmem_mc[devid].nj     = 0;
+  }
+
+  return;
+}
@@ -565,3 +565,74 @@ void g6_dump_(double *tim, int *n, double *m, double (*x)[3], double (*v)[3])
   g6_dump(*tim, *n, m, x, v);
   return;
 }
+
+// ----------------------------------------------------
+// Thread-safe entry points: each thread (devid) owns its j-memory and sets
+// its own j-particles, already predicted (e.g. the interaction list of a
+// tree code). g6_open() is not needed. nnb and rnnb may be NULL; rnnb is
+// the softened distance sqrt(r^2 + eps2) to the neighbour nnb.
+
+void g6_set_nj_mc(int devid, int nj)
+{
+  avx_set_nj_mc(devid, nj);
+  return;
+}
+
+void g6_set_j_particle_mc(int devid, int padr, int pidx, double mss,
+			  double *pos, double *vel)
+{
+  avx_set_j_particle_mc(devid, padr, pidx, mss, pos, vel);
+  return;
+}
+
+int g6calc_mc(int devid, int nj, int ni, int *pidx,
+	      double (*pos)[3], double (*vel)[3], double eps2,
+	      double (*acc)[3], double (*jrk)[3], double *pot, int *nnb, float *rnnb)
+{
+  int i, ii, nii;
+  PrdPosVel prdposvel_mc[NPIPES];
+  NewAccJrk newaccjrk_mc[NPIPES];
+
+  for(i = 0; i < ni; i += NPIPES){
+    nii = (ni - i < NPIPES) ? (ni - i) : NPIPES;
+    for(ii = 0; ii < nii; ii++){
+      prdposvel_mc[ii].xpos = pos[i+ii][0];
+      prdposvel_mc[ii].ypos = pos[i+ii][1];
+      prdposvel_mc[ii].zpos = pos[i+ii][2];
+      prdposvel_mc[ii].xvel = vel[i+ii][0];
+      prdposvel_mc[ii].yvel = vel[i+ii][1];
+      prdposvel_mc[ii].zvel = vel[i+ii][2];
+      prdposvel_mc[ii].id   = (float)pidx[i+ii];
+      prdposvel_mc[ii].eps2 = (float)eps2;
+    }
+    if(nii % 2 != 0)
+      prdposvel_mc[nii] = prdposvel_mc[nii-1];
+
+    for(ii = 0; ii < nii; ii += 2){
+      if(nnb == NULL && rnnb == NULL)
+	gravity_kernel_mc(devid, nj, &prdposvel_mc[ii], &newaccjrk_mc[ii]);
+      else
+	gravity_kernel2_mc(devid, nj, &prdposvel_mc[ii], &newaccjrk_mc[ii]);
+    }
+
+    for(ii = 0; ii < nii; ii++){
+      acc[i+ii][0] = acccorr * newaccjrk_mc[ii].xacc;
+      acc[i+ii][1] = acccorr * newaccjrk_mc[ii].yacc;
+      acc[i+ii][2] = acccorr * newaccjrk_mc[ii].zacc;
+      jrk[i+ii][0] = acccorr * newaccjrk_mc[ii].xjrk;
+      jrk[i+ii][1] = acccorr * newaccjrk_mc[ii].yjrk;
+      jrk[i+ii][2] = acccorr * newaccjrk_mc[ii].zjrk;
+      pot[i+ii]    = potcorr * newaccjrk_mc[ii].pot;
+      if(nnb != NULL)  nnb[i+ii]  = newaccjrk_mc[ii].nnb;
+      if(rnnb != NULL) rnnb[i+ii] = newaccjrk_mc[ii].rnnb;
+    }
+  }
+
+  return 0;
+}
+
+void g6_close_mc(void)
+{
+  avx_close_mc();
+  return;
+}
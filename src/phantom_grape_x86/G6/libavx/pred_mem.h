@@ -0,0 +1,13 @@
+// Layout of the predicted j-particles read by the AVX/AVX2 kernels. Needs
+// NVECS and NVECD of avx.h.
+
+#define JPARA 4
+
+typedef struct Pred_Mem * pPred_Mem;
+struct Pred_Mem{
+  double xpos[NVECD], ypos[NVECD], zpos[NVECD];
+  float  indx[NVECS], mass[NVECS];
+  float  xvel[NVECS], yvel[NVECS], zvel[NVECS];
+};
+
+pPred_Mem avx_get_jmem_mc(int, int);
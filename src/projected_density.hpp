@@ -0,0 +1,220 @@
+#pragma once
+
+#include<cstdio>
+#include<cmath>
+#include<vector>
+
+namespace ParticleSimulator{
+
+    // In situ projected density images.
+    //
+    // The local particles (getPos() and getCharge() of Tptcl) are put into a
+    // local TreeForForceLong::Monopole tree. A cell smaller than
+    // cell_size_cutoff pixels is deposited as one particle at its centre of
+    // mass, smoothed over the cell; the particles of the larger leaves are
+    // deposited one by one, smoothed over the smoothing length. Only the mass
+    // inside the region along the projection axis is deposited; the cells
+    // that cross its faces are opened. The 2D cubic spline kernel is
+    // normalized over all the pixels it covers, inside the image or not, so
+    // that no mass is lost to kernels smaller than a pixel and the mass
+    // outside the image is discarded. The images of the processes are
+    // summed on rank 0.
+    class ProjectedDensityRenderer{
+    public:
+        struct Force{
+            void clear(){}
+        };
+        struct EP{
+            F64vec pos_;
+            F64 mass_;
+            F64vec getPos() const { return pos_; }
+            void setPos(const F64vec & pos){ pos_ = pos; }
+            F64 getCharge() const { return mass_; }
+            template<class Tptcl>
+            void copyFromFP(const Tptcl & fp){
+                pos_ = fp.getPos();
+                mass_ = fp.getCharge();
+            }
+        };
+
+    private:
+        TreeForForceLong<Force, EP, EP>::Monopole tree_;
+        bool is_tree_initialized_;
+        S32 n_x_, n_y_;
+        S32 axis_u_, axis_v_, axis_w_;
+        F64 low_w_, high_w_;
+        F64 low_u_, low_v_;
+        F64 size_pixel_u_, size_pixel_v_;
+        F64 r_smooth_;
+        F64 size_cell_cutoff_;
+        std::vector<F64> image_;
+        std::vector<F64> weight_;
+
+        static F64 kernel(const F64 q){
+            if(q < 1.0) return 1.0 - 1.5*q*q + 0.75*q*q*q;
+            if(q < 2.0) return 0.25*(2.0-q)*(2.0-q)*(2.0-q);
+            return 0.0;
+        }
+        // the support radius is 2h
+        void deposit(const F64vec & pos, const F64 mass, F64 h){
+            if(axis_w_ >= 0 && (pos[axis_w_] < low_w_ || pos[axis_w_] >= high_w_)) return;
+            h = std::max(h, 0.5*std::max(size_pixel_u_, size_pixel_v_));
+            const F64 u = (pos[axis_u_] - low_u_) / size_pixel_u_;
+            const F64 v = (pos[axis_v_] - low_v_) / size_pixel_v_;
+            // the whole footprint, clipped to the image only when depositing
+            const S32 iu_min = (S32)std::floor(u - 2.0*h/size_pixel_u_);
+            const S32 iu_max = (S32)std::floor(u + 2.0*h/size_pixel_u_);
+            const S32 iv_min = (S32)std::floor(v - 2.0*h/size_pixel_v_);
+            const S32 iv_max = (S32)std::floor(v + 2.0*h/size_pixel_v_);
+            if(iu_max < 0 || iu_min >= n_x_ || iv_max < 0 || iv_min >= n_y_) return;
+            const S32 n_u = iu_max - iu_min + 1;
+            weight_.resize(n_u * (iv_max - iv_min + 1));
+            F64 w_sum = 0.0;
+            for(S32 iv=iv_min; iv<=iv_max; iv++){
+                const F64 dv = (iv + 0.5 - v) * size_pixel_v_;
+                for(S32 iu=iu_min; iu<=iu_max; iu++){
+                    const F64 du = (iu + 0.5 - u) * size_pixel_u_;
+                    const F64 w = kernel(std::sqrt(du*du + dv*dv) / h);
+                    weight_[(iv-iv_min)*n_u + (iu-iu_min)] = w;
+                    w_sum += w;
+                }
+            }
+            if(w_sum <= 0.0){
+                // the kernel misses every pixel centre: nearest pixel
+                const S32 iu = (S32)std::floor(u);
+                const S32 iv = (S32)std::floor(v);
+                if(iu >= 0 && iu < n_x_ && iv >= 0 && iv < n_y_) image_[iv*n_x_ + iu] += mass;
+                return;
+            }
+            const F64 m_norm = mass / w_sum;
+            for(S32 iv=std::max(0, iv_min); iv<=std::min(n_y_-1, iv_max); iv++){
+                for(S32 iu=std::max(0, iu_min); iu<=std::min(n_x_-1, iu_max); iu++){
+                    image_[iv*n_x_ + iu] += m_norm * weight_[(iv-iv_min)*n_u + (iu-iu_min)];
+                }
+            }
+        }
+        struct Depositor{
+            ProjectedDensityRenderer * renderer_;
+            bool openCell(const F64vec & center, const F64 half_length) const {
+                if(2.0*half_length > renderer_->size_cell_cutoff_) return true;
+                const S32 w = renderer_->axis_w_;
+                if(w < 0) return false;
+                return std::abs(center[w] - renderer_->low_w_) < half_length
+                    || std::abs(center[w] - renderer_->high_w_) < half_length;
+            }
+            template<class Tmom>
+            void visitCell(const Tmom & mom, const F64vec &, const F64 half_length){
+                if(mom.getCharge() <= 0.0) return;
+                renderer_->deposit(mom.getPos(), mom.getCharge(), std::max(renderer_->r_smooth_, half_length));
+            }
+            void visitParticle(const EP & ep){
+                renderer_->deposit(ep.pos_, ep.mass_, renderer_->r_smooth_);
+            }
+        };
+
+    public:
+        ProjectedDensityRenderer() : is_tree_initialized_(false), n_x_(0), n_y_(0), axis_w_(-1) {}
+
+        // The image covers region projected along axis (0, 1, 2); its
+        // horizontal axis is the first remaining one. Only the particles
+        // within region along axis are projected.
+        void initialize(const S32 n_x, const S32 n_y, const F64ort & region, const S32 axis = 2){
+            n_x_ = n_x;
+            n_y_ = n_y;
+#ifdef PARTICLE_SIMULATOR_TWO_DIMENSION
+            axis_u_ = 0;
+            axis_v_ = 1;
+            axis_w_ = -1;
+#else
+            axis_u_ = (axis == 0) ? 1 : 0;
+            axis_v_ = (axis == 2) ? 1 : 2;
+            axis_w_ = axis;
+            low_w_ = region.low_[axis_w_];
+            high_w_ = region.high_[axis_w_];
+#endif
+            low_u_ = region.low_[axis_u_];
+            low_v_ = region.low_[axis_v_];
+            size_pixel_u_ = (region.high_[axis_u_] - low_u_) / n_x_;
+            size_pixel_v_ = (region.high_[axis_v_] - low_v_) / n_y_;
+            r_smooth_ = 0.0;
+            image_.assign(n_x_ * n_y_, 0.0);
+        }
+        // 0: one pixel
+        void setSmoothingLength(const F64 r_smooth){ r_smooth_ = r_smooth; }
+
+        // Collective. The cells smaller than cell_size_cutoff pixels are not
+        // opened.
+        template<class Tpsys>
+        void render(Tpsys & psys, DomainInfo & dinfo, const F64 cell_size_cutoff = 1.0){
+            if(!is_tree_initialized_){
+                tree_.initialize(psys.getNumberOfParticleGlobal());
+                is_tree_initialized_ = true;
+            }
+            size_cell_cutoff_ = cell_size_cutoff * std::min(size_pixel_u_, size_pixel_v_);
+            image_.assign(n_x_ * n_y_, 0.0);
+            tree_.setParticleLocalTree(psys);
+            tree_.setRootCell(dinfo);
+            tree_.mortonSortLocalTreeOnly();
+            tree_.linkCellLocalTreeOnly();
+            tree_.calcMomentLocalTreeOnly();
+            Depositor dep;
+            dep.renderer_ = this;
+            tree_.traverseLocalTree(dep);
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+            std::vector<F64> image_loc(image_);
+            MPI::COMM_WORLD.Reduce(&image_loc[0], &image_[0], n_x_*n_y_, GetDataType<F64>(), MPI::SUM, 0);
+#endif
+        }
+
+        // surface density (mass per unit area), valid on rank 0
+        F64 getSurfaceDensity(const S32 ix, const S32 iy) const {
+            return image_[iy*n_x_ + ix] / (size_pixel_u_ * size_pixel_v_);
+        }
+        const std::vector<F64> & getImage() const { return image_; }
+
+        // 24 bit grey scale BMP of log10(surface density) between its
+        // minimum (positive) and maximum (rank 0 only)
+        void writeBmp(const char * const filename) const {
+            if(Comm::getRank() != 0) return;
+            F64 s_min = 0.0;
+            F64 s_max = 0.0;
+            for(S32 i=0; i<n_x_*n_y_; i++){
+                if(image_[i] <= 0.0) continue;
+                if(s_max == 0.0 || image_[i] < s_min) s_min = image_[i];
+                s_max = std::max(s_max, image_[i]);
+            }
+            const F64 l_min = (s_max > 0.0) ? std::log10(s_min) : 0.0;
+            const F64 l_range = (s_max > s_min) ? std::log10(s_max) - l_min : 1.0;
+            FILE * fp = fopen(filename, "wb");
+            if(fp == NULL){
+                PARTICLE_SIMULATOR_PRINT_ERROR("can not open output file");
+                std::cerr<<"output file: "<<filename<<std::endl;
+                Abort(-1);
+            }
+            const S32 n_byte_row = (3*n_x_ + 3) / 4 * 4;
+            U32 header[13];
+            header[0] = 54 + n_byte_row*n_y_; // bfSize
+            header[1] = 0;                     // bfReserved
+            header[2] = 54;                    // bfOffBits
+            header[3] = 40;                    // biSize
+            header[4] = n_x_;
+            header[5] = n_y_;
+            header[6] = 1 | (24 << 16);        // biPlanes, biBitCount
+            for(S32 i=7; i<13; i++) header[i] = 0;
+            fwrite("BM", 1, 2, fp);
+            fwrite(header, 4, 13, fp);
+            std::vector<unsigned char> row(n_byte_row, 0);
+            for(S32 iy=0; iy<n_y_; iy++){
+                for(S32 ix=0; ix<n_x_; ix++){
+                    const F64 s = image_[iy*n_x_ + ix];
+                    const F64 c = (s > 0.0) ? (std::log10(s) - l_min) / l_range : 0.0;
+                    const unsigned char g = (unsigned char)(255.0 * std::min(1.0, std::max(0.0, c)));
+                    row[3*ix] = row[3*ix+1] = row[3*ix+2] = g;
+                }
+                fwrite(&row[0], 1, n_byte_row, fp);
+            }
+            fclose(fp);
+        }
+    };
+
+}
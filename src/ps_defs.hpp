@@ -755,6 +755,7 @@ namespace ParticleSimulator{
     template<class Tp>
     inline F64ort GetMinBox(const Tp ptcl[], const S32 n){
 	F64ort box_loc;
+	box_loc.initNegativeVolume();
 #pragma omp parallel
 	{
 	    F64ort box_loc_tmp;
@@ -780,6 +781,7 @@ namespace ParticleSimulator{
     template<class Tp>
     inline F64ort GetMinBoxWithMargen(const Tp ptcl[], const S32 n){
         F64ort box_loc;
+        box_loc.initNegativeVolume();
 #pragma omp parallel
         {
             F64ort box_loc_tmp;
@@ -863,6 +865,120 @@ namespace ParticleSimulator{
     public:
         typedef typename HasRSearchInner< sizeof(Func<T>(NULL)) == 1 >::type type;
     };
+
+    // EPJ/SPJ which can be predicted in time (predict(dt))
+    struct TagPredict{};
+    struct TagNoPredict{};
+
+    template<bool T>
+    struct HasPredictInner{
+        typedef TagPredict type;
+    };
+    template<>
+    struct HasPredictInner<false>{
+        typedef TagNoPredict type;
+    };
+
+    template <class T>
+    class HasPredict{
+    private:
+        typedef char One[1];
+        typedef char Two[2];
+
+        template <class T2, T2>
+        class Check{};
+
+        template <typename T3>
+        static One & Func( Check<void (T3::*)(double), &T3::predict>* );
+
+        template <typename T3>
+        static Two &  Func(...);
+
+    public:
+        typedef typename HasPredictInner< sizeof(Func<T>(NULL)) == 1 >::type type;
+    };
+
+    // EP/SPJ whose position can be set (setPos(F64vec) or setPos(F32vec))
+    struct TagSetPos{};
+    struct TagNoSetPos{};
+
+    template<bool T>
+    struct HasSetPosInner{
+        typedef TagSetPos type;
+    };
+    template<>
+    struct HasSetPosInner<false>{
+        typedef TagNoSetPos type;
+    };
+
+    template <class T>
+    class HasSetPos{
+    private:
+        typedef char One[1];
+        typedef char Two[2];
+
+        template <class T2, T2>
+        class Check{};
+
+        template <typename T3>
+        static One & Func( Check<void (T3::*)(const F64vec &), &T3::setPos>* );
+        template <typename T3>
+        static One & Func( Check<void (T3::*)(const F32vec &), &T3::setPos>* );
+
+        template <typename T3>
+        static Two &  Func(...);
+
+    public:
+        typedef typename HasSetPosInner< sizeof(Func<T>(NULL)) == 1 >::type type;
+    };
+
+    // FP which describes its fields for the binary snapshots
+    // (static const char * getBinaryLayout())
+    struct TagBinaryLayout{};
+    struct TagNoBinaryLayout{};
+
+    template<bool T>
+    struct HasBinaryLayoutInner{
+        typedef TagBinaryLayout type;
+    };
+    template<>
+    struct HasBinaryLayoutInner<false>{
+        typedef TagNoBinaryLayout type;
+    };
+
+    template <class T>
+    class HasBinaryLayout{
+    private:
+        typedef char One[1];
+        typedef char Two[2];
+
+        template <class T2, T2>
+        class Check{};
+
+        template <typename T3>
+        static One & Func( Check<const char * (*)(), &T3::getBinaryLayout>* );
+
+        template <typename T3>
+        static Two &  Func(...);
+
+    public:
+        typedef typename HasBinaryLayoutInner< sizeof(Func<T>(NULL)) == 1 >::type type;
+    };
+
+    // EPI and EPJ of the same class: the tree keeps one copy of the particles in the original order
+    struct TagEpiIsEpj{};
+    struct TagEpiIsNotEpj{};
+
+    template<class Tepi, class Tepj>
+    struct EpiIsEpj{
+        static const bool value = false;
+        typedef TagEpiIsNotEpj type;
+    };
+    template<class Tep>
+    struct EpiIsEpj<Tep, Tep>{
+        static const bool value = true;
+        typedef TagEpiIsEpj type;
+    };
 }
 
 #include"reallocatable_array.hpp"
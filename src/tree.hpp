@@ -322,6 +322,11 @@ namespace ParticleSimulator{
                 ip->adr_ptcl_ = tc.adr_ptcl_;
             }
         };
+        // absorb the following i-group (contiguous in epi_sorted_)
+        void merge(const IPGroup & ipg){
+            n_ptcl_ += ipg.n_ptcl_;
+            vertex_.merge(ipg.vertex_);
+        }
         // for DEBUG
         void dump(std::ostream & fout = std::cout){
             fout<<"n_ptcl_="<<n_ptcl_<<std::endl;
@@ -345,6 +350,12 @@ namespace ParticleSimulator{
             vertex_ = tc.mom_.vertex_out_;
             vertex_in = tc.mom_.vertex_in_;
         }
+        // absorb the following i-group (contiguous in epi_sorted_)
+        void merge(const IPGroup & ipg){
+            n_ptcl_ += ipg.n_ptcl_;
+            vertex_.merge(ipg.vertex_);
+            vertex_in.merge(ipg.vertex_in);
+        }
         // for DEBUG
         void dump(std::ostream & fout = std::cout){
             fout<<"n_ptcl_="<<n_ptcl_<<std::endl;
@@ -375,18 +386,39 @@ namespace ParticleSimulator{
         }
     };
 
+    // position and search radius of EPJ with its address in epj_org_
+    // (used to make Verlet lists with the usual tree walks)
+    class EPXRAdr{
+        F64 r_search;
+        F64vec pos;
+        S32 adr;
+    public:
+        F64 getRSearch() const { return r_search;}
+        F64vec getPos() const { return pos;}
+	void setPos(const F64vec & pos_in) { pos = pos_in;}
+        S32 getAdr() const { return adr;}
+        void set(const F64vec & pos_in, const F64 r_search_in, const S32 adr_in){
+            pos = pos_in;
+            r_search = r_search_in;
+            adr = adr_in;
+        }
+    };
+
 
     //////////////
     /// Moment ///
+    // The positions (and the masses they are weighted with) of the moments
+    // and SPJ of Monopole and Quadrupole are F64, so that the mixed
+    // precision mode can shift them by the i-group.
     class MomentMonopole{
     public:
-        F32 mass;
-        F32vec pos;
+        F64 mass;
+        F64vec pos;
         MomentMonopole(){
             mass = 0.0;
             pos = 0.0;
         }
-        MomentMonopole(const F32 m, const F32vec & p){
+        MomentMonopole(const F64 m, const F64vec & p){
             mass = m;
             pos = p;
         }
@@ -394,10 +426,10 @@ namespace ParticleSimulator{
             mass = 0.0;
             pos = 0.0;
         }
-        F32vec getPos() const {
+        F64vec getPos() const {
             return pos;
         }
-        F32 getCharge() const {
+        F64 getCharge() const {
             return mass;
         }
         template<class Tepj>
@@ -422,10 +454,74 @@ namespace ParticleSimulator{
         }
     };
 
+    // Monopole with the time derivatives of the center of mass, for Hermite
+    // integrators. Tepj has to provide getVel(), getAcc() and getJerk().
+    class MomentMonopoleHermite{
+    public:
+        F64 mass;
+        F64vec pos;
+        F64vec vel;
+        F64vec acc;
+        F64vec jerk;
+        MomentMonopoleHermite(){
+            init();
+        }
+        MomentMonopoleHermite(const F64 m, const F64vec & p, const F64vec & v,
+                              const F64vec & a, const F64vec & j){
+            mass = m;
+            pos = p;
+            vel = v;
+            acc = a;
+            jerk = j;
+        }
+        void init(){
+            mass = 0.0;
+            pos = vel = acc = jerk = 0.0;
+        }
+        F64vec getPos() const {
+            return pos;
+        }
+        F64 getCharge() const {
+            return mass;
+        }
+        template<class Tepj>
+        void accumulateAtLeaf(const Tepj & epj){
+            const F64 m = epj.getCharge();
+            mass += m;
+            pos += m * epj.getPos();
+            vel += m * epj.getVel();
+            acc += m * epj.getAcc();
+            jerk += m * epj.getJerk();
+        }
+        template<class Tepj>
+        void accumulateAtLeaf2(const Tepj & epj){}
+        void set(){
+            const F64 m_inv = 1.0 / mass;
+            pos = pos * m_inv;
+            vel = vel * m_inv;
+            acc = acc * m_inv;
+            jerk = jerk * m_inv;
+        }
+        void accumulate(const MomentMonopoleHermite & mom){
+            mass += mom.mass;
+            pos += mom.mass * mom.pos;
+            vel += mom.mass * mom.vel;
+            acc += mom.mass * mom.acc;
+            jerk += mom.mass * mom.jerk;
+        }
+        void accumulate2(const MomentMonopoleHermite & mom){}
+        // for DEBUG 
+        void dump(std::ostream & fout = std::cout) const {
+            fout<<"mass="<<mass<<std::endl;
+            fout<<"pos="<<pos<<std::endl;
+            fout<<"vel="<<vel<<std::endl;
+        }
+    };
+
     class MomentQuadrupole{
     public:
-        F32vec pos;
-        F32 mass;
+        F64vec pos;
+        F64 mass;
         F32mat quad;
         void init(){
             pos = 0.0;
@@ -437,12 +533,12 @@ namespace ParticleSimulator{
             pos = 0.0;
             quad = 0.0;
         }
-        MomentQuadrupole(const F32 m, const F32vec & p, const F32mat & q){
+        MomentQuadrupole(const F64 m, const F64vec & p, const F32mat & q){
             mass = m;
             pos = p;
             quad = q;
         }
-        F32vec getPos() const {
+        F64vec getPos() const {
             return pos;
         }
         template<class Tepj>
@@ -854,18 +950,64 @@ namespace ParticleSimulator{
         F64vec pos;
     };
 
+    class SPJMonopoleHermite{
+    public:
+        void copyFromMoment(const MomentMonopoleHermite & mom){
+            mass = mom.mass;
+            pos = mom.pos;
+            vel = mom.vel;
+            acc = mom.acc;
+            jerk = mom.jerk;
+        }
+        void clear(){
+            mass = 0.0;
+            pos = vel = acc = jerk = 0.0;
+        }
+        F64 getCharge() const {
+            return mass;
+        }
+        F64vec getPos() const {
+            return pos;
+        }
+        void setPos(const F64vec & pos_new) {
+            pos = pos_new;
+        }
+        F64vec getVel() const {
+            return vel;
+        }
+        F64vec getAcc() const {
+            return acc;
+        }
+        F64vec getJerk() const {
+            return jerk;
+        }
+        MomentMonopoleHermite convertToMoment() const {
+            return MomentMonopoleHermite(mass, pos, vel, acc, jerk);
+        }
+        // 3rd order prediction (used by the tree walk, see setDtPrediction)
+        void predict(const F64 dt){
+            pos += dt * (vel + dt * (0.5 * acc + (1.0/6.0) * dt * jerk));
+            vel += dt * (acc + 0.5 * dt * jerk);
+        }
+        F64 mass;
+        F64vec pos;
+        F64vec vel;
+        F64vec acc;
+        F64vec jerk;
+    };
+
     class SPJQuadrupole{
     public:
         F32 mass;
-        F32vec pos;
+        F64vec pos;
         F32mat quad;
         F32 getCharge() const {
             return mass;
         }
-        F32vec getPos() const {
+        F64vec getPos() const {
             return pos;
         }
-        void setPos(const F32vec & pos_new) {
+        void setPos(const F64vec & pos_new) {
             pos = pos_new;
         }
         void copyFromMoment(const MomentQuadrupole & mom){
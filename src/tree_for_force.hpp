@@ -47,11 +47,24 @@ namespace ParticleSimulator{
         S32 ni_ave_;
         S32 nj_ave_;
 
+        // cost-ordered scheduling of the i-group loop in calcForce
+        ReallocatableArray<S32> n_epj_for_force_org_; // # of j-particles of each particle when it was last an i-particle, -1: never (original order)
+        ReallocatableArray<U32> cell_for_force_org_; // coarse cell of the particle at that time, to tell if it is still the same particle
+        ReallocatableArray<S32> adr_ipg_chunk_; // head i-group of each chunk (chunks are contiguous in Morton order)
+        ReallocatableArray< std::pair<F64, S32> > cost_ipg_chunk_; // (cost, chunk), the largest first
+        ReallocatableArray<S32> ipg_chunk_queue_; // the queue of thread i is [ipg_chunk_queue_head_[i], ipg_chunk_queue_tail_[i]), indices of cost_ipg_chunk_
+        ReallocatableArray<S32> ipg_chunk_queue_head_; // [n_thread], moved only by the owner (see popIPGroupChunk)
+        ReallocatableArray<S32> ipg_chunk_queue_tail_; // [n_thread], moved only by the thieves
+        ReallocatableArray<F64> ipg_chunk_queue_cost_; // [n_thread], cost left in the queue
+        ReallocatableArray<F64> wtime_busy_calc_force_; // [n_thread]
+        ReallocatableArray<F64> wtime_idle_calc_force_; // [n_thread]
+
         RadixSort<U64, 8> rs_;
         S32 n_loc_tot_; // # of all kinds of particles in local process
         S32 n_glb_tot_; // # of all kinds of particles in all processes
         S32 n_leaf_limit_;
         S32 n_group_limit_;
+        S32 n_ipg_batch_; // max # of i-groups dispatched in one kernel call
 
         S32 adr_tc_level_partition_[TREE_LEVEL_LIMIT+2];
         S32 lev_max_;
@@ -65,6 +78,12 @@ namespace ParticleSimulator{
         ReallocatableArray< TreeCell< Tmomloc > > tc_loc_;
         ReallocatableArray< TreeCell< Tmomglb > > tc_glb_;
         ReallocatableArray< Tepi > epi_sorted_, epi_org_;
+        // epi_org_ is left empty if Tepi == Tepj, the local part of epj_org_ is used instead
+        Tepi * getEpiOrgPointer(){ return getEpiOrgPointerImpl(typename EpiIsEpj<Tepi, Tepj>::type()); }
+        Tepi * getEpiOrgPointerImpl(TagEpiIsNotEpj){ return epi_org_.getPointer(); }
+        Tepi * getEpiOrgPointerImpl(TagEpiIsEpj){ return epj_org_.getPointer(); }
+        void setEpSortedLocal(TagEpiIsNotEpj);
+        void setEpSortedLocal(TagEpiIsEpj);
         ReallocatableArray< Tepj > epj_sorted_, epj_org_;
         ReallocatableArray< Tspj > spj_sorted_, spj_org_;
         ReallocatableArray< IPGroup<TSM> > ipg_;
@@ -96,6 +115,70 @@ namespace ParticleSimulator{
 
         S32 n_surface_for_comm_;
 
+        // LET particles sent to the other processes (short mode)
+        ReallocatableArray<S32> adr_ep_send_; // address in the local tree of each particle in epj_send_
+        ReallocatableArray<S32> adr_ep_let_send_; // addresses of all LET particles sent, in the order of epj_recv_ of the receivers
+        S32 * n_ep_let_send_disp_; // * n_proc+1
+
+        // for calcForceNewton3rd (SEARCH_MODE_SYMMETRY only)
+        ReallocatableArray<S32> adr_ipg_org_; // i-group of each local particle (original order)
+        ReallocatableArray<S32> adr_sorted_org_; // address in epi_sorted_ of each local particle (original order)
+        ReallocatableArray<S32> * adr_epj_for_force_; // where the reaction on epj_for_force_ goes (-1: dropped)
+        ReallocatableArray<Tforce> * force_epj_for_force_; // reaction on epj_for_force_
+        // reaction on a local (sorted order, adr < n_loc_tot_) or LET particle
+        struct ReactionEpj{
+            S32 adr_;
+            Tforce force_;
+        };
+        ReallocatableArray<ReactionEpj> * reaction_for_force_; // [n_thread*n_thread], [ith*n_thread+ib]: by thread ith on the address block ib
+        ReallocatableArray<Tforce> force_let_;
+        ReallocatableArray<Tforce> force_let_recv_;
+
+        // for calcForceAllVerlet (short mode)
+        F64 skin_verlet_;
+        bool is_verlet_list_valid_;
+        bool is_verlet_list_rebuilt_;
+        S64 n_modification_psys_verlet_; // GetNumberOfModification(psys) when the lists were made
+        ReallocatableArray<EPXRAdr> epxr_adr_sorted_; // copy of epj_sorted_ with the address in epj_org_
+        ReallocatableArray<EPXRAdr> * epxr_adr_for_force_; // [n_thread]
+        ReallocatableArray<S32> * adr_epj_verlet_; // [n_thread] lists (addresses in epj_org_) made by each thread
+        ReallocatableArray<S32> ith_verlet_list_; // thread which made the list of each i-group
+        ReallocatableArray<S32> adr_verlet_list_; // head of the list of each i-group in adr_epj_verlet_[ith]
+        ReallocatableArray<S32> n_verlet_list_; // length of the list of each i-group
+        ReallocatableArray<F64vec> pos_verlet_org_; // positions of local particles at the last list build
+        ReallocatableArray<F64vec> pos_verlet_let_; // positions of LET particles at the last list build
+
+        // uniform-grid cell list used instead of the global tree (short mode)
+        bool cell_list_mode_;
+        F64vec pos_low_cell_list_; // lower corner of the grid
+        F64 size_cell_list_; // side length of a cell
+        S32 n_cell_list_[DIMENSION]; // # of cells along each axis
+        F64 r_search_max_cell_list_; // max search radius of EPJ
+        ReallocatableArray<S32> adr_cell_list_head_; // head of each cell in epj_sorted_ (n_cell+1)
+        ReallocatableArray<S32> * adr_cell_list_for_force_; // [n_thread]
+
+        // for calcForceActiveAndWriteBack (block timesteps)
+        ReallocatableArray<S32> n_active_cum_; // # of active particles before each particle of the local tree
+        ReallocatableArray<S32> adr_active_org_; // original address of each active particle (Morton order)
+        ReallocatableArray<Tepi> epi_active_;
+        ReallocatableArray<Tforce> force_active_;
+
+        F64 dt_predict_; // time since the last tree construction to which the interaction lists are predicted
+        void setDtPredictionImpl(TagPredict, const F64 dt);
+        void setDtPredictionImpl(TagNoPredict, const F64 dt);
+        void checkDtPredictionSpj(TagForceShort);
+        void checkDtPredictionSpj(TagForceLong);
+
+        // mixed precision mode: positions passed to the kernels are relative to the i-group centre
+        bool mixed_precision_;
+        ReallocatableArray<Tepi> * epi_for_force_; // [n_thread] shifted copy of the i-particles
+        void checkMixedPrecisionModeSpj(TagForceShort);
+        void checkMixedPrecisionModeSpj(TagForceLong);
+
+        // set by the *AndWriteBack functions, which copy force_sorted_ to force_org_ and psys in one pass
+        bool defer_copy_force_org_;
+        Tepi * shiftInteractionList(const S32 adr_ipg, Tepi * epi, const S32 n_epi);
+
         template<class Tep2, class Tep3>
         inline void scatterEP(S32 n_send[],
                               S32 n_send_disp[],
@@ -138,6 +221,47 @@ namespace ParticleSimulator{
         void makeInteractionListImpl(TagSearchShortGather, const S32 adr_ipg);
         void makeInteractionListImpl(TagSearchShortSymmetry, const S32 adr_ipg); 
 
+        void makeIPGroupSchedule(const Tepi * epi, const S32 * adr_org);
+        void setCostIPGroup(const S32 adr_ipg, const S32 n_epj, const Tepi * epi, const S32 * adr_org);
+        U32 getCellForCost(const F64vec & pos) const;
+        // the original address of the ip-th i-particle: adr_org[ip], or that of the local tree if adr_org is NULL
+        S32 getAdrOrgIPGroup(const S32 ip, const S32 * adr_org) const {
+            return (adr_org != NULL) ? adr_org[ip] : (S32)ClearMSB(tp_loc_[ip].adr_ptcl_);
+        }
+        void makeEPXRAdrSortedImpl(TagRSearch);
+        void makeEPXRAdrSortedImpl(TagNoRSearch);
+        void makeVerletListImpl(TagSearchShortScatter, const S32 adr_ipg);
+        void makeVerletListImpl(TagSearchShortGather, const S32 adr_ipg);
+        void makeVerletListImpl(TagSearchShortSymmetry, const S32 adr_ipg);
+        void makeVerletList();
+        void exchangeLocalEssentialTreeVerlet();
+        void makeInteractionListVerlet(const S32 adr_ipg);
+        F64 getRSearchMaxImpl(TagRSearch);
+        F64 getRSearchMaxImpl(TagNoRSearch);
+        void makeCellListGlobal();
+        void setCellListModeImpl(TagForceShort, const bool flag);
+        void setCellListModeImpl(TagForceLong, const bool flag);
+        S32 getCellIndex(const F64vec & pos) const;
+        void makeAdrListUsingCellList(const F64ort & pos_box, ReallocatableArray<S32> & adr_list);
+        void makeAdrListUsingCellListImpl(TagSearchShortScatter, const S32 adr_ipg, ReallocatableArray<S32> & adr_list);
+        void makeAdrListUsingCellListImpl(TagSearchShortGather, const S32 adr_ipg, ReallocatableArray<S32> & adr_list);
+        void makeAdrListUsingCellListImpl(TagSearchShortSymmetry, const S32 adr_ipg, ReallocatableArray<S32> & adr_list);
+        template<class Tsearch>
+        void makeInteractionListUsingCellList(Tsearch, const S32 adr_ipg);
+        void makeInteractionListNewton3rd(const S32 adr_ipg);
+        template<class Tpsys>
+        void makeIPGroupActive(const Tpsys & psys, const S32 adr_active[], const S32 n_active);
+        void setVertexIPGroupActiveImpl(TagSearchLong, const S32 adr_ipg);
+        void setVertexIPGroupActiveImpl(TagSearchLongCutoff, const S32 adr_ipg);
+        void setVertexIPGroupActiveImpl(TagSearchShortScatter, const S32 adr_ipg);
+        void setVertexIPGroupActiveImpl(TagSearchShortGather, const S32 adr_ipg);
+        void setVertexIPGroupActiveImpl(TagSearchShortSymmetry, const S32 adr_ipg);
+        template<class Tfunc_ep_ep>
+        void calcForceOnlyNewton3rd(Tfunc_ep_ep pfunc_ep_ep,
+                                    const S32 adr_ipg,
+                                    const bool clear);
+        bool popIPGroupChunk(const S32 ith, S32 & adr_chunk);
+
         void checkMakeGlobalTreeImpl(TagForceLong, S32 & err, const F64vec & center, const F64 tolerance, std::ostream & fout);
         void checkMakeGlobalTreeImpl(TagForceShort, S32 & err, const F64vec & center, const F64 tolerance, std::ostream & fout);
 
@@ -161,10 +285,10 @@ namespace ParticleSimulator{
             calcCenterAndLengthOfRootCellOpenNoMargenImpl(epj_org_.getPointer());
         }
         void calcCenterAndLengthOfRootCellOpenImpl(TagSearchShortGather){
-            calcCenterAndLengthOfRootCellOpenNoMargenImpl(epi_org_.getPointer());
+            calcCenterAndLengthOfRootCellOpenNoMargenImpl(getEpiOrgPointer());
         }
         void calcCenterAndLengthOfRootCellOpenImpl(TagSearchShortSymmetry){
-            calcCenterAndLengthOfRootCellOpenNoMargenImpl(epi_org_.getPointer());
+            calcCenterAndLengthOfRootCellOpenNoMargenImpl(getEpiOrgPointer());
         }
         void calcCenterAndLengthOfRootCellOpenImpl(TagSearchLongCutoff){
             calcCenterAndLengthOfRootCellOpenNoMargenImpl(epj_org_.getPointer());
@@ -183,10 +307,10 @@ namespace ParticleSimulator{
             calcCenterAndLengthOfRootCellPeriodicImpl2(epj_org_.getPointer());
         }
         void calcCenterAndLengthOfRootCellPeriodicImpl(TagSearchShortGather){
-            calcCenterAndLengthOfRootCellPeriodicImpl2(epi_org_.getPointer());
+            calcCenterAndLengthOfRootCellPeriodicImpl2(getEpiOrgPointer());
         }
         void calcCenterAndLengthOfRootCellPeriodicImpl(TagSearchShortSymmetry){
-            calcCenterAndLengthOfRootCellPeriodicImpl2(epi_org_.getPointer());
+            calcCenterAndLengthOfRootCellPeriodicImpl2(getEpiOrgPointer());
         }
         void calcCenterAndLengthOfRootCellPeriodicImpl(TagSearchLongCutoff){
             calcCenterAndLengthOfRootCellPeriodicImpl2(epj_org_.getPointer());
@@ -286,7 +410,21 @@ namespace ParticleSimulator{
 	
     public:
 
-        TreeForForce() : is_initialized_(false){}
+        TreeForForce() : is_initialized_(false), n_ipg_batch_(1),
+                         adr_epj_for_force_(NULL), force_epj_for_force_(NULL), reaction_for_force_(NULL),
+                         skin_verlet_(0.0), is_verlet_list_valid_(false), is_verlet_list_rebuilt_(false),
+                         n_modification_psys_verlet_(0), epxr_adr_for_force_(NULL), adr_epj_verlet_(NULL),
+                         cell_list_mode_(false), adr_cell_list_for_force_(NULL), dt_predict_(0.0), mixed_precision_(false), epi_for_force_(NULL),
+                         defer_copy_force_org_(false){}
+        ~TreeForForce(){
+            delete [] adr_epj_for_force_;
+            delete [] force_epj_for_force_;
+            delete [] reaction_for_force_;
+            delete [] adr_cell_list_for_force_;
+            delete [] epi_for_force_;
+            delete [] epxr_adr_for_force_;
+            delete [] adr_epj_verlet_;
+        }
 
         size_t getMemSizeUsed()const;
 	
@@ -310,6 +448,38 @@ namespace ParticleSimulator{
         void setLocalEssentialTreeToGlobalTree();
         void mortonSortGlobalTreeOnly();
         S32 getNumberOfIPG() const { return ipg_.size();}
+        // Dispatch up to n consecutive small i-groups in one kernel call with
+        // the union of their j-lists (useful for kernels with high setup cost).
+        void setNumberOfIPGroupBatch(const S32 n){ n_ipg_batch_ = (n > 1) ? n : 1; }
+        S32 getNumberOfIPGroupBatch() const { return n_ipg_batch_; }
+        // Verlet lists (calcForceAllVerlet). getRSearch() of EPs must include
+        // the skin; the lists are reused while no particle moves more than skin/2.
+        void setVerletSkin(const F64 skin){ skin_verlet_ = skin; }
+        F64 getVerletSkin() const { return skin_verlet_; }
+        void clearVerletList(){ is_verlet_list_valid_ = false; }
+        bool isVerletListRebuilt() const { return is_verlet_list_rebuilt_; }
+        template<class Tpsys>
+        bool needVerletListRebuild(const Tpsys & psys);
+        // Replace the global tree by a uniform grid of cells (short mode
+        // only). Faster for nearly uniform distributions.
+        void setCellListMode(const bool flag);
+        bool getCellListMode() const { return cell_list_mode_; }
+        // Predict the j-particles and superparticles of the interaction
+        // lists by dt from the state of the last tree construction (Tepj
+        // and Tspj need predict(F64), e.g. SPJMonopoleHermite; aborts if
+        // dt != 0 and they do not). The tree is not rebuilt. Reset to 0 by
+        // setParticleLocalTree().
+        void setDtPrediction(const F64 dt);
+        F64 getDtPrediction() const { return dt_predict_; }
+        // Mixed precision mode. The kernels get the i-particles, j-particles
+        // and superparticles with positions relative to the centre of the
+        // i-group (shifted in F64, once per group), so that they can be
+        // converted to F32 without losing accuracy in large boxes. The
+        // forces must not depend on the origin. Tepi, Tepj (and Tspj in long
+        // mode) need setPos(); in long mode, the moments and Tspj need F64
+        // positions (Monopole, MonopoleHermite and Quadrupole).
+        void setMixedPrecisionMode(const bool flag);
+        bool getMixedPrecisionMode() const { return mixed_precision_; }
         void makeInteractionList(const S32 adr_ipg);
         template<class Tfunc_ep_ep>
         void calcForceOnly(Tfunc_ep_ep pfunc_ep_ep,
@@ -321,6 +491,9 @@ namespace ParticleSimulator{
                            const S32 adr_ipg,
                            const bool clear = true);
         void copyForceOriginalOrder();
+        // the same permutation, also writing the forces back to psys
+        template<class Tpsys>
+        void copyForceOriginalOrder(Tpsys & psys);
         template<class Tfunc_ep_ep>
         void calcForce(Tfunc_ep_ep pfunc_ep_ep,
                        const bool clear=true);
@@ -332,12 +505,54 @@ namespace ParticleSimulator{
         void calcForceAndWriteBack(Tfunc_ep_ep pfunc_ep_ep,
                                    Tpsys & psys,
                                    const bool clear=true);
+        // calcForce with the interaction lists kept by calcForceAllVerlet
+        template<class Tfunc_ep_ep>
+        void calcForceVerlet(Tfunc_ep_ep pfunc_ep_ep,
+                             const bool clear=true);
+        // SEARCH_MODE_SYMMETRY only. Every pair is evaluated once and the
+        // reaction is scattered to j. The kernel is called as
+        // pfunc_ep_ep(epi, ni, epj, nj, force_i, force_j), where epj[0..ni-1]
+        // are the i-particles themselves (evaluate only the pairs j > i among
+        // them) and force_j receives the reactions. Tforce has to provide
+        // accumulate(const Tforce &). Only pairs closer than
+        // max(r_search_i, r_search_j) are guaranteed to be evaluated. Reactions
+        // on LET particles are sent back to the owner processes.
+        template<class Tfunc_ep_ep>
+        void calcForceNewton3rd(Tfunc_ep_ep pfunc_ep_ep,
+                                const bool clear=true);
         template<class Tfunc_ep_ep, class Tfunc_ep_sp, class Tpsys>
         void calcForceAndWriteBack(Tfunc_ep_ep pfunc_ep_ep,
                                    Tfunc_ep_sp pfunc_ep_sp,
                                    Tpsys & psys,
                                    const bool clear=true);
+        // Force on the active particles psys[adr_active[0..n_active-1]] only,
+        // using the trees of the last calcForceAll* (the j-particles keep the
+        // positions of that call, the i-particles are taken from psys). The
+        // particles must not be exchanged or added in between.
+        template<class Tfunc_ep_ep, class Tpsys>
+        void calcForceActiveAndWriteBack(Tfunc_ep_ep pfunc_ep_ep,
+                                         Tpsys & psys,
+                                         const S32 adr_active[],
+                                         const S32 n_active,
+                                         const bool clear=true);
+        template<class Tfunc_ep_ep, class Tfunc_ep_sp, class Tpsys>
+        void calcForceActiveAndWriteBack(Tfunc_ep_ep pfunc_ep_ep,
+                                         Tfunc_ep_sp pfunc_ep_sp,
+                                         Tpsys & psys,
+                                         const S32 adr_active[],
+                                         const S32 n_active,
+                                         const bool clear=true);
         Tforce getForce(const S32 i) const { return force_org_[i]; }
+        // Visits the local tree (after calcMomentLocalTreeOnly, before the
+        // global tree is sorted). A cell for which
+        // func.openCell(center, half_length) is false is given to
+        // func.visitCell(mom, center, half_length) as a whole; the particles
+        // of the opened leaves are given to func.visitParticle(epj).
+        template<class Tfunc>
+        void traverseLocalTree(Tfunc & func) const;
+        // wall time of the thread ith spent on i-groups and waiting for the other threads in the last calcForce
+        F64 getWtimeBusyCalcForce(const S32 ith=0) const { return wtime_busy_calc_force_[ith]; }
+        F64 getWtimeIdleCalcForce(const S32 ith=0) const { return wtime_idle_calc_force_[ith]; }
 
         ///////////////////////
         /// CHECK FUNCTIONS ///
@@ -442,8 +657,10 @@ namespace ParticleSimulator{
                                       Tpsys & psys,
                                       DomainInfo & dinfo,
                                       const bool clear_force = true){
+            defer_copy_force_org_ = true;
             calcForceAll(pfunc_ep_ep, psys, dinfo, clear_force); 
-            for(S32 i=0; i<n_loc_tot_; i++) psys[i].copyFromForce(force_org_[i]);
+            defer_copy_force_org_ = false;
+            copyForceOriginalOrder(psys);
         }
 
         template<class Tfunc_ep_ep, class Tpsys>
@@ -451,8 +668,10 @@ namespace ParticleSimulator{
                                                Tpsys & psys,
                                                DomainInfo & dinfo,
                                                const bool clear_force = true){
+            defer_copy_force_org_ = true;
             calcForceAllWithCheck(pfunc_ep_ep, psys, dinfo, clear_force);
-            for(S32 i=0; i<n_loc_tot_; i++) psys[i].copyFromForce(force_org_[i]);
+            defer_copy_force_org_ = false;
+            copyForceOriginalOrder(psys);
         }
         //////////////////
         // FOR SHORT FORCE
@@ -505,6 +724,129 @@ namespace ParticleSimulator{
         }
 
 
+        ////////////////////////////////////////
+        // FOR SHORT FORCE WITH NEWTON'S 3RD LAW
+        template<class Tfunc_ep_ep, class Tpsys>
+        void calcForceAllNewton3rd(Tfunc_ep_ep pfunc_ep_ep, 
+                                   Tpsys & psys,
+                                   DomainInfo & dinfo,
+                                   const bool clear_force = true){
+            setParticleLocalTree(psys);
+            setRootCell(dinfo);
+            mortonSortLocalTreeOnly();
+            linkCellLocalTreeOnly();
+            calcMomentLocalTreeOnly();
+            exchangeLocalEssentialTree(dinfo);
+            setLocalEssentialTreeToGlobalTree();
+            mortonSortGlobalTreeOnly();
+            linkCellGlobalTreeOnly();
+            calcMomentGlobalTreeOnly();
+            makeIPGroup();
+            calcForceNewton3rd(pfunc_ep_ep, clear_force);
+        }
+
+        template<class Tfunc_ep_ep, class Tpsys>
+        void calcForceAllAndWriteBackNewton3rd(Tfunc_ep_ep pfunc_ep_ep, 
+                                               Tpsys & psys,
+                                               DomainInfo & dinfo,
+                                               const bool clear_force = true){
+            defer_copy_force_org_ = true;
+            calcForceAllNewton3rd(pfunc_ep_ep, psys, dinfo, clear_force);
+            defer_copy_force_org_ = false;
+            copyForceOriginalOrder(psys);
+        }
+
+        ///////////////////////////////////
+        // FOR SHORT FORCE WITH VERLET LISTS
+        // The lists are rebuilt when a particle has moved by more than half
+        // the skin or when the ParticleSystem has added, removed, sorted or
+        // exchanged (exchangeParticle()) particles since the last build, so
+        // exchangeParticle() may be called every step. Reordering the
+        // particles by other means needs clearVerletList().
+        template<class Tfunc_ep_ep, class Tpsys>
+        void calcForceAllVerlet(Tfunc_ep_ep pfunc_ep_ep, 
+                                Tpsys & psys,
+                                DomainInfo & dinfo,
+                                const bool clear_force = true){
+            if( needVerletListRebuild(psys) ){
+                setParticleLocalTree(psys);
+                setRootCell(dinfo);
+                mortonSortLocalTreeOnly();
+                linkCellLocalTreeOnly();
+                calcMomentLocalTreeOnly();
+                exchangeLocalEssentialTree(dinfo);
+                setLocalEssentialTreeToGlobalTree();
+                mortonSortGlobalTreeOnly();
+                linkCellGlobalTreeOnly();
+                calcMomentGlobalTreeOnly();
+                makeIPGroup();
+                makeVerletList();
+                is_verlet_list_rebuilt_ = true;
+            }
+            else{
+                setParticleLocalTree(psys);
+                exchangeLocalEssentialTreeVerlet();
+                is_verlet_list_rebuilt_ = false;
+            }
+            calcForceVerlet(pfunc_ep_ep, clear_force);
+        }
+
+        template<class Tfunc_ep_ep, class Tpsys>
+        void calcForceAllAndWriteBackVerlet(Tfunc_ep_ep pfunc_ep_ep, 
+                                            Tpsys & psys,
+                                            DomainInfo & dinfo,
+                                            const bool clear_force = true){
+            defer_copy_force_org_ = true;
+            calcForceAllVerlet(pfunc_ep_ep, psys, dinfo, clear_force);
+            defer_copy_force_org_ = false;
+            copyForceOriginalOrder(psys);
+        }
+
+        /////////////////////////////////////////
+        // FOR BLOCK (INDIVIDUAL) TIMESTEPS
+        // The trees are made of all the particles, the force is calculated
+        // and written back only for psys[adr_active[0..n_active-1]].
+        template<class Tfunc_ep_ep, class Tpsys>
+        void calcForceAllAndWriteBackActive(Tfunc_ep_ep pfunc_ep_ep, 
+                                            Tpsys & psys,
+                                            DomainInfo & dinfo,
+                                            const S32 adr_active[],
+                                            const S32 n_active,
+                                            const bool clear_force = true){
+            setParticleLocalTree(psys);
+            setRootCell(dinfo);
+            mortonSortLocalTreeOnly();
+            linkCellLocalTreeOnly();
+            calcMomentLocalTreeOnly();
+            exchangeLocalEssentialTree(dinfo);
+            setLocalEssentialTreeToGlobalTree();
+            mortonSortGlobalTreeOnly();
+            linkCellGlobalTreeOnly();
+            calcMomentGlobalTreeOnly();
+            calcForceActiveAndWriteBack(pfunc_ep_ep, psys, adr_active, n_active, clear_force);
+        }
+
+        template<class Tfunc_ep_ep, class Tfunc_ep_sp, class Tpsys>
+        void calcForceAllAndWriteBackActive(Tfunc_ep_ep pfunc_ep_ep, 
+                                            Tfunc_ep_sp pfunc_ep_sp,  
+                                            Tpsys & psys,
+                                            DomainInfo & dinfo,
+                                            const S32 adr_active[],
+                                            const S32 n_active,
+                                            const bool clear_force = true){
+            setParticleLocalTree(psys);
+            setRootCell(dinfo);
+            mortonSortLocalTreeOnly();
+            linkCellLocalTreeOnly();
+            calcMomentLocalTreeOnly();
+            exchangeLocalEssentialTree(dinfo);
+            setLocalEssentialTreeToGlobalTree();
+            mortonSortGlobalTreeOnly();
+            linkCellGlobalTreeOnly();
+            calcMomentGlobalTreeOnly();
+            calcForceActiveAndWriteBack(pfunc_ep_ep, pfunc_ep_sp, psys, adr_active, n_active, clear_force);
+        }
+
         template<class Tfunc_ep_ep, class Tpsys>
         void calcForceAllAndWriteBackWithTimer(Tfunc_ep_ep pfunc_ep_ep, 
                                                Tpsys & psys,
@@ -533,9 +875,11 @@ namespace ParticleSimulator{
             tm.restart("calcMomentGlobalTreeOnly");
             makeIPGroup();
             tm.restart("makeIPGroup");
+            defer_copy_force_org_ = true;
             calcForce(pfunc_ep_ep, clear_force);
+            defer_copy_force_org_ = false;
             tm.restart("calcForce");
-            for(S32 i=0; i<n_loc_tot_; i++) psys[i].copyFromForce(force_org_[i]);
+            copyForceOriginalOrder(psys);
             tm.restart("write back");
         }
 
@@ -572,9 +916,11 @@ namespace ParticleSimulator{
             tm.restart("calcMomentGlobalTreeOnly");
             makeIPGroup();
             tm.restart("makeIPGroup");
+            defer_copy_force_org_ = true;
             calcForce(pfunc_ep_ep, clear_force);
+            defer_copy_force_org_ = false;
             tm.restart("calcForce");
-            for(S32 i=0; i<n_loc_tot_; i++) psys[i].copyFromForce(force_org_[i]);
+            copyForceOriginalOrder(psys);
             tm.restart("write back");
         }
 
@@ -620,8 +966,10 @@ namespace ParticleSimulator{
                                       Tpsys & psys,
                                       DomainInfo & dinfo,
                                       const bool clear_force=true){
+	    defer_copy_force_org_ = true;
 	    calcForceAll(pfunc_ep_ep, pfunc_ep_sp, psys, dinfo, clear_force);
-	    for(S32 i=0; i<n_loc_tot_; i++) psys[i].copyFromForce(force_org_[i]);
+	    defer_copy_force_org_ = false;
+	    copyForceOriginalOrder(psys);
         }
 
         template<class Tfunc_ep_ep, class Tfunc_ep_sp, class Tpsys>
@@ -630,8 +978,10 @@ namespace ParticleSimulator{
 					       Tpsys & psys,
 					       DomainInfo & dinfo,
 					       const bool clear_force=true){
+	    defer_copy_force_org_ = true;
 	    calcForceAll(pfunc_ep_ep, pfunc_ep_sp, psys, dinfo, clear_force);
-	    for(S32 i=0; i<n_loc_tot_; i++) psys[i].copyFromForce(force_org_[i]);
+	    defer_copy_force_org_ = false;
+	    copyForceOriginalOrder(psys);
         }
 	
         template<class Tfunc_ep_ep, class Tfunc_ep_sp, class Tpsys>
@@ -663,9 +1013,11 @@ namespace ParticleSimulator{
 	    tm.restart("calcMomentGlobalTreeOnly");
             makeIPGroup();
             tm.restart("makeIPGroup");
+            defer_copy_force_org_ = true;
             calcForce(pfunc_ep_ep, pfunc_ep_sp, clear_force);
+            defer_copy_force_org_ = false;
             tm.restart("calcForce");
-            for(S32 i=0; i<n_loc_tot_; i++) psys[i].copyFromForce(force_org_[i]);
+            copyForceOriginalOrder(psys);
 
             tm.restart("write back");
         }
@@ -735,6 +1087,13 @@ namespace ParticleSimulator{
          MomentMonopole,
          SPJMonopole> Monopole;
 	
+        typedef TreeForForce
+        <SEARCH_MODE_LONG,
+         Tforce, Tepi, Tepj,
+         MomentMonopoleHermite,
+         MomentMonopoleHermite,
+         SPJMonopoleHermite> MonopoleHermite;
+
 	typedef TreeForForce
         <SEARCH_MODE_LONG_CUTOFF,
          Tforce, Tepi, Tepj,
@@ -431,8 +431,8 @@ namespace ParticleSimulator{
                 if(rank_target == my_rank && ii == 0) continue;
                 const F64vec shift = shift_image_domain[ii];
                 for(S32 ip=0; ip<this->n_loc_tot_; ip++){
-                    const F64vec pos_i = this->epi_org_[ip].getPos();
-                    const F64 len_sq_i = this->epi_org_[ip].getRSearch() * this->epi_org_[ip].getRSearch();
+                    const F64vec pos_i = this->getEpiOrgPointer()[ip].getPos();
+                    const F64 len_sq_i = this->getEpiOrgPointer()[ip].getRSearch() * this->getEpiOrgPointer()[ip].getRSearch();
                     const F64 dis_sq_pp = pos_i.getDistanceSQ(pos_j+shift);
                     if(dis_sq_pp <= len_sq_i){
                         pos_direct.push_back(pos_j+shift);
@@ -470,8 +470,8 @@ namespace ParticleSimulator{
                 const F64vec shift = shift_image_domain[ii];
                 const F64 dis_sq = dinfo.getPosDomain(my_rank).getDistanceMinSQ(pos_j+shift);
                 for(S32 ip=0; ip<this->n_loc_tot_; ip++){
-                    const F64vec pos_i = this->epi_org_[ip].getPos();
-                    const F64 len_sq_i = this->epi_org_[ip].getRSearch() * this->epi_org_[ip].getRSearch();
+                    const F64vec pos_i = this->getEpiOrgPointer()[ip].getPos();
+                    const F64 len_sq_i = this->getEpiOrgPointer()[ip].getRSearch() * this->getEpiOrgPointer()[ip].getRSearch();
                     const F64 dis_sq_pp = pos_i.getDistanceSQ(pos_j+shift);
                     if(dis_sq <= len_sq_j || dis_sq_pp <= len_sq_i){
                         pos_direct.push_back(pos_j+shift);
@@ -16,14 +16,17 @@ namespace ParticleSimulator{
                 const DomainInfo & dinfo){
         static bool first = true;
         static ReallocatableArray<Tep2> * ep_send_buf;
+        static ReallocatableArray<S32> * adr_ep_send_buf;
         static ReallocatableArray<F64vec> * shift_image_domain;
         if(first){
             const S32 n_thread = Comm::getNumberOfThread();
             ep_send_buf = new ReallocatableArray<Tep2>[n_thread];
+            adr_ep_send_buf = new ReallocatableArray<S32>[n_thread];
             shift_image_domain = new ReallocatableArray<F64vec>[n_thread];
             for(S32 i=0; i<n_thread; i++){
 	        //ep_send_buf[i].reserve(1000);
                 ep_send_buf[i].reserve(n_surface_for_comm_);
+                adr_ep_send_buf[i].reserve(n_surface_for_comm_);
                 shift_image_domain[i].reserve(5*5*5);
             }
             first = false;
@@ -46,6 +49,7 @@ namespace ParticleSimulator{
             bool pa[DIMENSION];
             dinfo.getPeriodicAxis(pa);
             ep_send_buf[ith].clearSize();
+            adr_ep_send_buf[ith].clearSize();
 //#pragma omp for schedule(dynamic, 4)
 #pragma omp for schedule(dynamic, 1)
             for(S32 ib=0; ib<n_proc; ib++){
@@ -78,6 +82,7 @@ namespace ParticleSimulator{
                         MakeListUsingOuterBoundary
                             (tc_loc_.getPointer(),  adr_tc_tmp,
                              ep_org.getPointer(),   ep_send_buf[ith],
+                             adr_ep_send_buf[ith],
                              pos_domain,            n_leaf_limit_,
                              -shift_image_domain[ith][ii]);
                     }
@@ -94,6 +99,7 @@ namespace ParticleSimulator{
                             ep_send_buf[ith].back() = ep_org[adr_tmp];
                             const F64vec pos_new = ep_send_buf[ith].back().getPos() - shift_image_domain[ith][ii];
                             ep_send_buf[ith].back().setPos(pos_new);
+                            adr_ep_send_buf[ith].push_back(adr_tmp);
                         }
                     }
                 }
@@ -108,6 +114,7 @@ namespace ParticleSimulator{
                     n_send_disp[i+1] = n_send_disp[i] + n_send[i];
                 }
                 ep_send.resizeNoInitialize(n_send_disp[n_proc]);
+                adr_ep_send_.resizeNoInitialize(n_send_disp[n_proc]);
             }
             S32 n_ep_cnt = 0;
             for(S32 ib=0; ib<n_proc_cum; ib++){
@@ -115,6 +122,7 @@ namespace ParticleSimulator{
                 const S32 adr_ep_tmp = n_send_disp[id];
                 const S32 n_ep_tmp = n_send[id];
                 for(int ip=0; ip<n_ep_tmp; ip++){
+                    adr_ep_send_[adr_ep_tmp+ip] = adr_ep_send_buf[ith][n_ep_cnt];
                     ep_send[adr_ep_tmp+ip] = ep_send_buf[ith][n_ep_cnt++];
                 }
             }
@@ -191,8 +199,8 @@ namespace ParticleSimulator{
         n_surface_for_comm_ = (6*np_one_dim*np_one_dim+8*np_one_dim)*6;
 #endif
         //std::cerr<<"n_surface_for_comm_="<<n_surface_for_comm_<<std::endl;
-        epi_org_.reserve( np_ave*4 + 100 );
-        epi_sorted_.reserve( epi_org_.capacity() );
+        epi_sorted_.reserve( np_ave*4 + 100 );
+        if(!EpiIsEpj<Tepi, Tepj>::value) epi_org_.reserve( epi_sorted_.capacity() );
 
         bool err = false;
         if(n_leaf_limit_ <= 0){
@@ -226,7 +234,7 @@ namespace ParticleSimulator{
         if( typeid(TSM) == typeid(SEARCH_MODE_LONG) || 
             typeid(TSM) == typeid(SEARCH_MODE_LONG_CUTOFF) ){
             if(theta_ > 0.0){
-                const S32 n_tmp = epi_org_.capacity() + 2000 * pow((0.5 / theta_), DIMENSION);
+                const S32 n_tmp = epi_sorted_.capacity() + 2000 * pow((0.5 / theta_), DIMENSION);
                 const S32 n_new = std::min( std::min(n_tmp, n_glb_tot_+100), 20000);
                 epj_org_.reserve( n_new );
                 epj_sorted_.reserve( n_new );
@@ -262,7 +270,7 @@ namespace ParticleSimulator{
         }
         else{
             // FOR SHORT MODE
-            epj_org_.reserve( epi_org_.capacity() + n_surface_for_comm_ );
+            epj_org_.reserve( epi_sorted_.capacity() + n_surface_for_comm_ );
             epj_sorted_.reserve( epj_org_.capacity() );
             S32 n_thread = Comm::getNumberOfThread();
             id_ep_send_buf_ = new ReallocatableArray<S32>[n_thread];
@@ -276,9 +284,16 @@ namespace ParticleSimulator{
                 epj_for_force_[i].reserve(n_surface_for_comm_ * 2 / n_thread);
                 spj_for_force_[i].reserve(1);
             }
+            adr_epj_for_force_ = new ReallocatableArray<S32>[n_thread];
+            force_epj_for_force_ = new ReallocatableArray<Tforce>[n_thread];
+            reaction_for_force_ = new ReallocatableArray<ReactionEpj>[n_thread*n_thread];
+            epxr_adr_for_force_ = new ReallocatableArray<EPXRAdr>[n_thread];
+            adr_epj_verlet_ = new ReallocatableArray<S32>[n_thread];
+            adr_cell_list_for_force_ = new ReallocatableArray<S32>[n_thread];
         }
+        epi_for_force_ = new ReallocatableArray<Tepi>[Comm::getNumberOfThread()];
 
-        tp_loc_.reserve( epi_org_.capacity() );
+        tp_loc_.reserve( epi_sorted_.capacity() );
         tp_glb_.reserve( epj_org_.capacity() );
         tp_buf_.reserve( epj_org_.capacity() );
         //std::cout<<"tp_loc_.capacity()="<<tp_loc_.capacity()<<std::endl;
@@ -287,7 +302,7 @@ namespace ParticleSimulator{
         //std::cout<<"tc_loc_.capacity()="<<tc_loc_.capacity()<<std::endl;
         tc_glb_.reserve( tp_glb_.capacity() / n_leaf_limit_ * N_CHILDREN );
         //std::cout<<"tc_glb_.capacity()="<<tc_glb_.capacity()<<std::endl;
-        ipg_.reserve( std::min(epi_org_.capacity()/n_group_limit_*4, epi_org_.capacity()) );
+        ipg_.reserve( std::min(epi_sorted_.capacity()/n_group_limit_*4, epi_sorted_.capacity()) );
         id_proc_send_ = new S32*[n_thread];
         for(S32 i=0; i<n_thread; i++) id_proc_send_[i] = new S32[n_proc];
 
@@ -298,10 +313,23 @@ namespace ParticleSimulator{
         n_ep_recv_ = new S32[n_proc];
         n_ep_send_disp_ = new S32[n_proc+1];
         n_ep_recv_disp_ = new S32[n_proc+1];
-
-        force_org_.reserve(epi_org_.capacity());
-        force_sorted_.reserve(epi_org_.capacity());
-
+        n_ep_let_send_disp_ = new S32[n_proc+1];
+
+        force_org_.reserve(epi_sorted_.capacity());
+        force_sorted_.reserve(epi_sorted_.capacity());
+
+        n_epj_for_force_org_.reserve(epi_sorted_.capacity());
+        cell_for_force_org_.reserve(epi_sorted_.capacity());
+        ipg_chunk_queue_head_.resizeNoInitialize(n_thread);
+        ipg_chunk_queue_tail_.resizeNoInitialize(n_thread);
+        ipg_chunk_queue_cost_.resizeNoInitialize(n_thread);
+        wtime_busy_calc_force_.resizeNoInitialize(n_thread);
+        wtime_idle_calc_force_.resizeNoInitialize(n_thread);
+        for(S32 i=0; i<n_thread; i++){
+            ipg_chunk_queue_cost_[i] = 0.0;
+            ipg_chunk_queue_head_[i] = ipg_chunk_queue_tail_[i] = 0;
+            wtime_busy_calc_force_[i] = wtime_idle_calc_force_[i] = 0.0;
+        }
     }
 
     template<class TSM, class Tforce, class Tepi, class Tepj,
@@ -312,21 +340,23 @@ namespace ParticleSimulator{
                          const bool clear){
         const S32 nloc = psys.getNumberOfParticleLocal();
         if(clear){ n_loc_tot_ = 0;}
+        dt_predict_ = 0.0;
         const S32 offset = 0;
         n_loc_tot_ += nloc;
-        epi_org_.resizeNoInitialize(n_loc_tot_);
+        const bool epi_is_epj = EpiIsEpj<Tepi, Tepj>::value;
+        if(!epi_is_epj) epi_org_.resizeNoInitialize(n_loc_tot_);
         epj_org_.resizeNoInitialize(n_loc_tot_);
         if(clear){
 #pragma omp parallel for
             for(S32 i=0; i<nloc; i++){
-                epi_org_[i].copyFromFP( psys[i] );
+                if(!epi_is_epj) epi_org_[i].copyFromFP( psys[i] );
                 epj_org_[i].copyFromFP( psys[i] );
             }
         }
         else{
 #pragma omp parallel for
             for(S32 i=0; i<nloc; i++){
-                epi_org_[i+offset].copyFromFP( psys[i] );
+                if(!epi_is_epj) epi_org_[i+offset].copyFromFP( psys[i] );
                 epj_org_[i+offset].copyFromFP( psys[i] );
             }
         }
@@ -375,6 +405,31 @@ namespace ParticleSimulator{
         pos_root_cell_.high_ = center_ + F64vec(length_*0.5);
     }
 
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setEpSortedLocal(TagEpiIsNotEpj){
+#pragma omp parallel for
+        for(S32 i=0; i<n_loc_tot_; i++){
+            const S32 adr = tp_loc_[i].adr_ptcl_;
+            epi_sorted_[i] = epi_org_[adr];
+            epj_sorted_[i] = epj_org_[adr];
+        }
+    }
+
+    // one gather from epj_org_, EPI is copied from the freshly written EPJ
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setEpSortedLocal(TagEpiIsEpj){
+#pragma omp parallel for
+        for(S32 i=0; i<n_loc_tot_; i++){
+            const S32 adr = tp_loc_[i].adr_ptcl_;
+            epj_sorted_[i] = epj_org_[adr];
+            epi_sorted_[i] = epj_sorted_[i];
+        }
+    }
+
     template<class TSM, class Tforce, class Tepi, class Tepj,
              class Tmomloc, class Tmomglb, class Tspj>
     void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
@@ -389,12 +444,7 @@ namespace ParticleSimulator{
             tp_loc_[i].setFromEP(epj_org_[i], i);
         }
         rs_.lsdSort(tp_loc_.getPointer(), tp_buf_.getPointer(), 0, n_loc_tot_-1);
-#pragma omp parallel for
-        for(S32 i=0; i<n_loc_tot_; i++){
-            const S32 adr = tp_loc_[i].adr_ptcl_;
-            epi_sorted_[i] = epi_org_[adr];
-            epj_sorted_[i] = epj_org_[adr];
-        }
+        setEpSortedLocal(typename EpiIsEpj<Tepi, Tepj>::type());
 #ifdef PARTICLE_SIMULATOR_DEBUG_PRINT
             PARTICLE_SIMULATOR_PRINT_LINE_INFO();
             std::cout<<"tp_loc_.size()="<<tp_loc_.size()<<" tp_buf_.size()="<<tp_buf_.size()<<std::endl;
@@ -722,6 +772,10 @@ namespace ParticleSimulator{
                   n_ep_recv_,  n_ep_recv_disp_, 
                   epj_send_,   epj_recv_,
                   epj_sorted_, dinfo);	
+        const S32 n_proc = Comm::getNumberOfProc();
+        for(S32 i=0; i<=n_proc; i++) n_ep_let_send_disp_[i] = n_ep_send_disp_[i];
+        adr_ep_let_send_.resizeNoInitialize(n_ep_send_disp_[n_proc]);
+        for(S32 i=0; i<n_ep_send_disp_[n_proc]; i++) adr_ep_let_send_[i] = adr_ep_send_[i];
 #ifdef PARTICLE_SIMULATOR_DEBUG_PRINT
         PARTICLE_SIMULATOR_PRINT_LINE_INFO();
         std::cout<<"epj_send_.size()="<<epj_send_.size()<<" spj_send_.size()="<<spj_send_.size()<<std::endl;
@@ -758,6 +812,7 @@ namespace ParticleSimulator{
         static ReallocatableArray<EPXROnly> ep_x_r_send;
         static ReallocatableArray<EPXROnly> ep_x_r_recv;
         static ReallocatableArray<Tepj> * epj_send_buf; // for 1st communication
+        static ReallocatableArray<S32> * adr_epj_send_buf;
         static ReallocatableArray<Tepj> epj_recv_buf; // for 2nd communication
         static S32 * n_ep_recv_1st;
         static S32 * n_ep_recv_disp_1st;
@@ -786,11 +841,13 @@ namespace ParticleSimulator{
             id_proc_dest = new S32[n_proc];
             id_ptcl_send = new ReallocatableArray<S32>[n_thread];
             epj_send_buf = new ReallocatableArray<Tepj>[n_thread];
+            adr_epj_send_buf = new ReallocatableArray<S32>[n_thread];
             for(S32 i=0; i<n_thread; i++){
 	        //id_ptcl_send[i].reserve(1000);
 	        //epj_send_buf[i].reserve(1000);
 	        id_ptcl_send[i].reserve(n_surface_for_comm_ * 2 / n_thread);
 	        epj_send_buf[i].reserve(n_surface_for_comm_ * 2 / n_thread);
+	        adr_epj_send_buf[i].reserve(n_surface_for_comm_ * 2 / n_thread);
             }
             //epj_recv_buf.reserve(1000);
 	    epj_recv_buf.reserve(n_surface_for_comm_);
@@ -858,6 +915,7 @@ namespace ParticleSimulator{
             bool pa[DIMENSION];
             dinfo.getPeriodicAxis(pa);
             epj_send_buf[ith].clearSize();
+            adr_epj_send_buf[ith].clearSize();
             S32 n_ep_send_cum_old = 0;
 //#pragma omp for schedule(dynamic, 4)
 #pragma omp for schedule(dynamic, 1)
@@ -992,6 +1050,7 @@ namespace ParticleSimulator{
                             if(pos_j.getDistanceSQ(pos_i) <= len_sq_i){
                                 epj_send_buf[ith].push_back( epj_sorted_[id_j] );
                                 epj_send_buf[ith].back().setPos(pos_j-shift);
+                                adr_epj_send_buf[ith].push_back(id_j);
                                 break;
                             }
                         }
@@ -1010,6 +1069,7 @@ namespace ParticleSimulator{
                     n_ep_send_disp_[i+1] = n_ep_send_disp_[i] + n_ep_send_[i];
                 }
                 epj_send_.resizeNoInitialize( n_ep_send_disp_[n_proc] );
+                adr_ep_let_send_.resizeNoInitialize( n_ep_send_disp_[n_proc] );
             }
             S32 n_ep_cnt = 0;
             for(S32 ib=0; ib<n_proc_src_2nd; ib++){
@@ -1017,10 +1077,12 @@ namespace ParticleSimulator{
                 S32 adr_ep_tmp = n_ep_send_disp_[id];
                 const S32 n_ep_tmp = n_ep_send_[id];
                 for(int ip=0; ip<n_ep_tmp; ip++){
+                    adr_ep_let_send_[adr_ep_tmp] = adr_epj_send_buf[ith][n_ep_cnt];
                     epj_send_[adr_ep_tmp++] = epj_send_buf[ith][n_ep_cnt++];
                 }
             }
         }// omp parallel scope
+        for(S32 i=0; i<=n_proc; i++) n_ep_let_send_disp_[i] = n_ep_send_disp_[i];
 
         TexLET1_ = GetWtime() - TexLET1_;
         wtime_walk_LET_2nd_ = TexLET1_;
@@ -1150,6 +1212,10 @@ namespace ParticleSimulator{
         static ReallocatableArray<Tepj> epj_recv_1st_buf;
         static ReallocatableArray<Tepj> epj_recv_2nd_buf;
         static ReallocatableArray<Tepj> * epj_send_buf; // for 1st communication
+        static ReallocatableArray<S32> * adr_ep_send_buf;
+        static ReallocatableArray<S32> adr_ep_send_1st;
+        static S32 * n_ep_send_1st;
+        static S32 * n_ep_send_disp_1st;
         static S32 * n_ep_recv_1st;
         static S32 * n_ep_recv_disp_1st;
         static S32 * n_ep_recv_2nd;
@@ -1169,6 +1235,8 @@ namespace ParticleSimulator{
             //epj_recv_2nd_buf.reserve(1000);
             epj_recv_1st_buf.reserve(n_surface_for_comm_);
             epj_recv_2nd_buf.reserve(n_surface_for_comm_);
+            n_ep_send_1st = new S32[n_proc];
+            n_ep_send_disp_1st = new S32[n_proc+1];
             n_ep_recv_1st = new S32[n_proc];
             n_ep_recv_disp_1st = new S32[n_proc+1];
             n_ep_recv_2nd = new S32[n_proc];
@@ -1176,12 +1244,14 @@ namespace ParticleSimulator{
             id_proc_src = new S32[n_proc];
             id_proc_dest = new S32[n_proc];
             epj_send_buf = new ReallocatableArray<Tepj>[n_thread];
+            adr_ep_send_buf = new ReallocatableArray<S32>[n_thread];
             id_ptcl_send = new ReallocatableArray<S32>[n_thread];
             for(S32 i=0; i<n_thread; i++){
                 //id_ptcl_send[i].reserve(1000);
                 //epj_send_buf[i].reserve(1000);
                 id_ptcl_send[i].reserve(n_surface_for_comm_);
                 epj_send_buf[i].reserve(n_surface_for_comm_);
+                adr_ep_send_buf[i].reserve(n_surface_for_comm_);
             }
 #ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
             req_send = new MPI::Request[n_proc];
@@ -1209,6 +1279,15 @@ namespace ParticleSimulator{
         n_ep_send_1st_ = epj_send_.size();
         n_ep_recv_1st_ = epj_recv_1st_buf.size();
 
+        // keep the addresses of the particles sent at the 1st step (for the reverse exchange)
+        for(S32 i=0; i<n_proc; i++){
+            n_ep_send_1st[i] = n_ep_send_[i];
+            n_ep_send_disp_1st[i] = n_ep_send_disp_[i];
+        }
+        n_ep_send_disp_1st[n_proc] = n_ep_send_disp_[n_proc];
+        adr_ep_send_1st.resizeNoInitialize(adr_ep_send_.size());
+        for(S32 i=0; i<adr_ep_send_.size(); i++) adr_ep_send_1st[i] = adr_ep_send_[i];
+
 #ifdef PARTICLE_SIMULATOR_DEBUG_PRINT
         PARTICLE_SIMULATOR_PRINT_LINE_INFO();
         std::cout<<"epj_recv_1st_buf.size()="<<epj_recv_1st_buf.size()<<" epj_send_size()="<<epj_send_.size()<<std::endl;
@@ -1241,6 +1320,7 @@ namespace ParticleSimulator{
             bool pa[DIMENSION];
             dinfo.getPeriodicAxis(pa);
             epj_send_buf[ith].clearSize();
+            adr_ep_send_buf[ith].clearSize();
             S32 n_ep_send_cum_old = 0;
 //#pragma omp for schedule(dynamic, 4)
 #pragma omp for schedule(dynamic, 1)
@@ -1396,6 +1476,7 @@ namespace ParticleSimulator{
                             if(pos_j.getDistanceSQ(pos_i) <= len_sq_i){
                                 epj_send_buf[ith].push_back(epj_sorted_[id_j]);
                                 epj_send_buf[ith].back().setPos(pos_j-shift);
+                                adr_ep_send_buf[ith].push_back(id_j);
                                 break;
                             }
                         }
@@ -1414,6 +1495,7 @@ namespace ParticleSimulator{
                     n_ep_send_disp_[i+1] = n_ep_send_disp_[i] + n_ep_send_[i];
                 }
                 epj_send_.resizeNoInitialize( n_ep_send_disp_[n_proc] );
+                adr_ep_send_.resizeNoInitialize( n_ep_send_disp_[n_proc] );
             }
             S32 n_ep_cnt = 0;
             for(S32 ib=0; ib<n_proc_src_2nd; ib++){
@@ -1421,6 +1503,7 @@ namespace ParticleSimulator{
                 S32 adr_ep_tmp = n_ep_send_disp_[id];
                 const S32 n_ep_tmp = n_ep_send_[id];
                 for(int ip=0; ip<n_ep_tmp; ip++){
+                    adr_ep_send_[adr_ep_tmp] = adr_ep_send_buf[ith][n_ep_cnt];
                     epj_send_[adr_ep_tmp++] = epj_send_buf[ith][n_ep_cnt++];
                 }
             }
@@ -1549,6 +1632,25 @@ namespace ParticleSimulator{
             }
         }
 
+        // addresses of the sent particles in the order the receivers store them in epj_recv_
+        // (used to send the reactions on LET particles back in calcForceNewton3rd
+        // and to update the LET particles in calcForceAllVerlet)
+        n_ep_let_send_disp_[0] = 0;
+        for(S32 i=0; i<n_proc; i++){
+            n_ep_let_send_disp_[i+1] = n_ep_let_send_disp_[i] + n_ep_send_1st[i] + n_ep_send_[i];
+        }
+        adr_ep_let_send_.resizeNoInitialize(n_ep_let_send_disp_[n_proc]);
+#pragma omp parallel for
+        for(S32 i=0; i<n_proc; i++){
+            S32 n_cnt = n_ep_let_send_disp_[i];
+            for(S32 j=n_ep_send_disp_1st[i]; j<n_ep_send_disp_1st[i]+n_ep_send_1st[i]; j++){
+                adr_ep_let_send_[n_cnt++] = adr_ep_send_1st[j];
+            }
+            for(S32 j=n_ep_send_disp_[i]; j<n_ep_send_disp_[i]+n_ep_send_[i]; j++){
+                adr_ep_let_send_[n_cnt++] = adr_ep_send_[j];
+            }
+        }
+
         TexLET4_ = GetWtime() - TexLET4_;
 
 #ifdef PARTICLE_SIMULATOR_DEBUG_PRINT
@@ -1641,6 +1743,10 @@ namespace ParticleSimulator{
 	     class Tmomloc, class Tmomglb, class Tspj>
     void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
     mortonSortGlobalTreeOnly(){
+        if(cell_list_mode_){
+            makeCellListGlobal();
+            return;
+        }
         tp_glb_.resizeNoInitialize(n_glb_tot_);
         tp_buf_.resizeNoInitialize(n_glb_tot_);
         rs_.lsdSort(tp_glb_.getPointer(), tp_buf_.getPointer(), 0, n_glb_tot_-1);
@@ -1680,6 +1786,7 @@ namespace ParticleSimulator{
              class Tmomloc, class Tmomglb, class Tspj>
     void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
     linkCellGlobalTreeOnly(){
+        if(cell_list_mode_) return;
         LinkCell(tc_glb_, adr_tc_level_partition_,
                  tp_glb_.getPointer(), lev_max_, n_glb_tot_, n_leaf_limit_);
 #ifdef PARTICLE_SIMULATOR_DEBUG_PRINT
@@ -1696,6 +1803,7 @@ namespace ParticleSimulator{
              class Tmomloc, class Tmomglb, class Tspj>
     void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
     calcMomentGlobalTreeOnly(){
+        if(cell_list_mode_) return;
         calcMomentGlobalTreeOnlyImpl(typename TSM::search_type());
 #ifdef PARTICLE_SIMULATOR_DEBUG_PRINT
         PARTICLE_SIMULATOR_PRINT_LINE_INFO();
@@ -1756,6 +1864,7 @@ namespace ParticleSimulator{
     makeIPGroup(){
         ipg_.clearSize();
         makeIPGroupImpl(typename TSM::force_type());
+        if(n_ipg_batch_ > 1) MergeIPGroup(ipg_, n_group_limit_, n_ipg_batch_);
 #ifdef PARTICLE_SIMULATOR_DEBUG_PRINT
         PARTICLE_SIMULATOR_PRINT_LINE_INFO();
         std::cout<<"ipg_.size()="<<ipg_.size()<<std::endl;
@@ -1774,6 +1883,288 @@ namespace ParticleSimulator{
         MakeIPGroupShort(ipg_, tc_loc_, epi_sorted_, 0, n_group_limit_);
     }
 
+    /////////////////
+    /// CELL LIST ///
+    // Uniform grid over the local and LET particles (LET particles already
+    // carry the shift of the periodic images). The cell size is the max
+    // search radius of EPJ, but not smaller than the mean particle spacing.
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setCellListMode(const bool flag){
+        setCellListModeImpl(typename TSM::force_type(), flag);
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setCellListModeImpl(TagForceShort, const bool flag){
+        cell_list_mode_ = flag;
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setCellListModeImpl(TagForceLong, const bool flag){
+        if(flag){
+            PARTICLE_SIMULATOR_PRINT_ERROR("cell list mode is available only for the short-range force");
+            Abort(-1);
+        }
+        cell_list_mode_ = false;
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    F64 TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    getRSearchMaxImpl(TagRSearch){
+        F64 r_search_max = 0.0;
+#pragma omp parallel
+        {
+            F64 r_search_max_tmp = 0.0;
+#pragma omp for nowait
+            for(S32 i=0; i<n_glb_tot_; i++){
+                if(epj_org_[i].getRSearch() > r_search_max_tmp) r_search_max_tmp = epj_org_[i].getRSearch();
+            }
+#pragma omp critical
+            {
+                if(r_search_max_tmp > r_search_max) r_search_max = r_search_max_tmp;
+            }
+        }
+        return r_search_max;
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    F64 TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    getRSearchMaxImpl(TagNoRSearch){
+        return 0.0;
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    S32 TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    getCellIndex(const F64vec & pos) const {
+        S32 adr = 0;
+        for(S32 k=DIMENSION-1; k>=0; k--){
+            S32 id = (S32)((pos[k] - pos_low_cell_list_[k]) / size_cell_list_);
+            if(id < 0) id = 0;
+            if(id >= n_cell_list_[k]) id = n_cell_list_[k] - 1;
+            adr = adr * n_cell_list_[k] + id;
+        }
+        return adr;
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeCellListGlobal(){
+        static ReallocatableArray<S32> n_cnt;
+        static ReallocatableArray<S32> n_cnt_thread;
+        tp_glb_.resizeNoInitialize(n_glb_tot_);
+        epj_sorted_.resizeNoInitialize(n_glb_tot_);
+        F64ort box;
+        box.initNegativeVolume();
+#pragma omp parallel
+        {
+            F64ort box_tmp;
+            box_tmp.init();
+#pragma omp for nowait
+            for(S32 i=0; i<n_glb_tot_; i++) box_tmp.merge(epj_org_[i].getPos());
+#pragma omp critical
+            {
+                box.merge(box_tmp);
+            }
+        }
+        r_search_max_cell_list_ = getRSearchMaxImpl(typename HasRSearch<Tepj>::type());
+        F64 volume = 1.0;
+        for(S32 k=0; k<DIMENSION; k++) volume *= (box.high_[k] - box.low_[k]);
+        size_cell_list_ = std::max(r_search_max_cell_list_, std::pow(volume / std::max(n_glb_tot_, 1), 1.0/DIMENSION));
+        if( !(size_cell_list_ > 0.0) ) size_cell_list_ = 1.0;
+        // keep # of cells O(n) also for flat distributions
+        while(true){
+            F64 n_cell_tmp = 1.0;
+            for(S32 k=0; k<DIMENSION; k++) n_cell_tmp *= (box.high_[k] - box.low_[k]) / size_cell_list_ + 1.0;
+            if(n_cell_tmp <= 2.0*n_glb_tot_ + 8.0) break;
+            size_cell_list_ *= 2.0;
+        }
+        S32 n_cell = 1;
+        for(S32 k=0; k<DIMENSION; k++){
+            n_cell_list_[k] = std::max( (S32)((box.high_[k] - box.low_[k]) / size_cell_list_) + 1, 1 );
+            n_cell *= n_cell_list_[k];
+        }
+        pos_low_cell_list_ = box.low_;
+
+        // counting sort of the particles by cell
+        const S32 n_thread = Comm::getNumberOfThread();
+        adr_cell_list_head_.resizeNoInitialize(n_cell+1);
+        n_cnt.resizeNoInitialize(n_cell);
+        n_cnt_thread.resizeNoInitialize(n_thread);
+        tp_buf_.resizeNoInitialize(n_glb_tot_);
+#pragma omp parallel
+        {
+#pragma omp for
+            for(S32 i=0; i<=n_cell; i++) adr_cell_list_head_[i] = 0;
+#pragma omp for
+            for(S32 i=0; i<n_glb_tot_; i++){
+                const S32 adr_cell = getCellIndex(epj_org_[i].getPos());
+                tp_buf_[i].key_ = adr_cell;
+#pragma omp atomic
+                adr_cell_list_head_[adr_cell+1]++;
+            }
+            // prefix sum, a block of cells per thread
+            const S32 ith = Comm::getThreadNum();
+            const S32 head = (S32)(((S64)n_cell*ith)/n_thread);
+            const S32 end = (S32)(((S64)n_cell*(ith+1))/n_thread);
+            S32 n_cnt_tmp = 0;
+            for(S32 i=head; i<end; i++){
+                n_cnt_tmp += adr_cell_list_head_[i+1];
+                adr_cell_list_head_[i+1] = n_cnt_tmp;
+            }
+            n_cnt_thread[ith] = n_cnt_tmp;
+#pragma omp barrier
+            S32 offset = 0;
+            for(S32 i=0; i<ith; i++) offset += n_cnt_thread[i];
+            for(S32 i=head; i<end; i++){
+                n_cnt[i] = (i == head) ? offset : adr_cell_list_head_[i];
+                adr_cell_list_head_[i+1] += offset;
+            }
+#pragma omp barrier
+#pragma omp for
+            for(S32 i=0; i<n_glb_tot_; i++){
+                const S32 adr_cell = (S32)tp_buf_[i].key_;
+                S32 adr;
+#pragma omp atomic capture
+                adr = n_cnt[adr_cell]++;
+                tp_glb_[adr].key_ = adr_cell;
+                tp_glb_[adr].adr_ptcl_ = i;
+            }
+            // restore the original order within each cell, so that the
+            // result does not depend on the number of threads
+#pragma omp for schedule(dynamic, 64)
+            for(S32 i=0; i<n_cell; i++){
+                for(S32 j=adr_cell_list_head_[i]+1; j<adr_cell_list_head_[i+1]; j++){
+                    const TreeParticle tp = tp_glb_[j];
+                    S32 k = j - 1;
+                    for(; k>=adr_cell_list_head_[i] && tp_glb_[k].adr_ptcl_ > tp.adr_ptcl_; k--){
+                        tp_glb_[k+1] = tp_glb_[k];
+                    }
+                    tp_glb_[k+1] = tp;
+                }
+            }
+        }
+#pragma omp parallel for
+        for(S32 i=0; i<n_glb_tot_; i++){
+            epj_sorted_[i] = epj_org_[tp_glb_[i].adr_ptcl_];
+        }
+    }
+
+    // append the addresses (in epj_sorted_) of all particles in the cells overlapping pos_box
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeAdrListUsingCellList(const F64ort & pos_box, ReallocatableArray<S32> & adr_list){
+        S32 id_low[DIMENSION];
+        S32 id_high[DIMENSION];
+        for(S32 k=0; k<DIMENSION; k++){
+            id_low[k] = (S32)std::floor((pos_box.low_[k] - pos_low_cell_list_[k]) / size_cell_list_);
+            id_high[k] = (S32)std::floor((pos_box.high_[k] - pos_low_cell_list_[k]) / size_cell_list_);
+            if(id_high[k] < 0 || id_low[k] >= n_cell_list_[k]) return;
+            if(id_low[k] < 0) id_low[k] = 0;
+            if(id_high[k] >= n_cell_list_[k]) id_high[k] = n_cell_list_[k] - 1;
+        }
+#ifdef PARTICLE_SIMULATOR_TWO_DIMENSION
+        for(S32 iy=id_low[1]; iy<=id_high[1]; iy++){
+            const S32 adr_cell = iy*n_cell_list_[0];
+#else
+        for(S32 iz=id_low[2]; iz<=id_high[2]; iz++){
+          for(S32 iy=id_low[1]; iy<=id_high[1]; iy++){
+            const S32 adr_cell = (iz*n_cell_list_[1] + iy)*n_cell_list_[0];
+#endif
+            // cells along x are contiguous in epj_sorted_
+            const S32 adr_head = adr_cell_list_head_[adr_cell+id_low[0]];
+            const S32 adr_tail = adr_cell_list_head_[adr_cell+id_high[0]+1];
+            adr_list.reserveEmptyAreaAtLeast( adr_tail - adr_head );
+            for(S32 ip=adr_head; ip<adr_tail; ip++) adr_list.pushBackNoCheck(ip);
+#ifndef PARTICLE_SIMULATOR_TWO_DIMENSION
+          }
+#endif
+        }
+    }
+
+    // same criteria as MakeListUsingOuterBoundary, MakeListUsingInnerBoundary
+    // and MakeListUsingOuterBoundaryAndInnerBoundary
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeAdrListUsingCellListImpl(TagSearchShortScatter, const S32 adr_ipg, ReallocatableArray<S32> & adr_list){
+        const F64ort pos_target_box = (ipg_[adr_ipg]).vertex_;
+        const F64vec len(r_search_max_cell_list_);
+        const S32 n_head = adr_list.size();
+        makeAdrListUsingCellList(F64ort(pos_target_box.low_-len, pos_target_box.high_+len), adr_list);
+        S32 n_cnt = n_head;
+        for(S32 i=n_head; i<adr_list.size(); i++){
+            const S32 adr = adr_list[i];
+            const F64 size_tmp = epj_sorted_[adr].getRSearch();
+            if(pos_target_box.getDistanceMinSQ(epj_sorted_[adr].getPos()) > size_tmp*size_tmp) continue;
+            adr_list[n_cnt++] = adr;
+        }
+        adr_list.resizeNoInitialize(n_cnt);
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeAdrListUsingCellListImpl(TagSearchShortGather, const S32 adr_ipg, ReallocatableArray<S32> & adr_list){
+        const F64ort pos_target_box = (ipg_[adr_ipg]).vertex_;
+        const S32 n_head = adr_list.size();
+        makeAdrListUsingCellList(pos_target_box, adr_list);
+        S32 n_cnt = n_head;
+        for(S32 i=n_head; i<adr_list.size(); i++){
+            const S32 adr = adr_list[i];
+            if( pos_target_box.notOverlapped(epj_sorted_[adr].getPos()) ) continue;
+            adr_list[n_cnt++] = adr;
+        }
+        adr_list.resizeNoInitialize(n_cnt);
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeAdrListUsingCellListImpl(TagSearchShortSymmetry, const S32 adr_ipg, ReallocatableArray<S32> & adr_list){
+        const F64ort pos_target_box_out = (ipg_[adr_ipg]).vertex_;
+        const F64ort pos_target_box_in = (ipg_[adr_ipg]).vertex_in;
+        const F64vec len(r_search_max_cell_list_);
+        F64ort pos_box(pos_target_box_in.low_-len, pos_target_box_in.high_+len);
+        pos_box.merge(pos_target_box_out);
+        const S32 n_head = adr_list.size();
+        makeAdrListUsingCellList(pos_box, adr_list);
+        S32 n_cnt = n_head;
+        for(S32 i=n_head; i<adr_list.size(); i++){
+            const S32 adr = adr_list[i];
+            const F64vec pos_tmp = epj_sorted_[adr].getPos();
+            const F64 size_tmp = epj_sorted_[adr].getRSearch();
+            const F64 dis_sq_tmp = pos_target_box_in.getDistanceMinSQ(pos_tmp);
+            if( pos_target_box_out.notOverlapped(pos_tmp) && dis_sq_tmp > size_tmp*size_tmp) continue;
+            adr_list[n_cnt++] = adr;
+        }
+        adr_list.resizeNoInitialize(n_cnt);
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    template<class Tsearch>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeInteractionListUsingCellList(Tsearch, const S32 adr_ipg){
+        const S32 ith = Comm::getThreadNum();
+        adr_cell_list_for_force_[ith].clearSize();
+        makeAdrListUsingCellListImpl(Tsearch(), adr_ipg, adr_cell_list_for_force_[ith]);
+        const S32 n_epj = adr_cell_list_for_force_[ith].size();
+        epj_for_force_[ith].resizeNoInitialize(n_epj);
+        for(S32 j=0; j<n_epj; j++){
+            epj_for_force_[ith][j] = epj_sorted_[adr_cell_list_for_force_[ith][j]];
+        }
+    }
+
     /////////////////////////////
     /// MAKE INTERACTION LIST ///
     template<class TSM, class Tforce, class Tepi, class Tepj,
@@ -1781,6 +2172,112 @@ namespace ParticleSimulator{
     void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
     makeInteractionList(const S32 adr_ipg){
         makeInteractionListImpl(typename TSM::search_type(), adr_ipg);
+        if(dt_predict_ != 0.0){
+            const S32 ith = Comm::getThreadNum();
+            PredictInteractionList(typename HasPredict<Tepj>::type(), epj_for_force_[ith], dt_predict_);
+            PredictInteractionList(typename HasPredict<Tspj>::type(), spj_for_force_[ith], dt_predict_);
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setDtPrediction(const F64 dt){
+        setDtPredictionImpl(typename HasPredict<Tepj>::type(), dt);
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setDtPredictionImpl(TagPredict, const F64 dt){
+        if(dt != 0.0) checkDtPredictionSpj(typename TSM::force_type());
+        dt_predict_ = dt;
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setDtPredictionImpl(TagNoPredict, const F64 dt){
+        if(dt != 0.0){
+            PARTICLE_SIMULATOR_PRINT_ERROR("EPJ has no predict(F64)");
+            Abort(-1);
+        }
+        dt_predict_ = 0.0;
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    checkDtPredictionSpj(TagForceShort){}
+
+    // the superparticles would otherwise stay at the positions of the last
+    // tree construction while the particles move
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    checkDtPredictionSpj(TagForceLong){
+        if( !IsPredict(typename HasPredict<Tspj>::type()) ){
+            PARTICLE_SIMULATOR_PRINT_ERROR("SPJ has no predict(F64)");
+            Abort(-1);
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setMixedPrecisionMode(const bool flag){
+        if(flag){
+            if( !IsSetPos(typename HasSetPos<Tepi>::type())
+                || !IsSetPos(typename HasSetPos<Tepj>::type()) ){
+                PARTICLE_SIMULATOR_PRINT_ERROR("EPI and EPJ need setPos() in the mixed precision mode");
+                Abort(-1);
+            }
+            checkMixedPrecisionModeSpj(typename TSM::force_type());
+        }
+        mixed_precision_ = flag;
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    checkMixedPrecisionModeSpj(TagForceShort){}
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    checkMixedPrecisionModeSpj(TagForceLong){
+        if( !IsSetPos(typename HasSetPos<Tspj>::type()) ){
+            PARTICLE_SIMULATOR_PRINT_ERROR("SPJ needs setPos() in the mixed precision mode");
+            Abort(-1);
+        }
+        // F32 absolute positions of the superparticles would lose what the
+        // shift gains
+        if( sizeof(static_cast<const Tmomloc *>(NULL)->getPos()) != sizeof(F64vec)
+            || sizeof(static_cast<const Tmomglb *>(NULL)->getPos()) != sizeof(F64vec)
+            || sizeof(static_cast<const Tspj *>(NULL)->getPos()) != sizeof(F64vec) ){
+            PARTICLE_SIMULATOR_PRINT_ERROR("the moments and SPJ need F64 positions in the mixed precision mode");
+            Abort(-1);
+        }
+    }
+
+    // Returns the i-particles to be passed to the kernel. In the mixed
+    // precision mode, shifts the interaction list of the thread and a copy
+    // of the i-particles by the centre of the i-group.
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    Tepi * TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    shiftInteractionList(const S32 adr_ipg, Tepi * epi, const S32 n_epi){
+        if(!mixed_precision_) return epi;
+        const S32 ith = Comm::getThreadNum();
+        const F64vec center = ipg_[adr_ipg].vertex_.getCenter();
+        epi_for_force_[ith].resizeNoInitialize(n_epi);
+        for(S32 i=0; i<n_epi; i++) epi_for_force_[ith][i] = epi[i];
+        ShiftPos(typename HasSetPos<Tepi>::type(), epi_for_force_[ith].getPointer(), n_epi, center);
+        ShiftPos(typename HasSetPos<Tepj>::type(), epj_for_force_[ith].getPointer(),
+                 epj_for_force_[ith].size(), center);
+        ShiftPos(typename HasSetPos<Tspj>::type(), spj_for_force_[ith].getPointer(),
+                 spj_for_force_[ith].size(), center);
+        return epi_for_force_[ith].getPointer();
     }
 
     template<class TSM, class Tforce, class Tepi, class Tepj,
@@ -1873,6 +2370,10 @@ namespace ParticleSimulator{
 	     class Tmomloc, class Tmomglb, class Tspj>
     void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
     makeInteractionListImpl(TagSearchShortScatter, const S32 adr_ipg){
+        if(cell_list_mode_){
+            makeInteractionListUsingCellList(TagSearchShortScatter(), adr_ipg);
+            return;
+        }
         const S32 ith = Comm::getThreadNum();
         const F64ort pos_target_box = (ipg_[adr_ipg]).vertex_;
         epj_for_force_[ith].clearSize();
@@ -1908,6 +2409,10 @@ namespace ParticleSimulator{
              class Tmomloc, class Tmomglb, class Tspj>
     void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
     makeInteractionListImpl(TagSearchShortGather, const S32 adr_ipg){
+        if(cell_list_mode_){
+            makeInteractionListUsingCellList(TagSearchShortGather(), adr_ipg);
+            return;
+        }
         const S32 ith = Comm::getThreadNum();
         const F64ort pos_target_box = (ipg_[adr_ipg]).vertex_;
         epj_for_force_[ith].clearSize();
@@ -1940,6 +2445,10 @@ namespace ParticleSimulator{
              class Tmomloc, class Tmomglb, class Tspj>
     void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
     makeInteractionListImpl(TagSearchShortSymmetry, const S32 adr_ipg){
+        if(cell_list_mode_){
+            makeInteractionListUsingCellList(TagSearchShortSymmetry(), adr_ipg);
+            return;
+        }
         const S32 ith = Comm::getThreadNum();
 #if 0
         const F64ort pos_target_box = (ipg_[adr_ipg]).vertex_;
@@ -2074,7 +2583,8 @@ namespace ParticleSimulator{
         if(clear){
             for(S32 i=offset; i<n_tail; i++) force_sorted_[i].clear();
         }
-        pfunc_ep_ep(epi_sorted_.getPointer(offset),     n_epi,
+        Tepi * epi = shiftInteractionList(adr_ipg, epi_sorted_.getPointer(offset), n_epi);
+        pfunc_ep_ep(epi,                                n_epi,
                     epj_for_force_[ith].getPointer(),   n_epj,
                     force_sorted_.getPointer(offset));
     }
@@ -2097,69 +2607,276 @@ namespace ParticleSimulator{
         if(clear){
             for(S32 i=offset; i<n_tail; i++) force_sorted_[i].clear();
         }
-	
-        pfunc_ep_ep(epi_sorted_.getPointer(offset),     n_epi,
+        Tepi * epi = shiftInteractionList(adr_ipg, epi_sorted_.getPointer(offset), n_epi);
+        pfunc_ep_ep(epi,                                n_epi,
                     epj_for_force_[ith].getPointer(),   n_epj,
                     force_sorted_.getPointer(offset));
-        pfunc_ep_sp(epi_sorted_.getPointer(offset),     n_epi,
+        pfunc_ep_sp(epi,                                n_epi,
                     spj_for_force_[ith].getPointer(),   n_spj,
                     force_sorted_.getPointer(offset));
     }
 
+    ////////////////////////
+    /// SCHEDULE I-GROUPS ///
+    // The i-groups are cut into chunks of contiguous groups (in Morton order
+    // they share most of their j-cells). The cost of a particle is 1 + the
+    // number of j-particles it had when it was last an i-particle. A particle
+    // which has no count, or was then in another coarse cell (it is not the
+    // same particle after exchangeParticle, additions or removals), is given
+    // the average of the others, or 0 if nobody has a count (first call).
+    // The chunks are dealt to the threads largest first (LPT). A thread pops
+    // its own chunks from the head of its queue without a lock; when it runs
+    // out, it steals the smallest chunk of the queue with the most cost left.
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    U32 TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    getCellForCost(const F64vec & pos) const {
+        const S32 n_cell = 32;
+        U32 cell = 0;
+        if( !(length_ > 0.0) ) return cell;
+        for(S32 d=0; d<DIMENSION; d++){
+            const F64 x = (pos[d] - pos_root_cell_.low_[d]) * ((F64)n_cell / length_);
+            const S32 ic = (x <= 0.0) ? 0 : ( (x >= (F64)n_cell) ? n_cell-1 : (S32)x );
+            cell = cell * n_cell + ic;
+        }
+        return cell;
+    }
+
     template<class TSM, class Tforce, class Tepi, class Tepj,
 	     class Tmomloc, class Tmomglb, class Tspj>
     void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
-    copyForceOriginalOrder(){
-        force_org_.resizeNoInitialize(n_loc_tot_);
-#pragma omp parallel for
-        for(S32 i=0; i<n_loc_tot_; i++){
-            const S32 adr = ClearMSB(tp_loc_[i].adr_ptcl_);
-            force_org_[adr] = force_sorted_[i];
+    setCostIPGroup(const S32 adr_ipg, const S32 n_epj, const Tepi * epi, const S32 * adr_org){
+        const S32 adr_ptcl_tail = ipg_[adr_ipg].adr_ptcl_ + ipg_[adr_ipg].n_ptcl_;
+        for(S32 ip=ipg_[adr_ipg].adr_ptcl_; ip<adr_ptcl_tail; ip++){
+            const S32 adr = getAdrOrgIPGroup(ip, adr_org);
+            n_epj_for_force_org_[adr] = n_epj;
+            cell_for_force_org_[adr] = getCellForCost(epi[ip].getPos());
         }
     }
 
+    // epi[ip]: the ip-th i-particle of ipg_
     template<class TSM, class Tforce, class Tepi, class Tepj,
 	     class Tmomloc, class Tmomglb, class Tspj>
-    template<class Tfunc_ep_ep>
     void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
-    calcForce(Tfunc_ep_ep pfunc_ep_ep,
-              const bool clear){
-        force_sorted_.resizeNoInitialize(n_loc_tot_);
-        force_org_.resizeNoInitialize(n_loc_tot_);
+    makeIPGroupSchedule(const Tepi * epi, const S32 * adr_org){
+        const S32 n_chunk_per_thread = 8;
+        const S32 n_thread = Comm::getNumberOfThread();
         const S32 n_ipg = ipg_.size();
-        S32 ni_tmp = 0;
-        S32 nj_tmp = 0;
-        S64 n_interaction_tmp = 0;
-        if(n_ipg > 0){
-#pragma omp parallel for schedule(dynamic, 4) reduction(+ : ni_tmp, nj_tmp, n_interaction_tmp) 
-            for(S32 i=0; i<n_ipg; i++){
-                makeInteractionList(i);
-                ni_tmp += ipg_[i].n_ptcl_;
-                nj_tmp += epj_for_force_[Comm::getThreadNum()].size();
-                n_interaction_tmp += ipg_[i].n_ptcl_ * epj_for_force_[Comm::getThreadNum()].size();
-                calcForceOnly( pfunc_ep_ep, i, clear);
+        const S32 n_old = n_epj_for_force_org_.size();
+        n_epj_for_force_org_.resizeNoInitialize(n_loc_tot_);
+        cell_for_force_org_.resizeNoInitialize(n_loc_tot_);
+        for(S32 i=n_old; i<n_loc_tot_; i++) n_epj_for_force_org_[i] = -1;
+
+        // the counts of the particles which moved to another cell are dropped
+        S64 n_epi_tot = 0;
+        S64 n_known = 0;
+        F64 n_epj_sum = 0.0;
+#pragma omp parallel for reduction(+ : n_epi_tot, n_known, n_epj_sum)
+        for(S32 i=0; i<n_ipg; i++){
+            const S32 adr_ptcl_tail = ipg_[i].adr_ptcl_ + ipg_[i].n_ptcl_;
+            n_epi_tot += ipg_[i].n_ptcl_;
+            for(S32 ip=ipg_[i].adr_ptcl_; ip<adr_ptcl_tail; ip++){
+                const S32 adr = getAdrOrgIPGroup(ip, adr_org);
+                if(n_epj_for_force_org_[adr] < 0) continue;
+                if(cell_for_force_org_[adr] != getCellForCost(epi[ip].getPos())){
+                    n_epj_for_force_org_[adr] = -1;
+                    continue;
+                }
+                n_known++;
+                n_epj_sum += n_epj_for_force_org_[adr];
             }
-            ni_ave_ = ni_tmp / n_ipg;
-            nj_ave_ = nj_tmp / n_ipg;
-            n_interaction_ = n_interaction_tmp;
         }
-        else{
-            ni_ave_ = nj_ave_ = n_interaction_ = 0;
+        const F64 n_epj_ave = (n_known > 0) ? n_epj_sum / n_known : 0.0;
+        const F64 cost_tot = n_epi_tot + n_epj_sum + (n_epi_tot - n_known) * n_epj_ave;
+        const F64 cost_chunk_target = cost_tot / (n_thread * n_chunk_per_thread);
+        adr_ipg_chunk_.clearSize();
+        cost_ipg_chunk_.clearSize();
+        adr_ipg_chunk_.push_back(0);
+        F64 cost_chunk = 0.0;
+        for(S32 i=0; i<n_ipg; i++){
+            const S32 adr_ptcl_tail = ipg_[i].adr_ptcl_ + ipg_[i].n_ptcl_;
+            for(S32 ip=ipg_[i].adr_ptcl_; ip<adr_ptcl_tail; ip++){
+                const S32 n_epj = n_epj_for_force_org_[getAdrOrgIPGroup(ip, adr_org)];
+                cost_chunk += 1.0 + ( (n_epj >= 0) ? (F64)n_epj : n_epj_ave );
+            }
+            if(cost_chunk >= cost_chunk_target || i == n_ipg-1){
+                cost_ipg_chunk_.push_back( std::make_pair(cost_chunk, cost_ipg_chunk_.size()) );
+                adr_ipg_chunk_.push_back(i+1);
+                cost_chunk = 0.0;
+            }
         }
-        copyForceOriginalOrder();
-#ifdef PARTICLE_SIMULATOR_DEBUG_PRINT
-        PARTICLE_SIMULATOR_PRINT_LINE_INFO();
-        std::cout<<"ipg_.size()="<<ipg_.size()<<std::endl;
-        std::cout<<"force_sorted_.size()="<<force_sorted_.size()<<std::endl;
-        std::cout<<"force_org_.size()="<<force_org_.size()<<std::endl;
-#endif
+        const S32 n_chunk = cost_ipg_chunk_.size();
+        std::sort(cost_ipg_chunk_.getPointer(), cost_ipg_chunk_.getPointer(n_chunk), std::greater< std::pair<F64, S32> >());
+
+        // LPT, then the queues are laid out thread by thread, the largest chunk first
+        S32 * ith_chunk = new S32[n_chunk];
+        for(S32 i=0; i<n_thread; i++){
+            ipg_chunk_queue_cost_[i] = 0.0;
+            ipg_chunk_queue_tail_[i] = 0;
+        }
+        for(S32 k=0; k<n_chunk; k++){
+            S32 ith = 0;
+            for(S32 j=1; j<n_thread; j++){
+                if(ipg_chunk_queue_cost_[j] < ipg_chunk_queue_cost_[ith]) ith = j;
+            }
+            ipg_chunk_queue_cost_[ith] += cost_ipg_chunk_[k].first;
+            ipg_chunk_queue_tail_[ith]++;
+            ith_chunk[k] = ith;
+        }
+        S32 n_sum = 0;
+        for(S32 i=0; i<n_thread; i++){
+            ipg_chunk_queue_head_[i] = n_sum;
+            n_sum += ipg_chunk_queue_tail_[i];
+            ipg_chunk_queue_tail_[i] = ipg_chunk_queue_head_[i];
+        }
+        ipg_chunk_queue_.resizeNoInitialize(n_chunk);
+        for(S32 k=0; k<n_chunk; k++){
+            ipg_chunk_queue_[ipg_chunk_queue_tail_[ith_chunk[k]]++] = k;
+        }
+        delete [] ith_chunk;
     }
 
+    // The owner moves the head of its queue and the thieves the tail. The
+    // owner takes the head first and checks it against the tail afterwards,
+    // a thief does the same with the tail (THE protocol), so that only a
+    // conflict on the last chunk of a queue is resolved under the lock,
+    // which also serializes the thieves.
     template<class TSM, class Tforce, class Tepi, class Tepj,
-             class Tmomloc, class Tmomglb, class Tspj>
-    template<class Tfunc_ep_ep, class Tfunc_ep_sp>
-    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
-    calcForce(Tfunc_ep_ep pfunc_ep_ep,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    bool TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    popIPGroupChunk(const S32 ith, S32 & adr_chunk){
+        S32 * head = ipg_chunk_queue_head_.getPointer();
+        S32 * tail = ipg_chunk_queue_tail_.getPointer();
+        F64 * cost = ipg_chunk_queue_cost_.getPointer();
+        S32 ith_queue = ith;
+        S32 k = head[ith];
+        head[ith] = k + 1;
+#pragma omp flush
+        if(k >= tail[ith]){
+            head[ith] = k;
+#pragma omp critical(ipg_chunk_queue)
+            {
+                k = head[ith];
+                if(k < tail[ith]) head[ith] = k + 1;
+                else k = -1;
+                if(k < 0){
+                    const S32 n_thread = Comm::getNumberOfThread();
+                    while(true){
+#pragma omp flush
+                        // the costs are only a hint, they may be behind
+                        S32 ith_victim = -1;
+                        for(S32 i=0; i<n_thread; i++){
+                            if(head[i] >= tail[i]) continue;
+                            if(ith_victim < 0 || cost[i] > cost[ith_victim]) ith_victim = i;
+                        }
+                        if(ith_victim < 0) break;
+                        const S32 t = tail[ith_victim] - 1;
+                        tail[ith_victim] = t;
+#pragma omp flush
+                        if(head[ith_victim] > t){
+                            // the owner took it
+                            tail[ith_victim] = t + 1;
+                            continue;
+                        }
+                        k = t;
+                        ith_queue = ith_victim;
+                        break;
+                    }
+                }
+            }
+        }
+        if(k < 0) return false;
+        const F64 cost_chunk = cost_ipg_chunk_[ipg_chunk_queue_[k]].first;
+#pragma omp atomic
+        cost[ith_queue] -= cost_chunk;
+        adr_chunk = cost_ipg_chunk_[ipg_chunk_queue_[k]].second;
+        return true;
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    copyForceOriginalOrder(){
+        force_org_.resizeNoInitialize(n_loc_tot_);
+#pragma omp parallel for
+        for(S32 i=0; i<n_loc_tot_; i++){
+            const S32 adr = ClearMSB(tp_loc_[i].adr_ptcl_);
+            force_org_[adr] = force_sorted_[i];
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    template<class Tpsys>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    copyForceOriginalOrder(Tpsys & psys){
+        force_org_.resizeNoInitialize(n_loc_tot_);
+#pragma omp parallel for
+        for(S32 i=0; i<n_loc_tot_; i++){
+            const S32 adr = ClearMSB(tp_loc_[i].adr_ptcl_);
+            force_org_[adr] = force_sorted_[i];
+            psys[adr].copyFromForce(force_sorted_[i]);
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    template<class Tfunc_ep_ep>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    calcForce(Tfunc_ep_ep pfunc_ep_ep,
+              const bool clear){
+        force_sorted_.resizeNoInitialize(n_loc_tot_);
+        force_org_.resizeNoInitialize(n_loc_tot_);
+        const S32 n_ipg = ipg_.size();
+        S32 ni_tmp = 0;
+        S32 nj_tmp = 0;
+        S64 n_interaction_tmp = 0;
+        if(n_ipg > 0){
+            makeIPGroupSchedule(epi_sorted_.getPointer(), NULL);
+#pragma omp parallel reduction(+ : ni_tmp, nj_tmp, n_interaction_tmp) 
+            {
+                const S32 ith = Comm::getThreadNum();
+                const F64 wtime_offset = GetWtime();
+                F64 wtime_busy = 0.0;
+                S32 adr_chunk;
+                while( popIPGroupChunk(ith, adr_chunk) ){
+                    const F64 wtime_chunk = GetWtime();
+                    for(S32 i=adr_ipg_chunk_[adr_chunk]; i<adr_ipg_chunk_[adr_chunk+1]; i++){
+                        makeInteractionList(i);
+                        const S32 n_epj = epj_for_force_[ith].size();
+                        ni_tmp += ipg_[i].n_ptcl_;
+                        nj_tmp += n_epj;
+                        n_interaction_tmp += ipg_[i].n_ptcl_ * n_epj;
+                        setCostIPGroup(i, n_epj, epi_sorted_.getPointer(), NULL);
+                        calcForceOnly( pfunc_ep_ep, i, clear);
+                    }
+                    wtime_busy += GetWtime() - wtime_chunk;
+                }
+#pragma omp barrier
+                wtime_busy_calc_force_[ith] = wtime_busy;
+                wtime_idle_calc_force_[ith] = GetWtime() - wtime_offset - wtime_busy;
+            }
+            ni_ave_ = ni_tmp / n_ipg;
+            nj_ave_ = nj_tmp / n_ipg;
+            n_interaction_ = n_interaction_tmp;
+        }
+        else{
+            ni_ave_ = nj_ave_ = n_interaction_ = 0;
+        }
+        if(!defer_copy_force_org_) copyForceOriginalOrder();
+#ifdef PARTICLE_SIMULATOR_DEBUG_PRINT
+        PARTICLE_SIMULATOR_PRINT_LINE_INFO();
+        std::cout<<"ipg_.size()="<<ipg_.size()<<std::endl;
+        std::cout<<"force_sorted_.size()="<<force_sorted_.size()<<std::endl;
+        std::cout<<"force_org_.size()="<<force_org_.size()<<std::endl;
+#endif
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    template<class Tfunc_ep_ep, class Tfunc_ep_sp>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    calcForce(Tfunc_ep_ep pfunc_ep_ep,
               Tfunc_ep_sp pfunc_ep_sp,
               const bool clear){
         force_sorted_.resizeNoInitialize(n_loc_tot_);
@@ -2169,15 +2886,29 @@ namespace ParticleSimulator{
         S32 nj_tmp = 0;
         S64 n_interaction_tmp = 0;
         if(n_ipg > 0){
-#pragma omp parallel for schedule(dynamic, 4) reduction(+ : ni_tmp, nj_tmp, n_interaction_tmp) 
-            for(S32 i=0; i<n_ipg; i++){
-                makeInteractionList(i);
-                ni_tmp += ipg_[i].n_ptcl_;
-                nj_tmp += epj_for_force_[Comm::getThreadNum()].size();
-                nj_tmp += spj_for_force_[Comm::getThreadNum()].size();
-                n_interaction_tmp += ipg_[i].n_ptcl_ * epj_for_force_[Comm::getThreadNum()].size();
-                n_interaction_tmp += ipg_[i].n_ptcl_ * spj_for_force_[Comm::getThreadNum()].size();
-                calcForceOnly( pfunc_ep_ep, pfunc_ep_sp, i, clear);
+            makeIPGroupSchedule(epi_sorted_.getPointer(), NULL);
+#pragma omp parallel reduction(+ : ni_tmp, nj_tmp, n_interaction_tmp) 
+            {
+                const S32 ith = Comm::getThreadNum();
+                const F64 wtime_offset = GetWtime();
+                F64 wtime_busy = 0.0;
+                S32 adr_chunk;
+                while( popIPGroupChunk(ith, adr_chunk) ){
+                    const F64 wtime_chunk = GetWtime();
+                    for(S32 i=adr_ipg_chunk_[adr_chunk]; i<adr_ipg_chunk_[adr_chunk+1]; i++){
+                        makeInteractionList(i);
+                        const S32 n_epj = epj_for_force_[ith].size() + spj_for_force_[ith].size();
+                        ni_tmp += ipg_[i].n_ptcl_;
+                        nj_tmp += n_epj;
+                        n_interaction_tmp += ipg_[i].n_ptcl_ * n_epj;
+                        setCostIPGroup(i, n_epj, epi_sorted_.getPointer(), NULL);
+                        calcForceOnly( pfunc_ep_ep, pfunc_ep_sp, i, clear);
+                    }
+                    wtime_busy += GetWtime() - wtime_chunk;
+                }
+#pragma omp barrier
+                wtime_busy_calc_force_[ith] = wtime_busy;
+                wtime_idle_calc_force_[ith] = GetWtime() - wtime_offset - wtime_busy;
             }
             ni_ave_ = ni_tmp / n_ipg;
             nj_ave_ = nj_tmp / n_ipg;
@@ -2186,7 +2917,7 @@ namespace ParticleSimulator{
         else{
             ni_ave_ = nj_ave_ = n_interaction_ = 0;
         }
-        copyForceOriginalOrder();
+        if(!defer_copy_force_org_) copyForceOriginalOrder();
 #ifdef PARTICLE_SIMULATOR_DEBUG_PRINT
         PARTICLE_SIMULATOR_PRINT_LINE_INFO();
         std::cout<<"ipg_.size()="<<ipg_.size()<<std::endl;
@@ -2195,6 +2926,739 @@ namespace ParticleSimulator{
 #endif
     }
     
+    //////////////////////////////////////
+    // CALC FORCE ON ACTIVE PARTICLES ONLY //
+    // The i-groups are made by walking the local tree and counting only the
+    // active particles of each cell, so that the groups of a sparse active
+    // set are not made of single particles. The active particles are copied
+    // from psys in Morton order into epi_active_. The j-side (global tree or
+    // cell list) is the one made by the last calcForceAll*.
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    template<class Tpsys>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeIPGroupActive(const Tpsys & psys,
+                      const S32 adr_active[],
+                      const S32 n_active){
+        if(psys.getNumberOfParticleLocal() != n_loc_tot_){
+            PARTICLE_SIMULATOR_PRINT_ERROR("the particles were exchanged or added after the last tree construction");
+            std::cerr<<"n_loc_tot_= "<<n_loc_tot_<<" psys.getNumberOfParticleLocal()= "<<psys.getNumberOfParticleLocal()<<std::endl;
+            Abort(-1);
+        }
+        adr_sorted_org_.resizeNoInitialize(n_loc_tot_);
+        n_active_cum_.resizeNoInitialize(n_loc_tot_+1);
+#pragma omp parallel for
+        for(S32 i=0; i<n_loc_tot_; i++){
+            adr_sorted_org_[ClearMSB(tp_loc_[i].adr_ptcl_)] = i;
+            n_active_cum_[i+1] = 0;
+        }
+        n_active_cum_[0] = 0;
+        for(S32 i=0; i<n_active; i++){
+            n_active_cum_[adr_sorted_org_[adr_active[i]]+1] = 1;
+        }
+        for(S32 i=0; i<n_loc_tot_; i++){
+            n_active_cum_[i+1] += n_active_cum_[i];
+        }
+        const S32 n_act = n_active_cum_[n_loc_tot_]; // duplicates in adr_active[] are counted once
+        adr_active_org_.resizeNoInitialize(n_act);
+        epi_active_.resizeNoInitialize(n_act);
+#pragma omp parallel for
+        for(S32 i=0; i<n_loc_tot_; i++){
+            const S32 k = n_active_cum_[i];
+            if(n_active_cum_[i+1] == k) continue;
+            const S32 adr = ClearMSB(tp_loc_[i].adr_ptcl_);
+            adr_active_org_[k] = adr;
+            epi_active_[k].copyFromFP(psys[adr]);
+        }
+        ipg_.clearSize();
+        MakeIPGroupActive(ipg_, tc_loc_, n_active_cum_, 0, n_group_limit_);
+        const S32 n_ipg = ipg_.size();
+#pragma omp parallel for
+        for(S32 i=0; i<n_ipg; i++){
+            setVertexIPGroupActiveImpl(typename TSM::search_type(), i);
+        }
+        if(n_ipg_batch_ > 1) MergeIPGroup(ipg_, n_group_limit_, n_ipg_batch_);
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setVertexIPGroupActiveImpl(TagSearchLong, const S32 adr_ipg){
+        ipg_[adr_ipg].vertex_ = GetMinBoxSingleThread(epi_active_.getPointer(ipg_[adr_ipg].adr_ptcl_), ipg_[adr_ipg].n_ptcl_);
+    }
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setVertexIPGroupActiveImpl(TagSearchLongCutoff, const S32 adr_ipg){
+        ipg_[adr_ipg].vertex_ = GetMinBoxSingleThread(epi_active_.getPointer(ipg_[adr_ipg].adr_ptcl_), ipg_[adr_ipg].n_ptcl_);
+    }
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setVertexIPGroupActiveImpl(TagSearchShortScatter, const S32 adr_ipg){
+        ipg_[adr_ipg].vertex_ = GetMinBoxSingleThread(epi_active_.getPointer(ipg_[adr_ipg].adr_ptcl_), ipg_[adr_ipg].n_ptcl_);
+    }
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setVertexIPGroupActiveImpl(TagSearchShortGather, const S32 adr_ipg){
+        const S32 adr_head = ipg_[adr_ipg].adr_ptcl_;
+        const S32 adr_tail = adr_head + ipg_[adr_ipg].n_ptcl_;
+        ipg_[adr_ipg].vertex_.initNegativeVolume();
+        for(S32 i=adr_head; i<adr_tail; i++){
+            ipg_[adr_ipg].vertex_.merge(epi_active_[i].getPos(), epi_active_[i].getRSearch());
+        }
+    }
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    setVertexIPGroupActiveImpl(TagSearchShortSymmetry, const S32 adr_ipg){
+        const S32 adr_head = ipg_[adr_ipg].adr_ptcl_;
+        const S32 adr_tail = adr_head + ipg_[adr_ipg].n_ptcl_;
+        ipg_[adr_ipg].vertex_.initNegativeVolume();
+        ipg_[adr_ipg].vertex_in.initNegativeVolume();
+        for(S32 i=adr_head; i<adr_tail; i++){
+            ipg_[adr_ipg].vertex_.merge(epi_active_[i].getPos(), epi_active_[i].getRSearch());
+            ipg_[adr_ipg].vertex_in.merge(epi_active_[i].getPos());
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    template<class Tfunc_ep_ep, class Tpsys>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    calcForceActiveAndWriteBack(Tfunc_ep_ep pfunc_ep_ep,
+                                Tpsys & psys,
+                                const S32 adr_active[],
+                                const S32 n_active,
+                                const bool clear){
+        makeIPGroupActive(psys, adr_active, n_active);
+        const S32 n_act = epi_active_.size();
+        const S32 n_ipg = ipg_.size();
+        force_active_.resizeNoInitialize(n_act);
+        force_org_.resizeNoInitialize(n_loc_tot_);
+        S32 ni_tmp = 0;
+        S32 nj_tmp = 0;
+        S64 n_interaction_tmp = 0;
+        if(n_ipg > 0){
+            makeIPGroupSchedule(epi_active_.getPointer(), adr_active_org_.getPointer());
+#pragma omp parallel reduction(+ : ni_tmp, nj_tmp, n_interaction_tmp)
+            {
+                const S32 ith = Comm::getThreadNum();
+                S32 adr_chunk;
+                while( popIPGroupChunk(ith, adr_chunk) ){
+                    for(S32 i=adr_ipg_chunk_[adr_chunk]; i<adr_ipg_chunk_[adr_chunk+1]; i++){
+                        makeInteractionList(i);
+                        const S32 offset = ipg_[i].adr_ptcl_;
+                        const S32 n_epi = ipg_[i].n_ptcl_;
+                        const S32 n_epj = epj_for_force_[ith].size();
+                        ni_tmp += n_epi;
+                        nj_tmp += n_epj;
+                        n_interaction_tmp += n_epi * n_epj;
+                        setCostIPGroup(i, n_epj, epi_active_.getPointer(), adr_active_org_.getPointer());
+                        for(S32 k=offset; k<offset+n_epi; k++){
+                            if(clear) force_active_[k].clear();
+                            else force_active_[k] = force_org_[adr_active_org_[k]];
+                        }
+                        Tepi * epi = shiftInteractionList(i, epi_active_.getPointer(offset), n_epi);
+                        pfunc_ep_ep(epi,                              n_epi,
+                                    epj_for_force_[ith].getPointer(), n_epj,
+                                    force_active_.getPointer(offset));
+                    }
+                }
+            }
+        }
+        ni_ave_ = (n_ipg > 0) ? ni_tmp / n_ipg : 0;
+        nj_ave_ = (n_ipg > 0) ? nj_tmp / n_ipg : 0;
+        n_interaction_ = n_interaction_tmp;
+#pragma omp parallel for
+        for(S32 k=0; k<n_act; k++){
+            const S32 adr = adr_active_org_[k];
+            force_org_[adr] = force_active_[k];
+            psys[adr].copyFromForce(force_active_[k]);
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    template<class Tfunc_ep_ep, class Tfunc_ep_sp, class Tpsys>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    calcForceActiveAndWriteBack(Tfunc_ep_ep pfunc_ep_ep,
+                                Tfunc_ep_sp pfunc_ep_sp,
+                                Tpsys & psys,
+                                const S32 adr_active[],
+                                const S32 n_active,
+                                const bool clear){
+        makeIPGroupActive(psys, adr_active, n_active);
+        const S32 n_act = epi_active_.size();
+        const S32 n_ipg = ipg_.size();
+        force_active_.resizeNoInitialize(n_act);
+        force_org_.resizeNoInitialize(n_loc_tot_);
+        S32 ni_tmp = 0;
+        S32 nj_tmp = 0;
+        S64 n_interaction_tmp = 0;
+        if(n_ipg > 0){
+            makeIPGroupSchedule(epi_active_.getPointer(), adr_active_org_.getPointer());
+#pragma omp parallel reduction(+ : ni_tmp, nj_tmp, n_interaction_tmp)
+            {
+                const S32 ith = Comm::getThreadNum();
+                S32 adr_chunk;
+                while( popIPGroupChunk(ith, adr_chunk) ){
+                    for(S32 i=adr_ipg_chunk_[adr_chunk]; i<adr_ipg_chunk_[adr_chunk+1]; i++){
+                        makeInteractionList(i);
+                        const S32 offset = ipg_[i].adr_ptcl_;
+                        const S32 n_epi = ipg_[i].n_ptcl_;
+                        const S32 n_epj = epj_for_force_[ith].size();
+                        const S32 n_spj = spj_for_force_[ith].size();
+                        ni_tmp += n_epi;
+                        nj_tmp += n_epj + n_spj;
+                        n_interaction_tmp += n_epi * (n_epj + n_spj);
+                        setCostIPGroup(i, n_epj + n_spj, epi_active_.getPointer(), adr_active_org_.getPointer());
+                        for(S32 k=offset; k<offset+n_epi; k++){
+                            if(clear) force_active_[k].clear();
+                            else force_active_[k] = force_org_[adr_active_org_[k]];
+                        }
+                        Tepi * epi = shiftInteractionList(i, epi_active_.getPointer(offset), n_epi);
+                        pfunc_ep_ep(epi,                              n_epi,
+                                    epj_for_force_[ith].getPointer(), n_epj,
+                                    force_active_.getPointer(offset));
+                        pfunc_ep_sp(epi,                              n_epi,
+                                    spj_for_force_[ith].getPointer(), n_spj,
+                                    force_active_.getPointer(offset));
+                    }
+                }
+            }
+        }
+        ni_ave_ = (n_ipg > 0) ? ni_tmp / n_ipg : 0;
+        nj_ave_ = (n_ipg > 0) ? nj_tmp / n_ipg : 0;
+        n_interaction_ = n_interaction_tmp;
+#pragma omp parallel for
+        for(S32 k=0; k<n_act; k++){
+            const S32 adr = adr_active_org_[k];
+            force_org_[adr] = force_active_[k];
+            psys[adr].copyFromForce(force_active_[k]);
+        }
+    }
+
+    ///////////////////////////////////
+    // CALC FORCE WITH VERLET LISTS //
+    // The lists of the i-groups hold the addresses of EPJ in epj_org_ (local
+    // particles in the original order followed by the LET particles). While
+    // they are reused, the LET particles are updated by sending the
+    // displacement since the list build to the same destinations.
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    template<class Tpsys>
+    bool TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    needVerletListRebuild(const Tpsys & psys){
+        const S32 n_loc = psys.getNumberOfParticleLocal();
+        const S64 n_modification = GetNumberOfModification(psys);
+        S32 flag = (is_verlet_list_valid_ && n_loc == n_loc_tot_
+                    && n_modification == n_modification_psys_verlet_) ? 0 : 1;
+        F64 dr2_max = 0.0;
+        if(flag == 0){
+            for(S32 i=0; i<n_loc; i++){
+                const F64vec dr = psys[i].getPos() - pos_verlet_org_[i];
+                if(dr*dr > dr2_max) dr2_max = dr*dr;
+            }
+        }
+        flag = Comm::getMaxValue(flag);
+        dr2_max = Comm::getMaxValue(dr2_max);
+        if(flag != 0 || 4.0*dr2_max > skin_verlet_*skin_verlet_){
+            is_verlet_list_valid_ = false;
+        }
+        n_modification_psys_verlet_ = n_modification;
+        return !is_verlet_list_valid_;
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeEPXRAdrSortedImpl(TagRSearch){
+        epxr_adr_sorted_.resizeNoInitialize(n_glb_tot_);
+#pragma omp parallel for
+        for(S32 i=0; i<n_glb_tot_; i++){
+            epxr_adr_sorted_[i].set(epj_sorted_[i].getPos(), epj_sorted_[i].getRSearch(), tp_glb_[i].adr_ptcl_);
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeEPXRAdrSortedImpl(TagNoRSearch){
+        epxr_adr_sorted_.resizeNoInitialize(n_glb_tot_);
+#pragma omp parallel for
+        for(S32 i=0; i<n_glb_tot_; i++){
+            epxr_adr_sorted_[i].set(epj_sorted_[i].getPos(), 0.0, tp_glb_[i].adr_ptcl_);
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeVerletListImpl(TagSearchShortScatter, const S32 adr_ipg){
+        const S32 ith = Comm::getThreadNum();
+        const F64ort pos_target_box = (ipg_[adr_ipg]).vertex_;
+        if( !tc_glb_[0].isLeaf(n_leaf_limit_) ){
+            MakeListUsingOuterBoundary
+                (tc_glb_.getPointer(),          tc_glb_[0].adr_tc_,
+                 epxr_adr_sorted_.getPointer(), epxr_adr_for_force_[ith], 
+                 pos_target_box,   n_leaf_limit_);
+        }
+        else if( pos_target_box.overlapped( tc_glb_[0].mom_.getVertexOut()) ){
+            S32 adr_ptcl_tmp = tc_glb_[0].adr_ptcl_;
+            const S32 n_tmp = tc_glb_[0].n_ptcl_;
+            epxr_adr_for_force_[ith].reserveEmptyAreaAtLeast( n_tmp );
+            for(S32 ip=0; ip<n_tmp; ip++, adr_ptcl_tmp++){
+                const F64vec pos_tmp = epxr_adr_sorted_[adr_ptcl_tmp].getPos();
+                const F64 size_tmp = epxr_adr_sorted_[adr_ptcl_tmp].getRSearch();
+                const F64 dis_sq_tmp = pos_target_box.getDistanceMinSQ(pos_tmp);
+                if(dis_sq_tmp > size_tmp*size_tmp) continue;
+                epxr_adr_for_force_[ith].pushBackNoCheck(epxr_adr_sorted_[adr_ptcl_tmp]);
+            }
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeVerletListImpl(TagSearchShortGather, const S32 adr_ipg){
+        const S32 ith = Comm::getThreadNum();
+        const F64ort pos_target_box = (ipg_[adr_ipg]).vertex_;
+        if( !tc_glb_[0].isLeaf(n_leaf_limit_) ){
+            MakeListUsingInnerBoundary
+                (tc_glb_.getPointer(),          tc_glb_[0].adr_tc_,
+                 epxr_adr_sorted_.getPointer(), epxr_adr_for_force_[ith], 
+                 pos_target_box,   n_leaf_limit_);
+        }
+        else if( pos_target_box.overlapped( tc_glb_[0].mom_.getVertexIn()) ){
+            S32 adr_ptcl_tmp = tc_glb_[0].adr_ptcl_;
+            const S32 n_tmp = tc_glb_[0].n_ptcl_;
+            epxr_adr_for_force_[ith].reserveEmptyAreaAtLeast( n_tmp );
+            for(S32 ip=0; ip<n_tmp; ip++, adr_ptcl_tmp++){
+                if( pos_target_box.overlapped( epxr_adr_sorted_[adr_ptcl_tmp].getPos() ) ){
+                    epxr_adr_for_force_[ith].pushBackNoCheck(epxr_adr_sorted_[adr_ptcl_tmp]);
+                }
+            }
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeVerletListImpl(TagSearchShortSymmetry, const S32 adr_ipg){
+        const S32 ith = Comm::getThreadNum();
+        const F64ort pos_target_box_out = (ipg_[adr_ipg]).vertex_;
+        const F64ort pos_target_box_in = (ipg_[adr_ipg]).vertex_in;
+        if( !tc_glb_[0].isLeaf(n_leaf_limit_) ){
+            MakeListUsingOuterBoundaryAndInnerBoundary
+                (tc_glb_.getPointer(),          tc_glb_[0].adr_tc_,
+                 epxr_adr_sorted_.getPointer(), epxr_adr_for_force_[ith], 
+                 pos_target_box_out, pos_target_box_in, n_leaf_limit_);
+        }
+        else if( pos_target_box_out.overlapped(tc_glb_[0].mom_.getVertexIn()) 
+                 || pos_target_box_in.overlapped(tc_glb_[0].mom_.getVertexOut()) ){
+            S32 adr_ptcl_tmp = tc_glb_[0].adr_ptcl_;
+            const S32 n_tmp = tc_glb_[0].n_ptcl_;
+            epxr_adr_for_force_[ith].reserveEmptyAreaAtLeast( n_tmp );
+            for(S32 ip=0; ip<n_tmp; ip++, adr_ptcl_tmp++){
+                const F64vec pos_tmp = epxr_adr_sorted_[adr_ptcl_tmp].getPos();
+                const F64 size_tmp = epxr_adr_sorted_[adr_ptcl_tmp].getRSearch();
+                const F64 dis_sq_tmp = pos_target_box_in.getDistanceMinSQ(pos_tmp);
+                if( pos_target_box_out.notOverlapped(pos_tmp) && dis_sq_tmp > size_tmp*size_tmp) continue;
+                epxr_adr_for_force_[ith].pushBackNoCheck(epxr_adr_sorted_[adr_ptcl_tmp]);
+            }
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeVerletList(){
+        const S32 n_ipg = ipg_.size();
+        makeEPXRAdrSortedImpl(typename HasRSearch<Tepj>::type());
+        ith_verlet_list_.resizeNoInitialize(n_ipg);
+        adr_verlet_list_.resizeNoInitialize(n_ipg);
+        n_verlet_list_.resizeNoInitialize(n_ipg);
+#pragma omp parallel
+        {
+            const S32 ith = Comm::getThreadNum();
+            adr_epj_verlet_[ith].clearSize();
+#pragma omp for schedule(dynamic, 4)
+            for(S32 i=0; i<n_ipg; i++){
+                epxr_adr_for_force_[ith].clearSize();
+                if(cell_list_mode_){
+                    adr_cell_list_for_force_[ith].clearSize();
+                    makeAdrListUsingCellListImpl(typename TSM::search_type(), i, adr_cell_list_for_force_[ith]);
+                    const S32 n_tmp = adr_cell_list_for_force_[ith].size();
+                    epxr_adr_for_force_[ith].reserveEmptyAreaAtLeast( n_tmp );
+                    for(S32 j=0; j<n_tmp; j++){
+                        epxr_adr_for_force_[ith].pushBackNoCheck( epxr_adr_sorted_[adr_cell_list_for_force_[ith][j]] );
+                    }
+                }
+                else{
+                    makeVerletListImpl(typename TSM::search_type(), i);
+                }
+                const S32 n_epj = epxr_adr_for_force_[ith].size();
+                ith_verlet_list_[i] = ith;
+                adr_verlet_list_[i] = adr_epj_verlet_[ith].size();
+                n_verlet_list_[i] = n_epj;
+                adr_epj_verlet_[ith].reserveEmptyAreaAtLeast( n_epj );
+                for(S32 j=0; j<n_epj; j++){
+                    adr_epj_verlet_[ith].pushBackNoCheck( epxr_adr_for_force_[ith][j].getAdr() );
+                }
+            }
+        }
+        const S32 n_let = n_glb_tot_ - n_loc_tot_;
+        pos_verlet_org_.resizeNoInitialize(n_loc_tot_);
+        pos_verlet_let_.resizeNoInitialize(n_let);
+#pragma omp parallel
+        {
+#pragma omp for
+            for(S32 i=0; i<n_loc_tot_; i++) pos_verlet_org_[i] = epj_org_[i].getPos();
+#pragma omp for
+            for(S32 i=0; i<n_let; i++) pos_verlet_let_[i] = epj_org_[n_loc_tot_+i].getPos();
+        }
+        is_verlet_list_valid_ = true;
+    }
+
+    // update epi_sorted_ and the LET particles without the tree
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    exchangeLocalEssentialTreeVerlet(){
+        const S32 n_proc = Comm::getNumberOfProc();
+        const S32 n_let = n_glb_tot_ - n_loc_tot_;
+        const S32 n_send_tot = n_ep_let_send_disp_[n_proc];
+        static bool first = true;
+        static S32 * n_ep_send;
+        static S32 * n_ep_recv;
+        static S32 * n_ep_recv_disp;
+        if(first){
+            n_ep_send = new S32[n_proc];
+            n_ep_recv = new S32[n_proc];
+            n_ep_recv_disp = new S32[n_proc+1];
+            first = false;
+        }
+        epj_send_.resizeNoInitialize(n_send_tot);
+#pragma omp parallel
+        {
+#pragma omp for
+            for(S32 i=0; i<n_loc_tot_; i++){
+                epi_sorted_[i] = getEpiOrgPointer()[tp_loc_[i].adr_ptcl_];
+            }
+#pragma omp for
+            for(S32 i=0; i<n_send_tot; i++){
+                const S32 adr = tp_loc_[adr_ep_let_send_[i]].adr_ptcl_;
+                epj_send_[i] = epj_org_[adr];
+                epj_send_[i].setPos( epj_org_[adr].getPos() - pos_verlet_org_[adr] );
+            }
+        }
+        for(S32 i=0; i<n_proc; i++){
+            n_ep_send[i] = n_ep_let_send_disp_[i+1] - n_ep_let_send_disp_[i];
+            n_ep_recv[i] = n_ep_recv_[i];
+            n_ep_recv_disp[i] = n_ep_recv_disp_[i];
+        }
+        n_ep_recv_disp[n_proc] = n_ep_recv_disp_[n_proc];
+        epj_recv_.resizeNoInitialize(n_let);
+        Comm::allToAllV(epj_send_.getPointer(), n_ep_send, n_ep_let_send_disp_,
+                        epj_recv_.getPointer(), n_ep_recv, n_ep_recv_disp);
+        epj_org_.resizeNoInitialize(n_glb_tot_);
+#pragma omp parallel for
+        for(S32 i=0; i<n_let; i++){
+            epj_org_[n_loc_tot_+i] = epj_recv_[i];
+            epj_org_[n_loc_tot_+i].setPos( pos_verlet_let_[i] + epj_recv_[i].getPos() );
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeInteractionListVerlet(const S32 adr_ipg){
+        const S32 ith = Comm::getThreadNum();
+        const S32 n_epj = n_verlet_list_[adr_ipg];
+        const S32 * adr_epj = adr_epj_verlet_[ith_verlet_list_[adr_ipg]].getPointer(adr_verlet_list_[adr_ipg]);
+        epj_for_force_[ith].resizeNoInitialize(n_epj);
+        for(S32 j=0; j<n_epj; j++) epj_for_force_[ith][j] = epj_org_[adr_epj[j]];
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    template<class Tfunc_ep_ep>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    calcForceVerlet(Tfunc_ep_ep pfunc_ep_ep,
+                    const bool clear){
+        force_sorted_.resizeNoInitialize(n_loc_tot_);
+        force_org_.resizeNoInitialize(n_loc_tot_);
+        const S32 n_ipg = ipg_.size();
+        S32 ni_tmp = 0;
+        S32 nj_tmp = 0;
+        S64 n_interaction_tmp = 0;
+        if(n_ipg > 0){
+            makeIPGroupSchedule(epi_sorted_.getPointer(), NULL);
+#pragma omp parallel reduction(+ : ni_tmp, nj_tmp, n_interaction_tmp) 
+            {
+                const S32 ith = Comm::getThreadNum();
+                const F64 wtime_offset = GetWtime();
+                F64 wtime_busy = 0.0;
+                S32 adr_chunk;
+                while( popIPGroupChunk(ith, adr_chunk) ){
+                    const F64 wtime_chunk = GetWtime();
+                    for(S32 i=adr_ipg_chunk_[adr_chunk]; i<adr_ipg_chunk_[adr_chunk+1]; i++){
+                        makeInteractionListVerlet(i);
+                        const S32 n_epj = epj_for_force_[ith].size();
+                        ni_tmp += ipg_[i].n_ptcl_;
+                        nj_tmp += n_epj;
+                        n_interaction_tmp += ipg_[i].n_ptcl_ * n_epj;
+                        setCostIPGroup(i, n_epj, epi_sorted_.getPointer(), NULL);
+                        calcForceOnly( pfunc_ep_ep, i, clear);
+                    }
+                    wtime_busy += GetWtime() - wtime_chunk;
+                }
+#pragma omp barrier
+                wtime_busy_calc_force_[ith] = wtime_busy;
+                wtime_idle_calc_force_[ith] = GetWtime() - wtime_offset - wtime_busy;
+            }
+            ni_ave_ = ni_tmp / n_ipg;
+            nj_ave_ = nj_tmp / n_ipg;
+            n_interaction_ = n_interaction_tmp;
+        }
+        else{
+            ni_ave_ = nj_ave_ = n_interaction_ = 0;
+        }
+        if(!defer_copy_force_org_) copyForceOriginalOrder();
+    }
+
+    ////////////////////////////////////
+    // CALC FORCE WITH NEWTON'S 3RD LAW //
+    // A pair is evaluated by the i-group with the smaller index. A pair with
+    // a LET particle is evaluated by the process with the smaller rank, and
+    // the reaction is sent back to the owner. Pairs with periodic images of
+    // the own particles are evaluated from both sides (reaction dropped).
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    makeInteractionListNewton3rd(const S32 adr_ipg){
+        const S32 ith = Comm::getThreadNum();
+        const S32 my_rank = Comm::getRank();
+        const S32 n_proc = Comm::getNumberOfProc();
+        const S32 offset = ipg_[adr_ipg].adr_ptcl_;
+        const S32 n_epi = ipg_[adr_ipg].n_ptcl_;
+        const F64ort pos_target_box_out = (ipg_[adr_ipg]).vertex_;
+        const F64ort pos_target_box_in = (ipg_[adr_ipg]).vertex_in;
+        epj_for_force_[ith].clearSize();
+        adr_epj_for_force_[ith].clearSize();
+        // the i-particles themselves come first
+        epj_for_force_[ith].reserveAtLeast( n_epi );
+        adr_epj_for_force_[ith].reserveAtLeast( n_epi );
+        for(S32 ip=offset; ip<offset+n_epi; ip++){
+            epj_for_force_[ith].pushBackNoCheck( epj_org_[tp_loc_[ip].adr_ptcl_] );
+            adr_epj_for_force_[ith].pushBackNoCheck( ip );
+        }
+        if(cell_list_mode_){
+            makeAdrListUsingCellListImpl(TagSearchShortSymmetry(), adr_ipg, adr_epj_for_force_[ith]);
+        }
+        else if( !tc_glb_[0].isLeaf(n_leaf_limit_) ){
+            MakeAdrListUsingOuterBoundaryAndInnerBoundary
+                (tc_glb_.getPointer(),     tc_glb_[0].adr_tc_,
+                 epj_sorted_.getPointer(), adr_epj_for_force_[ith], 
+                 pos_target_box_out, pos_target_box_in, n_leaf_limit_);
+        }
+        else{
+            S32 adr_ptcl_tmp = tc_glb_[0].adr_ptcl_;
+            const S32 n_tmp = tc_glb_[0].n_ptcl_;
+            adr_epj_for_force_[ith].reserveEmptyAreaAtLeast( n_tmp );
+            for(S32 ip=0; ip<n_tmp; ip++, adr_ptcl_tmp++){
+                const F64vec pos_tmp = epj_sorted_[adr_ptcl_tmp].getPos();
+                const F64 size_tmp = epj_sorted_[adr_ptcl_tmp].getRSearch();
+                const F64 dis_sq_tmp = pos_target_box_in.getDistanceMinSQ(pos_tmp);
+                if( pos_target_box_out.notOverlapped(pos_tmp) && dis_sq_tmp > size_tmp*size_tmp) continue;
+                adr_epj_for_force_[ith].pushBackNoCheck(adr_ptcl_tmp);
+            }
+        }
+        // keep only the pairs this i-group is responsible for
+        const S32 n_candidate = adr_epj_for_force_[ith].size();
+        epj_for_force_[ith].reserveAtLeast( n_candidate );
+        S32 n_cnt = n_epi;
+        for(S32 k=n_epi; k<n_candidate; k++){
+            const S32 adr_glb = adr_epj_for_force_[ith][k];
+            const S32 adr_org = tp_glb_[adr_glb].adr_ptcl_;
+            S32 adr_reaction = adr_org;
+            if(adr_org < n_loc_tot_){
+                if(adr_ipg_org_[adr_org] <= adr_ipg) continue;
+                adr_reaction = adr_sorted_org_[adr_org];
+            }
+            else{
+                const S32 adr_let = adr_org - n_loc_tot_;
+                const S32 rank = std::upper_bound(n_ep_recv_disp_, n_ep_recv_disp_+n_proc+1, adr_let) - n_ep_recv_disp_ - 1;
+                if(rank < my_rank) continue;
+                if(rank == my_rank) adr_reaction = -1;
+            }
+            epj_for_force_[ith].pushBackNoCheck( epj_sorted_[adr_glb] );
+            adr_epj_for_force_[ith][n_cnt++] = adr_reaction;
+        }
+        adr_epj_for_force_[ith].resizeNoInitialize(n_cnt);
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+             class Tmomloc, class Tmomglb, class Tspj>
+    template<class Tfunc_ep_ep>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    calcForceOnlyNewton3rd(Tfunc_ep_ep pfunc_ep_ep,
+                           const S32 adr_ipg,
+                           const bool clear){
+        const S32 offset = ipg_[adr_ipg].adr_ptcl_;
+        const S32 n_epi = ipg_[adr_ipg].n_ptcl_;
+        const S32 ith = Comm::getThreadNum();
+        const S32 n_epj = epj_for_force_[ith].size();
+        const S32 n_tail = offset + n_epi;
+        if(clear){
+            for(S32 i=offset; i<n_tail; i++) force_sorted_[i].clear();
+        }
+        force_epj_for_force_[ith].resizeNoInitialize(n_epj);
+        for(S32 j=0; j<n_epj; j++) force_epj_for_force_[ith][j].clear();
+        Tepi * epi = shiftInteractionList(adr_ipg, epi_sorted_.getPointer(offset), n_epi);
+        pfunc_ep_ep(epi,                                n_epi,
+                    epj_for_force_[ith].getPointer(),   n_epj,
+                    force_sorted_.getPointer(offset),
+                    force_epj_for_force_[ith].getPointer());
+        // the own i-particles are written by this thread only, the others
+        // are reduced after the loop
+        const S32 n_thread = Comm::getNumberOfThread();
+        for(S32 j=0; j<n_epj; j++){
+            const S32 adr = adr_epj_for_force_[ith][j];
+            if(adr < 0) continue;
+            if(adr >= offset && adr < n_tail){
+                force_sorted_[adr].accumulate(force_epj_for_force_[ith][j]);
+                continue;
+            }
+            ReactionEpj reaction;
+            reaction.adr_ = adr;
+            reaction.force_ = force_epj_for_force_[ith][j];
+            const S32 ib = (S32)( ((S64)adr * n_thread) / n_glb_tot_ );
+            reaction_for_force_[ith*n_thread+ib].push_back(reaction);
+        }
+    }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    template<class Tfunc_ep_ep>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    calcForceNewton3rd(Tfunc_ep_ep pfunc_ep_ep,
+                       const bool clear){
+        const S32 n_thread = Comm::getNumberOfThread();
+        const S32 n_ipg = ipg_.size();
+        const S32 n_let = n_glb_tot_ - n_loc_tot_;
+        force_sorted_.resizeNoInitialize(n_loc_tot_);
+        force_org_.resizeNoInitialize(n_loc_tot_);
+        adr_ipg_org_.resizeNoInitialize(n_loc_tot_);
+        adr_sorted_org_.resizeNoInitialize(n_loc_tot_);
+#pragma omp parallel for
+        for(S32 i=0; i<n_ipg; i++){
+            const S32 adr_ptcl_tail = ipg_[i].adr_ptcl_ + ipg_[i].n_ptcl_;
+            for(S32 ip=ipg_[i].adr_ptcl_; ip<adr_ptcl_tail; ip++){
+                const S32 adr_org = tp_loc_[ip].adr_ptcl_;
+                adr_ipg_org_[adr_org] = i;
+                adr_sorted_org_[adr_org] = ip;
+            }
+        }
+        makeIPGroupSchedule(epi_sorted_.getPointer(), NULL);
+        S32 ni_tmp = 0;
+        S32 nj_tmp = 0;
+        S64 n_interaction_tmp = 0;
+#pragma omp parallel reduction(+ : ni_tmp, nj_tmp, n_interaction_tmp) 
+        {
+            const S32 ith = Comm::getThreadNum();
+            for(S32 ib=0; ib<n_thread; ib++) reaction_for_force_[ith*n_thread+ib].clearSize();
+            const F64 wtime_offset = GetWtime();
+            F64 wtime_busy = 0.0;
+            S32 adr_chunk;
+            while( popIPGroupChunk(ith, adr_chunk) ){
+                const F64 wtime_chunk = GetWtime();
+                for(S32 i=adr_ipg_chunk_[adr_chunk]; i<adr_ipg_chunk_[adr_chunk+1]; i++){
+                    makeInteractionListNewton3rd(i);
+                    const S32 n_epj = epj_for_force_[ith].size();
+                    ni_tmp += ipg_[i].n_ptcl_;
+                    nj_tmp += n_epj;
+                    n_interaction_tmp += ipg_[i].n_ptcl_ * n_epj;
+                    setCostIPGroup(i, n_epj, epi_sorted_.getPointer(), NULL);
+                    calcForceOnlyNewton3rd( pfunc_ep_ep, i, clear);
+                }
+                wtime_busy += GetWtime() - wtime_chunk;
+            }
+#pragma omp barrier
+            wtime_busy_calc_force_[ith] = wtime_busy;
+            wtime_idle_calc_force_[ith] = GetWtime() - wtime_offset - wtime_busy;
+        }
+        if(n_ipg > 0){
+            ni_ave_ = ni_tmp / n_ipg;
+            nj_ave_ = nj_tmp / n_ipg;
+            n_interaction_ = n_interaction_tmp;
+        }
+        else{
+            ni_ave_ = nj_ave_ = n_interaction_ = 0;
+        }
+
+        // sum up the reactions of all threads, one address block per thread
+        force_let_.resizeNoInitialize(n_let);
+#pragma omp parallel
+        {
+#pragma omp for
+            for(S32 i=0; i<n_let; i++) force_let_[i].clear();
+#pragma omp for schedule(dynamic, 1)
+            for(S32 ib=0; ib<n_thread; ib++){
+                for(S32 ith=0; ith<n_thread; ith++){
+                    const ReallocatableArray<ReactionEpj> & reaction = reaction_for_force_[ith*n_thread+ib];
+                    const S32 n_reaction = reaction.size();
+                    for(S32 k=0; k<n_reaction; k++){
+                        const S32 adr = reaction[k].adr_;
+                        if(adr < n_loc_tot_) force_sorted_[adr].accumulate(reaction[k].force_);
+                        else force_let_[adr-n_loc_tot_].accumulate(reaction[k].force_);
+                    }
+                }
+            }
+        }
+
+#ifdef PARTICLE_SIMULATOR_MPI_PARALLEL
+        // send the reactions on LET particles back to the owners (higher ranks)
+        // and receive the reactions on the own particles from the lower ranks
+        static bool first = true;
+        static MPI::Request * req_send;
+        static MPI::Request * req_recv;
+        const S32 my_rank = Comm::getRank();
+        const S32 n_proc = Comm::getNumberOfProc();
+        if(first){
+            req_send = new MPI::Request[n_proc];
+            req_recv = new MPI::Request[n_proc];
+            first = false;
+        }
+        force_let_recv_.resizeNoInitialize(n_ep_let_send_disp_[n_proc]);
+        S32 n_cnt_send = 0;
+        S32 n_cnt_recv = 0;
+        for(S32 i=my_rank+1; i<n_proc; i++){
+            if(n_ep_recv_[i] > 0){
+                req_send[n_cnt_send++] = MPI::COMM_WORLD.Isend
+                    (force_let_.getPointer(n_ep_recv_disp_[i]), n_ep_recv_[i],
+                     GetDataType<Tforce>(), i, my_rank);
+            }
+        }
+        for(S32 i=0; i<my_rank; i++){
+            const S32 n_recv = n_ep_let_send_disp_[i+1] - n_ep_let_send_disp_[i];
+            if(n_recv > 0){
+                req_recv[n_cnt_recv++] = MPI::COMM_WORLD.Irecv
+                    (force_let_recv_.getPointer(n_ep_let_send_disp_[i]), n_recv,
+                     GetDataType<Tforce>(), i, i);
+            }
+        }
+        MPI::Request::Waitall(n_cnt_send, req_send);
+        MPI::Request::Waitall(n_cnt_recv, req_recv);
+        for(S32 i=0; i<n_ep_let_send_disp_[my_rank]; i++){
+            force_sorted_[adr_ep_let_send_[i]].accumulate(force_let_recv_[i]);
+        }
+#endif
+        if(!defer_copy_force_org_) copyForceOriginalOrder();
+    }
+
     template<class TSM, class Tforce, class Tepi, class Tepj,
 	     class Tmomloc, class Tmomglb, class Tspj>
     template<class Tfunc_ep_ep, class Tpsys>
@@ -2202,8 +3666,10 @@ namespace ParticleSimulator{
     calcForceAndWriteBack(Tfunc_ep_ep pfunc_ep_ep,
                           Tpsys & psys,
                           const bool clear){
+        defer_copy_force_org_ = true;
         calcForce(pfunc_ep_ep, clear);
-        for(S32 i=0; i<n_loc_tot_; i++) psys[i].copyFromForce(force_org_[i]);
+        defer_copy_force_org_ = false;
+        copyForceOriginalOrder(psys);
     }
 
     template<class TSM, class Tforce, class Tepi, class Tepj,
@@ -2214,8 +3680,10 @@ namespace ParticleSimulator{
 			  Tfunc_ep_sp pfunc_ep_sp,
 			  Tpsys & psys,
 			  const bool clear){
+        defer_copy_force_org_ = true;
         calcForce(pfunc_ep_ep, pfunc_ep_sp, clear);
-        for(S32 i=0; i<n_loc_tot_; i++) psys[i].copyFromForce(force_org_[i]);
+        defer_copy_force_org_ = false;
+        copyForceOriginalOrder(psys);
     }
 
     template<class TSM, class Tforce, class Tepi, class Tepj,
@@ -2234,7 +3702,7 @@ namespace ParticleSimulator{
         bool pa[DIMENSION];
         dinfo.getPeriodicAxis(pa);
         AllGatherParticle(epj_tmp, n_epj_tmp, epj_org_.getPointer(), n_loc_tot_, dinfo.getPosRootDomain().getFullLength(), pos_root_cell_, pa);
-        pfunc_ep_ep(epi_org_.getPointer(), n_loc_tot_, epj_tmp, n_epj_tmp, force);
+        pfunc_ep_ep(getEpiOrgPointer(), n_loc_tot_, epj_tmp, n_epj_tmp, force);
         delete [] epj_tmp;
     }
 
@@ -2254,7 +3722,40 @@ namespace ParticleSimulator{
         bool pa[DIMENSION];
         dinfo.getPeriodicAxis(pa);
         AllGatherParticle(epj_tmp, n_epj_tmp, epj_org_.getPointer(), n_loc_tot_, dinfo.getPosRootDomain().getFullLength(), pos_root_cell_, pa);
-        pfunc_ep_ep(epi_org_.getPointer(), n_loc_tot_, epj_tmp, n_epj_tmp, force_org_.getPointer());
+        pfunc_ep_ep(getEpiOrgPointer(), n_loc_tot_, epj_tmp, n_epj_tmp, force_org_.getPointer());
         delete [] epj_tmp;
     }
+
+    template<class TSM, class Tforce, class Tepi, class Tepj,
+	     class Tmomloc, class Tmomglb, class Tspj>
+    template<class Tfunc>
+    void TreeForForce<TSM, Tforce, Tepi, Tepj, Tmomloc, Tmomglb, Tspj>::
+    traverseLocalTree(Tfunc & func) const {
+        if(n_loc_tot_ <= 0) return;
+        std::vector<U32> adr_stack(1, 0);
+        std::vector<F64vec> center_stack(1, center_);
+        std::vector<F64> half_stack(1, length_*0.5);
+        while(!adr_stack.empty()){
+            const TreeCell<Tmomloc> & tc = tc_loc_[adr_stack.back()];
+            const F64vec center = center_stack.back();
+            const F64 half_length = half_stack.back();
+            adr_stack.pop_back();
+            center_stack.pop_back();
+            half_stack.pop_back();
+            if(tc.n_ptcl_ <= 0) continue;
+            if(!func.openCell(center, half_length)){
+                func.visitCell(tc.mom_, center, half_length);
+            }
+            else if(tc.isLeaf(n_leaf_limit_)){
+                for(S32 ip=0; ip<tc.n_ptcl_; ip++) func.visitParticle(epj_sorted_[tc.adr_ptcl_+ip]);
+            }
+            else{
+                for(S32 ic=0; ic<N_CHILDREN; ic++){
+                    adr_stack.push_back(tc.adr_tc_+ic);
+                    center_stack.push_back(center + SHIFT_CENTER[ic]*half_length);
+                    half_stack.push_back(half_length*0.5);
+                }
+            }
+        }
+    }
 }
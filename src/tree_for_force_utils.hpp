@@ -544,6 +544,65 @@ namespace ParticleSimulator{
         }
     }
 
+    // n_active_cum[i]: # of active particles before the i-th particle of the
+    // local tree. The groups address the active particles only.
+    template<class Tipg, class Ttc>
+    inline void MakeIPGroupActive(ReallocatableArray<Tipg> & ipg_first,
+                                  const ReallocatableArray<Ttc> & tc_first,
+                                  const ReallocatableArray<S32> & n_active_cum,
+                                  const S32 adr_tc,
+                                  const S32 n_grp_limit){
+        const Ttc * tc_tmp = tc_first.getPointer() + adr_tc;
+        const S32 adr_ptcl = tc_tmp->adr_ptcl_;
+        const S32 n_tmp = n_active_cum[adr_ptcl+tc_tmp->n_ptcl_] - n_active_cum[adr_ptcl];
+        if(n_tmp == 0) return;
+        else if( n_tmp <= n_grp_limit || tc_tmp->isLeaf(n_grp_limit) ){
+            ipg_first.increaseSize();
+            ipg_first.back().n_ptcl_ = n_tmp;
+            ipg_first.back().adr_ptcl_ = n_active_cum[adr_ptcl];
+            return;
+        }
+        else{
+            S32 adr_tc_tmp = tc_tmp->adr_tc_;
+            for(S32 i=0; i<N_CHILDREN; i++){
+                MakeIPGroupActive<Tipg, Ttc>
+                    (ipg_first, tc_first, n_active_cum, adr_tc_tmp+i, n_grp_limit);
+            }
+        }
+    }
+
+    // Merge up to n_batch consecutive i-groups into one, as long as the merged
+    // group has at most n_grp_limit particles and its box is not much larger
+    // than those of its parts (so that their j-lists mostly overlap).
+    template<class Tipg>
+    inline void MergeIPGroup(ReallocatableArray<Tipg> & ipg_first,
+                             const S32 n_grp_limit,
+                             const S32 n_batch){
+        const S32 n_ipg = ipg_first.size();
+        if(n_ipg <= 1) return;
+        S32 adr_head = 0;
+        S32 n_merged = 1;
+        for(S32 i=1; i<n_ipg; i++){
+            const Tipg & ipg_head = ipg_first[adr_head];
+            F64ort box_merged = ipg_head.vertex_;
+            box_merged.merge(ipg_first[i].vertex_);
+            const F64 len_max = std::max(ipg_head.vertex_.getFullLength().getMax(),
+                                         ipg_first[i].vertex_.getFullLength().getMax());
+            if( n_merged < n_batch
+                && ipg_head.n_ptcl_ + ipg_first[i].n_ptcl_ <= n_grp_limit
+                && ipg_head.adr_ptcl_ + ipg_head.n_ptcl_ == ipg_first[i].adr_ptcl_
+                && box_merged.getFullLength().getMax() <= 2.0 * len_max ){
+                ipg_first[adr_head].merge(ipg_first[i]);
+                n_merged++;
+            }
+            else{
+                ipg_first[++adr_head] = ipg_first[i];
+                n_merged = 1;
+            }
+        }
+        ipg_first.resizeNoInitialize(adr_head+1);
+    }
+
 
     template<class Tep>
     void CheckMortonSort(const S32 n,
@@ -890,6 +949,36 @@ namespace ParticleSimulator{
         }
     }
     
+    template<class Tep>
+    inline void PredictInteractionList(TagPredict,
+                                       ReallocatableArray<Tep> & ep_list,
+                                       const F64 dt){
+        const S32 n = ep_list.size();
+        for(S32 i=0; i<n; i++) ep_list[i].predict(dt);
+    }
+    template<class Tep>
+    inline void PredictInteractionList(TagNoPredict,
+                                       ReallocatableArray<Tep> & ep_list,
+                                       const F64 dt){}
+
+    template<class Tep>
+    inline void ShiftPos(TagSetPos,
+                         Tep * ep,
+                         const S32 n,
+                         const F64vec & shift){
+        for(S32 i=0; i<n; i++) ep[i].setPos( F64vec(ep[i].getPos()) - shift );
+    }
+    template<class Tep>
+    inline void ShiftPos(TagNoSetPos,
+                         Tep * ep,
+                         const S32 n,
+                         const F64vec & shift){}
+
+    inline bool IsSetPos(TagSetPos){ return true; }
+    inline bool IsSetPos(TagNoSetPos){ return false; }
+    inline bool IsPredict(TagPredict){ return true; }
+    inline bool IsPredict(TagNoPredict){ return false; }
+
     /////////////////////////////
     /// MAKE INTERACTION LIST ///
     template<class Ttc, class Ttp, class Tep, class Tsp>
@@ -1070,6 +1159,51 @@ namespace ParticleSimulator{
     }
 
 
+    // same as above, but also records the address of each particle in ep_first
+    template<class Ttc, class Tep2, class Tep3>
+    inline void MakeListUsingOuterBoundary(const Ttc * tc_first,
+                                           const S32 adr_tc,
+                                           const Tep2 * ep_first,
+                                           ReallocatableArray<Tep3> & ep_list,
+                                           ReallocatableArray<S32> & adr_list,
+                                           const F64ort & pos_target_box, // position of domain
+                                           const S32 n_leaf_limit,
+                                           const F64vec & shift = F64vec(0.0) ){
+        U32 open_bits = 0;
+        for(S32 i=0; i<N_CHILDREN; i++){
+            open_bits |= (pos_target_box.overlapped( tc_first[adr_tc+i].mom_.getVertexOut() ) << i);
+        }
+        for(S32 i=0; i<N_CHILDREN; i++){
+            if( (open_bits>>i) & 0x1){
+                const S32 adr_tc_child = adr_tc + i;
+                const Ttc * tc_child = tc_first + adr_tc_child;
+                const S32 n_child = tc_child->n_ptcl_;
+                if(n_child == 0) continue;
+                if( !(tc_child->isLeaf(n_leaf_limit)) ){
+                    MakeListUsingOuterBoundary<Ttc, Tep2, Tep3>
+                        (tc_first, tc_first[adr_tc_child].adr_tc_, ep_first, ep_list, adr_list,
+                         pos_target_box, n_leaf_limit, shift);
+                }
+                else{
+                    S32 adr_ptcl_tmp = tc_child->adr_ptcl_;
+                    ep_list.reserveEmptyAreaAtLeast( n_child );
+                    adr_list.reserveEmptyAreaAtLeast( n_child );
+                    for(S32 ip=0; ip<n_child; ip++, adr_ptcl_tmp++){
+                        const F64vec pos_tmp = ep_first[adr_ptcl_tmp].getPos();
+                        const F64 size_tmp = ep_first[adr_ptcl_tmp].getRSearch();
+                        const F64 dis_sq_tmp = pos_target_box.getDistanceMinSQ(pos_tmp);
+                        if(dis_sq_tmp > size_tmp*size_tmp) continue;
+                        ep_list.increaseSize();
+                        ep_list.back() = ep_first[adr_ptcl_tmp];
+                        const F64vec pos_new = ep_list.back().getPos() + shift;
+                        ep_list.back().setPos(pos_new);
+                        adr_list.pushBackNoCheck(adr_ptcl_tmp);
+                    }
+                }
+            }
+        }
+    }
+
     // NEW functions for 
     template<class Ttc, class Tep2, class Tep3>
     inline void MakeListUsingOuterBoundaryAndInnerBoundary(const Ttc * tc_first,
@@ -1123,6 +1257,48 @@ namespace ParticleSimulator{
     }
 
 
+    // same criterion as MakeListUsingOuterBoundaryAndInnerBoundary, but only
+    // the addresses of the particles in ep_first are listed
+    template<class Ttc, class Tep2>
+    inline void MakeAdrListUsingOuterBoundaryAndInnerBoundary(const Ttc * tc_first,
+                                                              const S32 adr_tc,
+                                                              const Tep2 * ep_first,
+                                                              ReallocatableArray<S32> & adr_list,
+                                                              const F64ort & pos_target_box_out,
+                                                              const F64ort & pos_target_box_in,
+                                                              const S32 n_leaf_limit){
+        U32 open_bits = 0;
+        for(S32 i=0; i<N_CHILDREN; i++){
+            open_bits |= ( (pos_target_box_out.overlapped( tc_first[adr_tc+i].mom_.getVertexIn() ) 
+                            || pos_target_box_in.overlapped( tc_first[adr_tc+i].mom_.getVertexOut() ) )
+                           << i);
+        }
+        for(S32 i=0; i<N_CHILDREN; i++){
+            if( (open_bits>>i) & 0x1){
+                const S32 adr_tc_child = adr_tc + i;
+                const Ttc * tc_child = tc_first + adr_tc_child;
+                const S32 n_child = tc_child->n_ptcl_;
+                if(n_child == 0) continue;
+                if( !(tc_child->isLeaf(n_leaf_limit)) ){
+                    MakeAdrListUsingOuterBoundaryAndInnerBoundary<Ttc, Tep2>
+                        (tc_first, tc_first[adr_tc_child].adr_tc_, ep_first, adr_list,
+                         pos_target_box_out, pos_target_box_in, n_leaf_limit);
+                }
+                else{
+                    S32 adr_ptcl_tmp = tc_child->adr_ptcl_;
+                    adr_list.reserveEmptyAreaAtLeast( n_child );
+                    for(S32 ip=0; ip<n_child; ip++, adr_ptcl_tmp++){
+                        const F64vec pos_tmp = ep_first[adr_ptcl_tmp].getPos();
+                        const F64 size_tmp = ep_first[adr_ptcl_tmp].getRSearch();
+                        const F64 dis_sq_tmp = pos_target_box_in.getDistanceMinSQ(pos_tmp);
+                        if( pos_target_box_out.notOverlapped(pos_tmp) && dis_sq_tmp > size_tmp*size_tmp) continue;
+                        adr_list.pushBackNoCheck(adr_ptcl_tmp);
+                    }
+                }
+            }
+        }
+    }
+
     template<class Ttc, class Tep2, class Tep3>
     inline void MakeListUsingInnerBoundary(const Ttc * tc_first,
                                            const S32 adr_tc,
@@ -0,0 +1,152 @@
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cmath>
+
+#include <particle_simulator.hpp>
+
+// Chains of particles along x, 0.01 apart, linked with 0.015. The chains
+// are spread over the domains, so that their groups have to be merged
+// across the processes.
+
+class FoFParticle {
+public:
+    PS::S64    id;
+    PS::S32    chain;
+    PS::F64    mass;
+    PS::F64vec pos;
+
+    PS::F64vec getPos() const {
+        return this->pos;
+    }
+
+    void setPos(const PS::F64vec & pos) {
+        this->pos = pos;
+    }
+
+    PS::F64 getCharge() const {
+        return this->mass;
+    }
+};
+
+// chain c at y = z = 0.25 + 0.5 c; with gap, x in (0.4, 0.6) is left out
+template <class Tptcl>
+void generateChain(Tptcl & system,
+                   PS::S32 n_chain,
+                   bool gap)
+{
+    std::vector<FoFParticle> ptcl;
+    for(PS::S32 c = 0; c < n_chain; c++) {
+        for(PS::S32 k = 0; k < 100; k++) {
+            FoFParticle p;
+            p.pos   = PS::F64vec(0.005 + 0.01 * k, 0.25 + 0.5 * c, 0.25 + 0.5 * c);
+            if(gap && p.pos.x > 0.4 && p.pos.x < 0.6) continue;
+            p.id    = ptcl.size();
+            p.chain = c;
+            p.mass  = 1.0;
+            ptcl.push_back(p);
+        }
+    }
+    PS::S32 rank = PS::Comm::getRank();
+    PS::S32 size = PS::Comm::getNumberOfProc();
+    PS::S32 ntot = ptcl.size();
+    PS::S32 ibgn = (ntot * rank) / size;
+    PS::S32 iend = (ntot * (rank + 1)) / size;
+    system.setNumberOfParticleLocal(iend - ibgn);
+    for(PS::S32 i = ibgn; i < iend; i++)
+        system[i - ibgn] = ptcl[i];
+}
+
+// all the members of a chain are in the same group, n_group groups of
+// n_member particles in total
+template <class Tptcl>
+bool checkGroup(PS::FriendOfFriend & fof,
+                Tptcl & system,
+                PS::S32 n_chain,
+                PS::S64 n_group,
+                PS::S64 n_member)
+{
+    bool success = (fof.getNumberOfGroupGlobal() == n_group);
+    PS::S32 nloc = system.getNumberOfParticleLocal();
+    std::vector<PS::F64> id_min(n_chain), id_max(n_chain);
+    for(PS::S32 c = 0; c < n_chain; c++) {
+        PS::F64 id_min_loc = 1e30;
+        PS::F64 id_max_loc = -1e30;
+        for(PS::S32 i = 0; i < nloc; i++) {
+            if(system[i].chain != c) continue;
+            const PS::F64 id = (PS::F64)fof.getGroupId(i);
+            id_min_loc = std::min(id_min_loc, id);
+            id_max_loc = std::max(id_max_loc, id);
+        }
+        id_min[c] = PS::Comm::getMinValue(id_min_loc);
+        id_max[c] = PS::Comm::getMaxValue(id_max_loc);
+        success = success && (id_min[c] == id_max[c]);
+    }
+    for(PS::S32 c = 1; c < n_chain; c++)
+        success = success && (id_min[c] != id_min[0]);
+    bool success_loc = true;
+    for(PS::S32 i = 0; i < fof.getNumberOfGroupLocal(); i++)
+        success_loc = success_loc && (fof.getGroup(i).n_ptcl_ == n_member)
+            && (fof.getGroup(i).mass_ == (PS::F64)n_member);
+    return PS::Comm::synchronizeConditionalBranchAND(success && success_loc);
+}
+
+int main(int argc, char **argv)
+{
+    PS::Initialize(argc, argv);
+
+    PS::S32    nmem = 1024;
+    PS::F64    llen = 0.015;
+    PS::S32    code = 0;
+
+    // two separated chains: two groups
+    {
+        PS::DomainInfo dinfo;
+        PS::ParticleSystem<FoFParticle> system;
+        PS::FriendOfFriend fof;
+        dinfo.initialize();
+        system.initialize();
+        system.createParticle(nmem);
+        generateChain(system, 2, false);
+        dinfo.decomposeDomainAll(system);
+        system.exchangeParticle(dinfo);
+        fof.calcGroup(system, dinfo, llen);
+        code = checkGroup(fof, system, 2, 2, 100) ? code : (code | 1);
+    }
+
+    // a chain cut in the middle: two groups without a periodic boundary
+    {
+        PS::DomainInfo dinfo;
+        PS::ParticleSystem<FoFParticle> system;
+        PS::FriendOfFriend fof;
+        dinfo.initialize();
+        system.initialize();
+        system.createParticle(nmem);
+        generateChain(system, 1, true);
+        dinfo.decomposeDomainAll(system);
+        system.exchangeParticle(dinfo);
+        fof.calcGroup(system, dinfo, llen);
+        code = (fof.getNumberOfGroupGlobal() == 2) ? code : (code | (1 << 1));
+    }
+
+    // and one group across the periodic boundary in x
+    {
+        PS::DomainInfo dinfo;
+        PS::ParticleSystem<FoFParticle> system;
+        PS::FriendOfFriend fof;
+        dinfo.initialize();
+        system.initialize();
+        system.createParticle(nmem);
+        dinfo.setBoundaryCondition(PS::BOUNDARY_CONDITION_PERIODIC_X);
+        dinfo.setPosRootDomain(PS::F64vec(0.0), PS::F64vec(1.0));
+        generateChain(system, 1, true);
+        dinfo.decomposeDomainAll(system);
+        system.exchangeParticle(dinfo);
+        fof.calcGroup(system, dinfo, llen);
+        code = checkGroup(fof, system, 1, 1, 80) ? code : (code | (1 << 2));
+    }
+
+    PS::Finalize();
+
+    return code;
+}
@@ -0,0 +1,155 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+#include <particle_simulator.hpp>
+#include "../../basic_particle.hpp"
+#include "../check_particle_system.hpp"
+
+typedef BasicParticle32                            FP;
+
+template <class Tptcl>
+void generateSphere(PS::U32 seed,
+                    PS::S32 ntot,
+                    Tptcl & system,
+                    PS::F64 radius,
+                    PS::F64vec center)
+{
+    PS::S32 rank = PS::Comm::getRank();
+    PS::S32 size = PS::Comm::getNumberOfProc();
+
+    PS::S32 ibgn = (ntot * rank) / size;
+    PS::S32 iend = (ntot * (rank + 1)) / size;
+    PS::S32 nloc = iend - ibgn;
+    PS::MT::init_genrand(seed);
+    for(PS::S32 i = 0; i < nloc; i++)
+        system[i].generateSphere(i+ibgn, radius, center);
+    system.setNumberOfParticleLocal(nloc);
+
+    return;
+}
+
+template <class Tptcl>
+bool checkSameIdList(PS::ParticleSystem<Tptcl> & system,
+                     const std::vector<PS::S64> & id,
+                     bool keep_order)
+{
+    PS::S32 nloc = system.getNumberOfParticleLocal();
+    std::vector<PS::S64> id_sys(nloc), id_ref(id);
+    for(PS::S32 i = 0; i < nloc; i++)
+        id_sys[i] = system[i].id;
+    if(!keep_order) {
+        std::sort(id_sys.begin(), id_sys.end());
+        std::sort(id_ref.begin(), id_ref.end());
+    }
+    return PS::Comm::synchronizeConditionalBranchAND(id_sys == id_ref);
+}
+
+int main(int argc, char **argv)
+{
+    PS::Initialize(argc, argv);
+
+    PS::S32    nmem = 131072;
+    PS::S32    ntot = 83927;
+    PS::F64    prad = 3.1;
+    PS::F32vec pcen(1.0, -10.0, 199.8);
+    PS::U32    seed = PS::Comm::getRank();
+    PS::S32    code = 0;
+
+    PS::ParticleSystem<FP> bp;
+    std::vector<PS::S64> id;
+    std::vector<PS::S32> idx;
+
+    bp.initialize();
+    bp.createParticle(nmem);
+    generateSphere(seed, ntot, bp, prad, pcen);
+    for(PS::S32 i = 0; i < bp.getNumberOfParticleLocal(); i++)
+        id.push_back(bp[i].id);
+
+    // every third particle, in reverse order, with keep_order
+    {
+        std::vector<PS::S64> id_new;
+        idx.clear();
+        for(PS::S32 i = bp.getNumberOfParticleLocal() - 1; i >= 0; i--) {
+            if(i % 3 == 0)
+                idx.push_back(i);
+        }
+        for(size_t i = 0; i < id.size(); i++) {
+            if(i % 3 != 0)
+                id_new.push_back(id[i]);
+        }
+        id = id_new;
+        PS::S64 n_mod = bp.getNumberOfModification();
+        bp.removeParticle(&idx[0], idx.size(), true);
+        bool success = checkSameIdList(bp, id, true);
+        success = success && (bp.getNumberOfModification() > n_mod);
+        code = success ? code : (code | 1);
+    }
+
+    // a block at the head and one at the tail, without keep_order
+    {
+        PS::S32 nloc = bp.getNumberOfParticleLocal();
+        PS::S32 nrem = std::min(1000, nloc / 4);
+        std::vector<PS::S64> id_new;
+        idx.clear();
+        for(PS::S32 i = 0; i < nrem; i++) {
+            idx.push_back(i);
+            idx.push_back(nloc - 1 - 2 * i);
+        }
+        std::vector<bool> removed(nloc, false);
+        for(size_t i = 0; i < idx.size(); i++)
+            removed[idx[i]] = true;
+        for(PS::S32 i = 0; i < nloc; i++) {
+            if(!removed[i])
+                id_new.push_back(id[i]);
+        }
+        id = id_new;
+        PS::S64 n_mod = bp.getNumberOfModification();
+        bp.removeParticle(&idx[0], idx.size());
+        bool success = checkSameIdList(bp, id, false);
+        success = success && (bp.getNumberOfModification() > n_mod);
+        code = success ? code : (code | (1 << 1));
+    }
+
+    // addParticle and addOneParticle append in order
+    {
+        PS::S32 nadd = 5000;
+        std::vector<FP> ptcl_add(nadd);
+        for(PS::S32 i = 0; i < nadd; i++) {
+            ptcl_add[i].generateSphere(ntot + i, prad, pcen);
+        }
+        // the order left by the removal above
+        for(PS::S32 i = 0; i < bp.getNumberOfParticleLocal(); i++)
+            id[i] = bp[i].id;
+        PS::S64 n_mod = bp.getNumberOfModification();
+        bp.addParticle(&ptcl_add[0], nadd - 1);
+        bp.addOneParticle(ptcl_add[nadd - 1]);
+        for(PS::S32 i = 0; i < nadd; i++)
+            id.push_back(ntot + i);
+        bool success = checkSameIdList(bp, id, true);
+        success = success && (bp.getNumberOfModification() >= n_mod + 2);
+        code = success ? code : (code | (1 << 2));
+    }
+
+    // beyond the capacity given to createParticle; an empty removal
+    // leaves the particles and the counter alone
+    {
+        std::vector<FP> ptcl_add(nmem);
+        for(PS::S32 i = 0; i < nmem; i++) {
+            ptcl_add[i].generateSphere(2 * ntot + i, prad, pcen);
+        }
+        bp.addParticle(&ptcl_add[0], nmem);
+        for(PS::S32 i = 0; i < nmem; i++)
+            id.push_back(2 * ntot + i);
+        PS::S64 n_mod = bp.getNumberOfModification();
+        bp.removeParticle(&idx[0], 0);
+        bool success = checkSameIdList(bp, id, true);
+        success = success && (bp.getNumberOfModification() == n_mod);
+        code = success ? code : (code | (1 << 3));
+    }
+
+    PS::Finalize();
+
+    return code;
+}
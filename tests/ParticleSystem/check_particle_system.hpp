@@ -34,3 +34,188 @@ namespace ParticleSimulator {
         return success_glb;
     }
 }
+
+// Round trips of the snapshot formats and of addParticle/removeParticle.
+// The particles are gathered on all the processes, sorted by id and
+// compared with those before the write.
+
+template <class Tvec, class Treal>
+class SnapshotParticle {
+public:
+    PS::S64 id;
+    Tvec    pos;
+    Tvec    vel;
+    Treal   mass;
+
+    PS::F64vec getPos() const {
+        return this->pos;
+    }
+
+    void setPos(const PS::F64vec & pos) {
+        this->pos = pos;
+    }
+
+    static const char * getBinaryLayout() {
+        return (sizeof(Treal) == 8) ? "S64 id; F64vec pos; F64vec vel; F64 mass;"
+                                    : "S64 id; F32vec pos; F32vec vel; F32 mass;";
+    }
+
+    void generateSphere(PS::S64 i,
+                        PS::F64 radius) {
+        this->id = i;
+        do {
+            for(PS::S32 k = 0; k < PS::DIMENSION; k++)
+                this->pos[k] = radius * (2.0 * PS::MT::genrand_real2() - 1.0);
+        }while(this->pos * this->pos >= radius * radius);
+        for(PS::S32 k = 0; k < PS::DIMENSION; k++)
+            this->vel[k] = 2.0 * PS::MT::genrand_real2() - 1.0;
+        this->mass = 1.0 + PS::MT::genrand_real2();
+    }
+};
+
+template <class Tptcl>
+class SnapshotCodec {
+public:
+    PS::S32 getNumberOfExtraByte() const {
+        return sizeof(PS::S64) + sizeof(PS::F64);
+    }
+
+    PS::F64vec getVel(const Tptcl & p) const {
+        return p.vel;
+    }
+
+    void setVel(Tptcl & p, const PS::F64vec & v) const {
+        p.vel = v;
+    }
+
+    void packExtra(const Tptcl & p, char * c) const {
+        PS::F64 mass = p.mass;
+        memcpy(c, &p.id, sizeof(PS::S64));
+        memcpy(c + sizeof(PS::S64), &mass, sizeof(PS::F64));
+    }
+
+    void unpackExtra(Tptcl & p, const char * c) const {
+        PS::F64 mass;
+        memcpy(&p.id, c, sizeof(PS::S64));
+        memcpy(&mass, c + sizeof(PS::S64), sizeof(PS::F64));
+        p.mass = mass;
+    }
+};
+
+// types 0, 1 and 2 by id
+template <class Tptcl>
+class SnapshotGadgetAccessor {
+public:
+    void setPos(Tptcl & p, const PS::F64vec & x) const { p.pos = x; }
+    PS::F64vec getPos(const Tptcl & p) const { return p.pos; }
+    void setVel(Tptcl & p, const PS::F64vec & v) const { p.vel = v; }
+    PS::F64vec getVel(const Tptcl & p) const { return p.vel; }
+    void setId(Tptcl & p, const PS::S64 id) const { p.id = id; }
+    PS::S64 getId(const Tptcl & p) const { return p.id; }
+    void setMass(Tptcl & p, const PS::F64 m) const { p.mass = m; }
+    PS::F64 getMass(const Tptcl & p) const { return p.mass; }
+    void setType(Tptcl &, const PS::S32) const {}
+    PS::S32 getType(const Tptcl & p) const { return p.id % 3; }
+};
+
+class SnapshotHeader {
+public:
+    PS::F64 time;
+    PS::S64 n_step;
+
+    void writeBinary(FILE * fp) const {
+        fwrite(&this->time, sizeof(this->time), 1, fp);
+        fwrite(&this->n_step, sizeof(this->n_step), 1, fp);
+    }
+
+    int readBinary(FILE * fp) {
+        fread(&this->time, sizeof(this->time), 1, fp);
+        fread(&this->n_step, sizeof(this->n_step), 1, fp);
+        return -1;
+    }
+};
+
+// the header is read on rank 0 only
+bool checkSameHeader(const SnapshotHeader & header0,
+                     const SnapshotHeader & header1)
+{
+    bool success = (PS::Comm::getRank() != 0)
+        || (header0.time == header1.time && header0.n_step == header1.n_step);
+    return PS::Comm::synchronizeConditionalBranchAND(success);
+}
+
+template <class Tptcl>
+bool compareParticleId(const Tptcl & a, const Tptcl & b)
+{
+    return a.id < b.id;
+}
+
+template <class Tptcl>
+void gatherParticleSortedById(PS::ParticleSystem<Tptcl> & system,
+                              std::vector<Tptcl> & ptcl)
+{
+    PS::S32 nproc = PS::Comm::getNumberOfProc();
+    PS::S32 nloc  = system.getNumberOfParticleLocal();
+    std::vector<PS::S32> n(nproc), n_disp(nproc + 1, 0);
+    PS::Comm::allGather(&nloc, 1, &n[0]);
+    for(PS::S32 i = 0; i < nproc; i++)
+        n_disp[i+1] = n_disp[i] + n[i];
+    ptcl.resize(n_disp[nproc] + 1);
+    PS::Comm::allGatherV(&system[0], nloc, &ptcl[0], &n[0], &n_disp[0]);
+    ptcl.resize(n_disp[nproc]);
+    std::sort(ptcl.begin(), ptcl.end(), compareParticleId<Tptcl>);
+}
+
+// tol_pos and tol_vel are absolute, tol_mass relative
+template <class Tptcl>
+bool checkSameParticle(const std::vector<Tptcl> & ptcl0,
+                       const std::vector<Tptcl> & ptcl1,
+                       PS::F64 tol_pos,
+                       PS::F64 tol_vel,
+                       PS::F64 tol_mass)
+{
+    if(ptcl0.size() != ptcl1.size())
+        return false;
+    for(size_t i = 0; i < ptcl0.size(); i++) {
+        if(ptcl0[i].id != ptcl1[i].id)
+            return false;
+        for(PS::S32 k = 0; k < PS::DIMENSION; k++) {
+            if(std::fabs(ptcl0[i].pos[k] - ptcl1[i].pos[k]) > tol_pos)
+                return false;
+            if(std::fabs(ptcl0[i].vel[k] - ptcl1[i].vel[k]) > tol_vel)
+                return false;
+        }
+        if(std::fabs(ptcl0[i].mass - ptcl1[i].mass) > tol_mass * std::fabs(ptcl0[i].mass))
+            return false;
+    }
+    return true;
+}
+
+// ptcl1 (read with region) holds the particles of ptcl0 inside region, up to
+// tol_pos at its boundary
+template <class Tptcl>
+bool checkSameParticleInRegion(const std::vector<Tptcl> & ptcl0,
+                               const std::vector<Tptcl> & ptcl1,
+                               const PS::F64ort & region,
+                               PS::F64 tol_pos)
+{
+    size_t j = 0;
+    for(size_t i = 0; i < ptcl0.size(); i++) {
+        bool inside = true, outside = false;
+        for(PS::S32 k = 0; k < PS::DIMENSION; k++) {
+            inside  = inside  && (ptcl0[i].pos[k] >= region.low_[k] + tol_pos) && (ptcl0[i].pos[k] < region.high_[k] - tol_pos);
+            outside = outside || (ptcl0[i].pos[k] < region.low_[k] - tol_pos) || (ptcl0[i].pos[k] >= region.high_[k] + tol_pos);
+        }
+        bool found = (j < ptcl1.size() && ptcl1[j].id == ptcl0[i].id);
+        if((inside && !found) || (outside && found))
+            return false;
+        if(found) {
+            for(PS::S32 k = 0; k < PS::DIMENSION; k++) {
+                if(std::fabs(ptcl0[i].pos[k] - ptcl1[j].pos[k]) > tol_pos)
+                    return false;
+            }
+            j++;
+        }
+    }
+    return (j == ptcl1.size());
+}
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+#include <particle_simulator.hpp>
+#include "../check_particle_system.hpp"
+
+typedef PS::F32vec                                 Tvec;
+typedef PS::F32                                    Treal;
+typedef SnapshotParticle<Tvec, Treal>              FP;
+
+template <class Tptcl>
+void generateSphere(PS::U32 seed,
+                    PS::S32 ntot,
+                    Tptcl & system,
+                    PS::F64 radius)
+{
+    PS::S32 rank = PS::Comm::getRank();
+    PS::S32 size = PS::Comm::getNumberOfProc();
+
+    PS::S32 ibgn = (ntot * rank) / size;
+    PS::S32 iend = (ntot * (rank + 1)) / size;
+    PS::S32 nloc = iend - ibgn;
+    PS::MT::init_genrand(seed);
+    system.setNumberOfParticleLocal(nloc);
+    for(PS::S32 i = 0; i < nloc; i++)
+        system[i].generateSphere(i+ibgn, radius);
+
+    return;
+}
+
+bool checkSameDomain(PS::DomainInfo & dinfo0,
+                     PS::DomainInfo & dinfo1)
+{
+    bool success = true;
+    for(PS::S32 i = 0; i < PS::Comm::getNumberOfProc(); i++) {
+        for(PS::S32 k = 0; k < PS::DIMENSION; k++) {
+            success = success && (dinfo0.getPosDomain(i).low_[k]  == dinfo1.getPosDomain(i).low_[k]);
+            success = success && (dinfo0.getPosDomain(i).high_[k] == dinfo1.getPosDomain(i).high_[k]);
+        }
+    }
+    return success;
+}
+
+int main(int argc, char **argv)
+{
+    PS::Initialize(argc, argv);
+
+    PS::S32    nmem = 131072;
+    PS::S32    ntot = 83927;
+    PS::F64    prad = 1.0;
+    PS::U32    seed = PS::Comm::getRank();
+    PS::S32    code = 0;
+
+    PS::DomainInfo dinfo;
+    PS::ParticleSystem<FP> system;
+    SnapshotHeader header;
+    std::vector<FP> ptcl0, ptcl1;
+
+    dinfo.initialize();
+    system.initialize();
+    system.createParticle(nmem);
+    generateSphere(seed, ntot, system, prad);
+
+    dinfo.decomposeDomainAll(system);
+    system.exchangeParticle(dinfo);
+    gatherParticleSortedById(system, ptcl0);
+
+    header.time   = 1.25;
+    header.n_step = 1024;
+
+    // checkpoint: the particles, the header and the domains
+    {
+        PS::DomainInfo dinfo_read;
+        PS::ParticleSystem<FP> system_read;
+        SnapshotHeader header_read;
+        dinfo_read.initialize();
+        system_read.initialize();
+        system.writeCheckpoint("snap.chk", dinfo, header);
+        system_read.readCheckpoint("snap.chk", dinfo_read, header_read);
+        gatherParticleSortedById(system_read, ptcl1);
+        bool success = checkSameParticle(ptcl0, ptcl1, 0.0, 0.0, 0.0);
+        success = success && checkSameHeader(header, header_read);
+        success = success && checkSameDomain(dinfo, dinfo_read);
+        code = success ? code : (code | 1);
+    }
+
+    PS::Comm::barrier();
+    if(PS::Comm::getRank() == 0) {
+        remove("snap.chk");
+    }
+
+    PS::Finalize();
+
+    return code;
+}
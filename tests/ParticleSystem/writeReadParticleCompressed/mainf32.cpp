@@ -0,0 +1,81 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+#include <particle_simulator.hpp>
+#include "../check_particle_system.hpp"
+
+typedef PS::F32vec                                 Tvec;
+typedef PS::F32                                    Treal;
+typedef SnapshotParticle<Tvec, Treal>              FP;
+
+template <class Tptcl>
+void generateSphere(PS::U32 seed,
+                    PS::S32 ntot,
+                    Tptcl & system,
+                    PS::F64 radius)
+{
+    PS::S32 rank = PS::Comm::getRank();
+    PS::S32 size = PS::Comm::getNumberOfProc();
+
+    PS::S32 ibgn = (ntot * rank) / size;
+    PS::S32 iend = (ntot * (rank + 1)) / size;
+    PS::S32 nloc = iend - ibgn;
+    PS::MT::init_genrand(seed);
+    system.setNumberOfParticleLocal(nloc);
+    for(PS::S32 i = 0; i < nloc; i++)
+        system[i].generateSphere(i+ibgn, radius);
+
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    PS::Initialize(argc, argv);
+
+    PS::S32    nmem = 131072;
+    PS::S32    ntot = 83927;
+    PS::F64    prad = 1.0;
+    PS::U32    seed = PS::Comm::getRank();
+    PS::S32    code = 0;
+
+    PS::DomainInfo dinfo;
+    PS::ParticleSystem<FP> system;
+    SnapshotCodec<FP> codec;
+    std::vector<FP> ptcl0, ptcl1;
+
+    dinfo.initialize();
+    system.initialize();
+    system.createParticle(nmem);
+    generateSphere(seed, ntot, system, prad);
+
+    dinfo.decomposeDomainAll(system);
+    system.exchangeParticle(dinfo);
+    gatherParticleSortedById(system, ptcl0);
+
+    // compressed, all and a subvolume
+    {
+        PS::ParticleSystem<FP> system_read;
+        PS::F64ort region(PS::F64vec(-0.5), PS::F64vec(0.3));
+        system_read.initialize();
+        system.writeParticleCompressed("snap.cmp", codec, 20, 16, 4096);
+        system_read.readParticleCompressed("snap.cmp", codec);
+        gatherParticleSortedById(system_read, ptcl1);
+        code = checkSameParticle(ptcl0, ptcl1, 4e-6, 4e-5, 0.0) ? code : (code | 1);
+        system_read.readParticleCompressed("snap.cmp", codec, region);
+        gatherParticleSortedById(system_read, ptcl1);
+        code = checkSameParticleInRegion(ptcl0, ptcl1, region, 4e-6) ? code : (code | (1 << 1));
+    }
+
+    PS::Comm::barrier();
+    if(PS::Comm::getRank() == 0) {
+        remove("snap.cmp");
+    }
+
+    PS::Finalize();
+
+    return code;
+}
@@ -0,0 +1,162 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+#include <particle_simulator.hpp>
+
+class MassParticle {
+public:
+    PS::F64vec pos;
+    PS::F64    mass;
+
+    PS::F64vec getPos() const {
+        return this->pos;
+    }
+
+    void setPos(const PS::F64vec & pos_new) {
+        this->pos = pos_new;
+    }
+
+    PS::F64 getCharge() const {
+        return this->mass;
+    }
+};
+
+typedef PS::ParticleSystem<MassParticle> Tpsys;
+
+PS::F64 kernel(PS::F64 q) {
+    if(q < 1.0) return 1.0 - 1.5*q*q + 0.75*q*q*q;
+    if(q < 2.0) return 0.25*(2.0-q)*(2.0-q)*(2.0-q);
+    return 0.0;
+}
+
+void generateCube(PS::S32 ntot,
+                  Tpsys & system,
+                  PS::F64 low,
+                  PS::F64 high)
+{
+    PS::S32 rank = PS::Comm::getRank();
+    PS::S32 size = PS::Comm::getNumberOfProc();
+
+    PS::S32 ibgn = (ntot * rank) / size;
+    PS::S32 iend = (ntot * (rank + 1)) / size;
+    PS::S32 nloc = iend - ibgn;
+    system.setNumberOfParticleLocal(nloc);
+    for(PS::S32 i = 0; i < nloc; i++) {
+        for(PS::S32 k = 0; k < PS::DIMENSION; k++)
+            system[i].pos[k] = low + (high - low) * PS::MT::genrand_res53();
+        system[i].mass = 1.0 + PS::MT::genrand_res53();
+    }
+
+    return;
+}
+
+PS::F64 getImageMass(const PS::ProjectedDensityRenderer & renderer) {
+    const std::vector<PS::F64> & image = renderer.getImage();
+    PS::F64 sum = 0.0;
+    for(size_t i = 0; i < image.size(); i++)
+        sum += image[i];
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    PS::Initialize(argc, argv);
+
+    PS::S32    nmem = 65536;
+    PS::S32    ntot = 20000;
+    PS::F64    tol  = 1e-10;
+    PS::S32    rank = PS::Comm::getRank();
+    PS::S32    code = 0;
+
+    PS::DomainInfo dinfo;
+    Tpsys system;
+
+    dinfo.initialize();
+    system.initialize();
+    system.createParticle(nmem);
+    PS::MT::init_genrand(rank);
+    generateCube(ntot, system, 0.25, 0.75);
+
+    dinfo.decomposeDomainAll(system);
+    system.exchangeParticle(dinfo);
+
+    PS::F64 mass_all  = 0.0;
+    PS::F64 mass_near = 0.0;
+    for(PS::S32 i = 0; i < system.getNumberOfParticleLocal(); i++) {
+        mass_all += system[i].mass;
+        if(system[i].pos[2] < 0.5)
+            mass_near += system[i].mass;
+    }
+    mass_all  = PS::Comm::getSum(mass_all);
+    mass_near = PS::Comm::getSum(mass_near);
+
+    // every kernel inside the image: all the mass is deposited, also by the
+    // cells (up to four pixels)
+    {
+        PS::ProjectedDensityRenderer renderer;
+        renderer.initialize(64, 64, PS::F64ort(PS::F64vec(0.0), PS::F64vec(1.0)));
+        renderer.setSmoothingLength(0.02);
+        renderer.render(system, dinfo, 4.0);
+        if(rank == 0 && std::abs(getImageMass(renderer) - mass_all) > tol * mass_all)
+            code |= 1;
+    }
+
+    // depth cut along z: only the particles with z < 0.5, the cells across
+    // z = 0.5 are opened
+    {
+        PS::ProjectedDensityRenderer renderer;
+        renderer.initialize(64, 64, PS::F64ort(PS::F64vec(0.0), PS::F64vec(1.0, 1.0, 0.5)));
+        renderer.setSmoothingLength(0.02);
+        renderer.render(system, dinfo, 4.0);
+        if(rank == 0 && std::abs(getImageMass(renderer) - mass_near) > tol * mass_all)
+            code |= 2;
+    }
+
+    // a kernel across the edge of the image: only the part inside the
+    // image is deposited
+    {
+        PS::F64 pixel = 0.1;
+        PS::F64 h     = 0.1;
+        PS::F64vec pos(-0.12, 0.55, 0.5);
+        system.setNumberOfParticleLocal(rank == 0 ? 1 : 0);
+        if(rank == 0) {
+            system[0].pos  = pos;
+            system[0].mass = 1.0;
+        }
+        dinfo.decomposeDomainAll(system);
+        system.exchangeParticle(dinfo);
+
+        PS::ProjectedDensityRenderer renderer;
+        renderer.initialize(10, 10, PS::F64ort(PS::F64vec(0.0), PS::F64vec(1.0)));
+        renderer.setSmoothingLength(h);
+        renderer.render(system, dinfo);
+
+        PS::F64 w_sum = 0.0;
+        PS::F64 w_in  = 0.0;
+        for(PS::S32 iy = -5; iy < 15; iy++) {
+            for(PS::S32 ix = -5; ix < 15; ix++) {
+                PS::F64 dx = (ix + 0.5) * pixel - pos[0];
+                PS::F64 dy = (iy + 0.5) * pixel - pos[1];
+                PS::F64 w  = kernel(std::sqrt(dx*dx + dy*dy) / h);
+                w_sum += w;
+                if(ix >= 0 && ix < 10 && iy >= 0 && iy < 10)
+                    w_in += w;
+            }
+        }
+        if(rank == 0) {
+            if(std::abs(getImageMass(renderer) - w_in / w_sum) > tol * w_in / w_sum)
+                code |= 4;
+            for(PS::S32 iy = 0; iy < 10; iy++)
+                for(PS::S32 ix = 1; ix < 10; ix++)
+                    if(renderer.getImage()[iy*10 + ix] != 0.0)
+                        code |= 4;
+        }
+    }
+
+    code = PS::Comm::getMaxValue(code);
+
+    PS::Finalize();
+
+    return code;
+}
@@ -0,0 +1,125 @@
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cmath>
+
+#include <particle_simulator.hpp>
+#include "../check_tree_for_force.hpp"
+
+typedef PS::F64vec                                 Tvec;
+typedef PS::F64                                    Treal;
+typedef PairParticle<Tvec, Treal>                  FP;
+typedef PairEssentialParticle<Tvec, Treal>         EP;
+typedef PairForce<Tvec>                            Force;
+
+template <class Tptcl>
+void generateCube(PS::U32 seed,
+                  PS::S32 ntot,
+                  Tptcl & system,
+                  PS::F64 length)
+{
+    PS::S32 rank = PS::Comm::getRank();
+    PS::S32 size = PS::Comm::getNumberOfProc();
+
+    PS::S32 ibgn = (ntot * rank) / size;
+    PS::S32 iend = (ntot * (rank + 1)) / size;
+    PS::S32 nloc = iend - ibgn;
+    PS::MT::init_genrand(seed);
+    system.setNumberOfParticleLocal(nloc);
+    for(PS::S32 i = 0; i < nloc; i++)
+        system[i].generateCube(i+ibgn, length, 0.02 * length, 0.06 * length);
+
+    return;
+}
+
+// the active particles are given the forces of the full calculation, the
+// others keep what they had
+template <class Tpsys>
+bool checkActiveForce(const Tpsys & system,
+                      const std::vector<Tvec> & acc_all,
+                      const std::vector<PS::S32> & n_ngb_all,
+                      const std::vector<bool> & active,
+                      PS::F64 tolerance)
+{
+    bool success_loc = true;
+    PS::S32 nloc = system.getNumberOfParticleLocal();
+    for(PS::S32 i = 0; i < nloc; i++) {
+        if(active[i]) {
+            const PS::F64vec acc_ref = acc_all[i];
+            const PS::F64vec dacc    = PS::F64vec(system[i].acc) - acc_ref;
+            success_loc = success_loc && (system[i].n_ngb == n_ngb_all[i]);
+            success_loc = success_loc && (dacc * dacc <= tolerance * tolerance * (acc_ref * acc_ref + 1.0));
+        }
+        else {
+            success_loc = success_loc && (system[i].n_ngb == -1);
+            success_loc = success_loc && (system[i].acc[0] == -1.0);
+        }
+    }
+    return PS::Comm::synchronizeConditionalBranchAND(success_loc);
+}
+
+int main(int argc, char **argv)
+{
+    PS::Initialize(argc, argv);
+
+    PS::S32    nmem  = 65536;
+    PS::S32    ntot  = 20000;
+    PS::F64    plen  = 1.0;
+    PS::U32    seed  = PS::Comm::getRank();
+    PS::F64    tol   = 1e-10;
+    PS::S32    code  = 0;
+
+    PS::DomainInfo dinfo;
+    PS::ParticleSystem<FP> system;
+    PS::TreeForForceShort<Force, EP, EP>::Symmetry tree;
+
+    dinfo.initialize();
+    system.initialize();
+    system.createParticle(nmem);
+    generateCube(seed, ntot, system, plen);
+
+    dinfo.decomposeDomainAll(system);
+    system.exchangeParticle(dinfo);
+
+    tree.initialize(ntot);
+    std::vector<Tvec>    acc_all;
+    std::vector<PS::S32> n_ngb_all;
+    tree.calcForceAllAndWriteBack(CalcPairForce<Tvec, Treal>(), system, dinfo);
+    copyForce(system, acc_all, n_ngb_all);
+
+    // every third particle and a block at the tail (none on rank 1)
+    PS::S32 nloc = system.getNumberOfParticleLocal();
+    std::vector<bool>    active(nloc, false);
+    std::vector<PS::S32> adr_active;
+    for(PS::S32 i = 0; i < nloc; i++) {
+        active[i] = (PS::Comm::getRank() != 1) && (i % 3 == 1 || i >= nloc - 100);
+        if(active[i]) adr_active.push_back(i);
+        system[i].acc   = -1.0;
+        system[i].n_ngb = -1;
+    }
+    PS::S32 n_active = adr_active.size();
+    adr_active.push_back(0); // &adr_active[0] is valid with no active particle
+
+    tree.calcForceActiveAndWriteBack(CalcPairForce<Tvec, Treal>(), system, &adr_active[0], n_active);
+    code = checkActiveForce(system, acc_all, n_ngb_all, active, tol) ? code : (code | 1);
+
+    // a second, smaller subset on the same tree
+    for(PS::S32 i = 0; i < nloc; i++) {
+        system[i].acc   = -1.0;
+        system[i].n_ngb = -1;
+    }
+    adr_active.clear();
+    for(PS::S32 i = 0; i < nloc; i++) {
+        active[i] = (i % 17 == 5);
+        if(active[i]) adr_active.push_back(i);
+    }
+    n_active = adr_active.size();
+    adr_active.push_back(0);
+
+    tree.calcForceActiveAndWriteBack(CalcPairForce<Tvec, Treal>(), system, &adr_active[0], n_active);
+    code = checkActiveForce(system, acc_all, n_ngb_all, active, tol) ? code : (code | (1 << 1));
+
+    PS::Finalize();
+
+    return code;
+}
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cmath>
+
+#include <particle_simulator.hpp>
+#include "../check_tree_for_force.hpp"
+
+typedef PS::F64vec                                 Tvec;
+typedef PS::F64                                    Treal;
+typedef PairParticle<Tvec, Treal>                  FP;
+typedef PairEssentialParticle<Tvec, Treal>         EP;
+typedef PairForce<Tvec>                            Force;
+
+template <class Tptcl>
+void generateCube(PS::U32 seed,
+                  PS::S32 ntot,
+                  Tptcl & system,
+                  PS::F64 length,
+                  PS::F64 r_search_min,
+                  PS::F64 r_search_max)
+{
+    PS::S32 rank = PS::Comm::getRank();
+    PS::S32 size = PS::Comm::getNumberOfProc();
+
+    PS::S32 ibgn = (ntot * rank) / size;
+    PS::S32 iend = (ntot * (rank + 1)) / size;
+    PS::S32 nloc = iend - ibgn;
+    PS::MT::init_genrand(seed);
+    system.setNumberOfParticleLocal(nloc);
+    for(PS::S32 i = 0; i < nloc; i++)
+        system[i].generateCube(i+ibgn, length, r_search_min, r_search_max);
+
+    return;
+}
+
+// the forces with the cell list agree with those of the tree walk
+template <class Ttree, class Tpsys>
+bool checkCellListSameForce(Ttree & tree,
+                            Ttree & tree_cell,
+                            Tpsys & system,
+                            PS::DomainInfo & dinfo,
+                            PS::F64 tolerance,
+                            bool check_n_ngb)
+{
+    std::vector<Tvec>    acc;
+    std::vector<PS::S32> n_ngb;
+    tree.calcForceAllAndWriteBack(CalcPairForce<Tvec, Treal>(), system, dinfo);
+    copyForce(system, acc, n_ngb);
+    tree_cell.setCellListMode(true);
+    tree_cell.calcForceAllAndWriteBack(CalcPairForce<Tvec, Treal>(), system, dinfo);
+    return checkSameForce(system, acc, n_ngb, tolerance, check_n_ngb);
+}
+
+int main(int argc, char **argv)
+{
+    PS::Initialize(argc, argv);
+
+    PS::S32    nmem  = 65536;
+    PS::S32    ntot  = 20000;
+    PS::F64    plen  = 1.0;
+    PS::U32    seed  = PS::Comm::getRank();
+    PS::F64    tol   = 1e-10;
+    PS::S32    code  = 0;
+
+    PS::DomainInfo dinfo;
+    PS::ParticleSystem<FP> system;
+
+    dinfo.initialize();
+    system.initialize();
+    system.createParticle(nmem);
+
+    // gather: one search radius, so that the pair force, which uses the
+    // larger radius of the pair, sees the same pairs as the search
+    {
+        PS::TreeForForceShort<Force, EP, EP>::Gather tree, tree_cell;
+        generateCube(seed, ntot, system, plen, 0.04 * plen, 0.04 * plen);
+        dinfo.decomposeDomainAll(system);
+        system.exchangeParticle(dinfo);
+        tree.initialize(ntot);
+        tree_cell.initialize(ntot);
+        code = checkCellListSameForce(tree, tree_cell, system, dinfo, tol, true) ? code : (code | 1);
+    }
+
+    // symmetry: search radii spread by a factor of three
+    {
+        PS::TreeForForceShort<Force, EP, EP>::Symmetry tree, tree_cell;
+        generateCube(seed, ntot, system, plen, 0.02 * plen, 0.06 * plen);
+        dinfo.decomposeDomainAll(system);
+        system.exchangeParticle(dinfo);
+        tree.initialize(ntot);
+        tree_cell.initialize(ntot);
+        code = checkCellListSameForce(tree, tree_cell, system, dinfo, tol, true) ? code : (code | (1 << 1));
+    }
+
+    PS::Finalize();
+
+    return code;
+}
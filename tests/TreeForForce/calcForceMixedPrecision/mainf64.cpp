@@ -0,0 +1,198 @@
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cmath>
+
+#include <particle_simulator.hpp>
+
+// Gravity with an F32 kernel: far from the origin it only works in the
+// mixed precision mode, which hands the kernel positions relative to the
+// i-group. The errors are measured against the direct sum in F64.
+
+class GravityForce {
+public:
+    PS::F64vec acc;
+
+    void clear() {
+        this->acc = 0.0;
+    }
+};
+
+class GravityParticle {
+public:
+    PS::S64    id;
+    PS::F64    mass;
+    PS::F64vec pos;
+    PS::F64vec acc;
+    PS::F64vec acc_ref;
+
+    PS::F64vec getPos() const {
+        return this->pos;
+    }
+
+    void setPos(const PS::F64vec & pos) {
+        this->pos = pos;
+    }
+
+    void copyFromForce(const GravityForce & f) {
+        this->acc = f.acc;
+    }
+};
+
+class GravityEssentialParticle {
+public:
+    PS::F64    mass;
+    PS::F64vec pos;
+
+    PS::F64vec getPos() const {
+        return this->pos;
+    }
+
+    void setPos(const PS::F64vec & pos) {
+        this->pos = pos;
+    }
+
+    PS::F64 getCharge() const {
+        return this->mass;
+    }
+
+    void copyFromFP(const GravityParticle & fp) {
+        this->mass = fp.mass;
+        this->pos  = fp.pos;
+    }
+};
+
+typedef GravityEssentialParticle EP;
+
+template <class Tvec, class Treal>
+struct CalcGravity {
+    template <class Tepj>
+    void operator () (const EP * epi,
+                      const PS::S32 ni,
+                      const Tepj * epj,
+                      const PS::S32 nj,
+                      GravityForce * force) {
+        const Treal eps2 = 1e-4;
+        for(PS::S32 i = 0; i < ni; i++) {
+            const Tvec xi = epi[i].getPos();
+            Tvec ai = 0.0;
+            for(PS::S32 j = 0; j < nj; j++) {
+                const Tvec  dr   = xi - Tvec(epj[j].getPos());
+                const Treal r2   = dr * dr + eps2;
+                const Treal rinv = 1.0 / std::sqrt(r2);
+                ai -= ((Treal)epj[j].getCharge() * rinv * rinv * rinv) * dr;
+            }
+            force[i].acc += ai;
+        }
+    }
+};
+
+typedef CalcGravity<PS::F32vec, PS::F32> CalcGravityF32;
+typedef CalcGravity<PS::F64vec, PS::F64> CalcGravityF64;
+
+template <class Tptcl>
+void generateCube(PS::U32 seed,
+                  PS::S32 ntot,
+                  Tptcl & system)
+{
+    PS::S32 rank = PS::Comm::getRank();
+    PS::S32 size = PS::Comm::getNumberOfProc();
+
+    PS::S32 ibgn = (ntot * rank) / size;
+    PS::S32 iend = (ntot * (rank + 1)) / size;
+    PS::S32 nloc = iend - ibgn;
+    PS::MT::init_genrand(seed);
+    system.setNumberOfParticleLocal(nloc);
+    for(PS::S32 i = 0; i < nloc; i++) {
+        system[i].id   = i + ibgn;
+        system[i].mass = 1.0 / ntot;
+        for(PS::S32 k = 0; k < PS::DIMENSION; k++)
+            system[i].pos[k] = PS::MT::genrand_real2();
+    }
+
+    return;
+}
+
+// RMS of |acc - acc_ref| / |acc_ref|
+template <class Tpsys>
+PS::F64 getForceError(const Tpsys & system)
+{
+    PS::S32 nloc = system.getNumberOfParticleLocal();
+    PS::F64 err2_loc = 0.0;
+    for(PS::S32 i = 0; i < nloc; i++) {
+        const PS::F64vec dacc = system[i].acc - system[i].acc_ref;
+        err2_loc += (dacc * dacc) / (system[i].acc_ref * system[i].acc_ref);
+    }
+    PS::F64 err2 = PS::Comm::getSum(err2_loc);
+    PS::S64 ntot = PS::Comm::getSum((PS::S64)nloc);
+    return std::sqrt(err2 / ntot);
+}
+
+template <class Ttree, class Tpsys>
+void calcForceShifted(Ttree & tree,
+                      Tpsys & system,
+                      PS::DomainInfo & dinfo,
+                      PS::F64vec shift)
+{
+    PS::S32 nloc = system.getNumberOfParticleLocal();
+    for(PS::S32 i = 0; i < nloc; i++)
+        system[i].pos += shift;
+    dinfo.decomposeDomainAll(system);
+    system.exchangeParticle(dinfo);
+    tree.calcForceAllAndWriteBack(CalcGravityF32(), CalcGravityF32(), system, dinfo);
+    nloc = system.getNumberOfParticleLocal();
+    for(PS::S32 i = 0; i < nloc; i++)
+        system[i].pos -= shift;
+}
+
+int main(int argc, char **argv)
+{
+    PS::Initialize(argc, argv);
+
+    PS::S32    nmem   = 65536;
+    PS::S32    ntot   = 20000;
+    PS::U32    seed   = PS::Comm::getRank();
+    PS::F64vec offset = 1e5;
+    PS::S32    code   = 0;
+
+    PS::DomainInfo dinfo;
+    PS::ParticleSystem<GravityParticle> system;
+    PS::TreeForForceLong<GravityForce, EP, EP>::Monopole tree;
+    PS::TreeForForceLong<GravityForce, EP, EP>::Monopole tree_mixed;
+
+    dinfo.initialize();
+    system.initialize();
+    system.createParticle(nmem);
+    generateCube(seed, ntot, system);
+
+    tree.initialize(ntot, 0.5);
+    tree_mixed.initialize(ntot, 0.5);
+    tree_mixed.setMixedPrecisionMode(true);
+
+    // the un-offset run, and the direct sum near the origin
+    calcForceShifted(tree, system, dinfo, 0.0);
+    std::vector<GravityForce> force_direct(system.getNumberOfParticleLocal());
+    tree.calcForceDirect(CalcGravityF64(), &force_direct[0], dinfo);
+    for(PS::S32 i = 0; i < system.getNumberOfParticleLocal(); i++)
+        system[i].acc_ref = force_direct[i].acc;
+    PS::F64 err_origin = getForceError(system);
+
+    // far from the origin: the same error with the mixed precision mode,
+    // the moments included
+    calcForceShifted(tree_mixed, system, dinfo, offset);
+    PS::F64 err_mixed = getForceError(system);
+    code = (err_mixed < 1.5 * err_origin) ? code : (code | 1);
+
+    // and a much larger one without it (the offset is large enough to matter)
+    calcForceShifted(tree, system, dinfo, offset);
+    PS::F64 err_plain = getForceError(system);
+    code = (err_plain > 10.0 * err_origin) ? code : (code | (1 << 1));
+
+    if(PS::Comm::getRank() == 0)
+        std::cerr << "error: " << err_origin << " (origin) " << err_mixed << " (mixed) "
+                  << err_plain << " (plain)" << std::endl;
+
+    PS::Finalize();
+
+    return code;
+}
@@ -0,0 +1,70 @@
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cmath>
+
+#include <particle_simulator.hpp>
+#include "../check_tree_for_force.hpp"
+
+typedef PS::F64vec                                 Tvec;
+typedef PS::F64                                    Treal;
+typedef PairParticle<Tvec, Treal>                  FP;
+typedef PairEssentialParticle<Tvec, Treal>         EP;
+typedef PairForce<Tvec>                            Force;
+
+template <class Tptcl>
+void generateCube(PS::U32 seed,
+                  PS::S32 ntot,
+                  Tptcl & system,
+                  PS::F64 length)
+{
+    PS::S32 rank = PS::Comm::getRank();
+    PS::S32 size = PS::Comm::getNumberOfProc();
+
+    PS::S32 ibgn = (ntot * rank) / size;
+    PS::S32 iend = (ntot * (rank + 1)) / size;
+    PS::S32 nloc = iend - ibgn;
+    PS::MT::init_genrand(seed);
+    system.setNumberOfParticleLocal(nloc);
+    for(PS::S32 i = 0; i < nloc; i++)
+        system[i].generateCube(i+ibgn, length, 0.02 * length, 0.06 * length);
+
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    PS::Initialize(argc, argv);
+
+    PS::S32    nmem = 65536;
+    PS::S32    ntot = 20000;
+    PS::F64    plen = 1.0;
+    PS::U32    seed = PS::Comm::getRank();
+    PS::F64    tol  = 1e-10;
+    PS::S32    code = 0;
+
+    PS::DomainInfo dinfo;
+    PS::ParticleSystem<FP> system;
+    PS::TreeForForceShort<Force, EP, EP>::Symmetry tree;
+    PS::TreeForForceShort<Force, EP, EP>::Symmetry tree_n3;
+
+    dinfo.initialize();
+    system.initialize();
+    system.createParticle(nmem);
+    generateCube(seed, ntot, system, plen);
+
+    dinfo.decomposeDomainAll(system);
+    system.exchangeParticle(dinfo);
+
+    tree.initialize(ntot);
+    tree_n3.initialize(ntot);
+    tree.calcForceAllAndWriteBack(CalcPairForce<Tvec, Treal>(), system, dinfo);
+    tree_n3.calcForceAllNewton3rd(CalcPairForceNewton3rd<Tvec, Treal>(), system, dinfo);
+
+    code = (checkCalcForceNewton3rdSameForce(system, tree_n3, tol)) ? code : (code | 1);
+    code = (checkCalcForceNewton3rdZeroSum(tree_n3, system.getNumberOfParticleLocal(), tol)) ? code : (code | (1 << 1));
+
+    PS::Finalize();
+
+    return code;
+}
@@ -0,0 +1,224 @@
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cmath>
+
+#include <particle_simulator.hpp>
+
+// The particles move on cubic orbits, which the third order prediction
+// follows exactly. The forces from a tree built at t = 0 and predicted by
+// setDtPrediction(dt) have to be as accurate as those from a tree rebuilt
+// at t = dt; the errors are measured against the direct sum at t = dt.
+
+class GravityForce {
+public:
+    PS::F64vec acc;
+
+    void clear() {
+        this->acc = 0.0;
+    }
+};
+
+class HermiteParticle {
+public:
+    PS::S64    id;
+    PS::F64    mass;
+    PS::F64vec pos;
+    PS::F64vec vel;
+    PS::F64vec acc0;
+    PS::F64vec jerk;
+    PS::F64vec acc;
+    PS::F64vec acc_ref;
+
+    PS::F64vec getPos() const {
+        return this->pos;
+    }
+
+    void copyFromForce(const GravityForce & f) {
+        this->acc = f.acc;
+    }
+
+    // moves along the cubic orbit by dt
+    void predict(const PS::F64 dt) {
+        this->pos  += dt * (this->vel + dt * (0.5 * this->acc0 + (1.0/6.0) * dt * this->jerk));
+        this->vel  += dt * (this->acc0 + 0.5 * dt * this->jerk);
+        this->acc0 += dt * this->jerk;
+    }
+};
+
+class HermiteEssentialParticle {
+public:
+    PS::F64    mass;
+    PS::F64vec pos;
+    PS::F64vec vel;
+    PS::F64vec acc;
+    PS::F64vec jerk;
+
+    PS::F64vec getPos() const {
+        return this->pos;
+    }
+
+    void setPos(const PS::F64vec & pos) {
+        this->pos = pos;
+    }
+
+    PS::F64vec getVel() const {
+        return this->vel;
+    }
+
+    PS::F64vec getAcc() const {
+        return this->acc;
+    }
+
+    PS::F64vec getJerk() const {
+        return this->jerk;
+    }
+
+    PS::F64 getCharge() const {
+        return this->mass;
+    }
+
+    void copyFromFP(const HermiteParticle & fp) {
+        this->mass = fp.mass;
+        this->pos  = fp.pos;
+        this->vel  = fp.vel;
+        this->acc  = fp.acc0;
+        this->jerk = fp.jerk;
+    }
+
+    void predict(const PS::F64 dt) {
+        this->pos += dt * (this->vel + dt * (0.5 * this->acc + (1.0/6.0) * dt * this->jerk));
+        this->vel += dt * (this->acc + 0.5 * dt * this->jerk);
+        this->acc += dt * this->jerk;
+    }
+};
+
+typedef HermiteEssentialParticle EP;
+
+struct CalcGravity {
+    template <class Tepj>
+    void operator () (const EP * epi,
+                      const PS::S32 ni,
+                      const Tepj * epj,
+                      const PS::S32 nj,
+                      GravityForce * force) {
+        const PS::F64 eps2 = 1e-4;
+        for(PS::S32 i = 0; i < ni; i++) {
+            const PS::F64vec xi = epi[i].getPos();
+            PS::F64vec ai = 0.0;
+            for(PS::S32 j = 0; j < nj; j++) {
+                const PS::F64vec dr   = xi - epj[j].getPos();
+                const PS::F64    r2   = dr * dr + eps2;
+                const PS::F64    rinv = 1.0 / std::sqrt(r2);
+                ai -= (epj[j].getCharge() * rinv * rinv * rinv) * dr;
+            }
+            force[i].acc += ai;
+        }
+    }
+};
+
+template <class Tptcl>
+void generateCube(PS::U32 seed,
+                  PS::S32 ntot,
+                  Tptcl & system)
+{
+    PS::S32 rank = PS::Comm::getRank();
+    PS::S32 size = PS::Comm::getNumberOfProc();
+
+    PS::S32 ibgn = (ntot * rank) / size;
+    PS::S32 iend = (ntot * (rank + 1)) / size;
+    PS::S32 nloc = iend - ibgn;
+    PS::MT::init_genrand(seed);
+    system.setNumberOfParticleLocal(nloc);
+    for(PS::S32 i = 0; i < nloc; i++) {
+        system[i].id   = i + ibgn;
+        system[i].mass = 1.0 / ntot;
+        for(PS::S32 k = 0; k < PS::DIMENSION; k++) {
+            system[i].pos[k]  = PS::MT::genrand_real2();
+            system[i].vel[k]  = PS::MT::genrand_real2() - 0.5;
+            system[i].acc0[k] = PS::MT::genrand_real2() - 0.5;
+            system[i].jerk[k] = PS::MT::genrand_real2() - 0.5;
+        }
+    }
+
+    return;
+}
+
+// RMS of |acc - acc_ref| / |acc_ref|
+template <class Tpsys>
+PS::F64 getForceError(const Tpsys & system)
+{
+    PS::S32 nloc = system.getNumberOfParticleLocal();
+    PS::F64 err2_loc = 0.0;
+    for(PS::S32 i = 0; i < nloc; i++) {
+        const PS::F64vec dacc = system[i].acc - system[i].acc_ref;
+        err2_loc += (dacc * dacc) / (system[i].acc_ref * system[i].acc_ref);
+    }
+    PS::F64 err2 = PS::Comm::getSum(err2_loc);
+    PS::S64 ntot = PS::Comm::getSum((PS::S64)nloc);
+    return std::sqrt(err2 / ntot);
+}
+
+int main(int argc, char **argv)
+{
+    PS::Initialize(argc, argv);
+
+    PS::S32    nmem = 65536;
+    PS::S32    ntot = 20000;
+    PS::U32    seed = PS::Comm::getRank();
+    PS::F64    dt   = 0.05;
+    PS::S32    code = 0;
+
+    PS::DomainInfo dinfo;
+    PS::ParticleSystem<HermiteParticle> system;
+    PS::TreeForForceLong<GravityForce, EP, EP>::MonopoleHermite tree;
+    PS::TreeForForceLong<GravityForce, EP, EP>::MonopoleHermite tree_rebuilt;
+
+    dinfo.initialize();
+    system.initialize();
+    system.createParticle(nmem);
+    generateCube(seed, ntot, system);
+    dinfo.decomposeDomainAll(system);
+    system.exchangeParticle(dinfo);
+
+    tree.initialize(ntot, 0.5);
+    tree_rebuilt.initialize(ntot, 0.5);
+
+    // the tree at t = 0; the particles are not exchanged afterwards
+    tree.calcForceAllAndWriteBack(CalcGravity(), CalcGravity(), system, dinfo);
+
+    PS::S32 nloc = system.getNumberOfParticleLocal();
+    std::vector<PS::S32> adr_all(nloc);
+    for(PS::S32 i = 0; i < nloc; i++) {
+        adr_all[i] = i;
+        system[i].predict(dt);
+    }
+
+    // the reference: a tree rebuilt at t = dt, and the direct sum
+    tree_rebuilt.calcForceAllAndWriteBack(CalcGravity(), CalcGravity(), system, dinfo);
+    std::vector<GravityForce> force_direct(nloc);
+    tree_rebuilt.calcForceDirect(CalcGravity(), &force_direct[0], dinfo);
+    for(PS::S32 i = 0; i < nloc; i++)
+        system[i].acc_ref = force_direct[i].acc;
+    PS::F64 err_rebuilt = getForceError(system);
+
+    // the tree of t = 0, predicted to t = dt
+    tree.setDtPrediction(dt);
+    tree.calcForceActiveAndWriteBack(CalcGravity(), CalcGravity(), system, &adr_all[0], nloc);
+    PS::F64 err_predicted = getForceError(system);
+    code = (err_predicted < 1.5 * err_rebuilt) ? code : (code | 1);
+
+    // without the prediction the j-particles stay at t = 0
+    tree.setDtPrediction(0.0);
+    tree.calcForceActiveAndWriteBack(CalcGravity(), CalcGravity(), system, &adr_all[0], nloc);
+    PS::F64 err_stale = getForceError(system);
+    code = (err_stale > 10.0 * err_rebuilt) ? code : (code | (1 << 1));
+
+    if(PS::Comm::getRank() == 0)
+        std::cerr << "error: " << err_rebuilt << " (rebuilt) " << err_predicted << " (predicted) "
+                  << err_stale << " (stale)" << std::endl;
+
+    PS::Finalize();
+
+    return code;
+}
@@ -0,0 +1,100 @@
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cmath>
+
+#include <particle_simulator.hpp>
+#include "../check_tree_for_force.hpp"
+
+typedef PS::F64vec                                 Tvec;
+typedef PS::F64                                    Treal;
+typedef PairParticle<Tvec, Treal>                  FP;
+typedef PairEssentialParticle<Tvec, Treal>         EP;
+typedef PairForce<Tvec>                            Force;
+
+template <class Tptcl>
+void generateCube(PS::U32 seed,
+                  PS::S32 ntot,
+                  Tptcl & system,
+                  PS::F64 length)
+{
+    PS::S32 rank = PS::Comm::getRank();
+    PS::S32 size = PS::Comm::getNumberOfProc();
+
+    PS::S32 ibgn = (ntot * rank) / size;
+    PS::S32 iend = (ntot * (rank + 1)) / size;
+    PS::S32 nloc = iend - ibgn;
+    PS::MT::init_genrand(seed);
+    system.setNumberOfParticleLocal(nloc);
+    for(PS::S32 i = 0; i < nloc; i++)
+        system[i].generateCube(i+ibgn, length, 0.02 * length, 0.06 * length);
+
+    return;
+}
+
+// a drift of up to dx per step in a direction fixed by the id
+template <class Tptcl>
+void driftParticle(Tptcl & system,
+                   PS::F64 dx)
+{
+    PS::S32 nloc = system.getNumberOfParticleLocal();
+    for(PS::S32 i = 0; i < nloc; i++)
+        for(PS::S32 k = 0; k < PS::DIMENSION; k++)
+            system[i].pos[k] += dx * std::sin(1.7 * system[i].id + 2.3 * k);
+}
+
+int main(int argc, char **argv)
+{
+    PS::Initialize(argc, argv);
+
+    PS::S32    nmem  = 65536;
+    PS::S32    ntot  = 20000;
+    PS::F64    plen  = 1.0;
+    PS::U32    seed  = PS::Comm::getRank();
+    PS::F64    skin  = 0.02 * plen;
+    PS::S32    nstep = 12;
+    PS::F64    tol   = 1e-10;
+    PS::S32    code  = 0;
+
+    PS::DomainInfo dinfo;
+    PS::ParticleSystem<FP> system;
+    PS::TreeForForceShort<Force, EP, EP>::Symmetry tree;
+    PS::TreeForForceShort<Force, EP, EP>::Symmetry tree_verlet;
+
+    dinfo.initialize();
+    system.initialize();
+    system.createParticle(nmem);
+    generateCube(seed, ntot, system, plen);
+
+    dinfo.decomposeDomainAll(system);
+    system.exchangeParticle(dinfo);
+
+    EP::r_skin = skin;
+    tree.initialize(ntot);
+    tree_verlet.initialize(ntot);
+    tree_verlet.setVerletSkin(skin);
+
+    // the lists are reused while the drift stays below skin/2 and no
+    // particle is exchanged, and rebuilt otherwise
+    PS::S32 n_reuse   = 0;
+    PS::S32 n_rebuild = 0;
+    std::vector<Tvec>    acc;
+    std::vector<PS::S32> n_ngb;
+    for(PS::S32 s = 0; s < nstep; s++) {
+        if(s > 0) driftParticle(system, 0.003 * plen);
+        if(s % 6 == 0) system.exchangeParticle(dinfo);
+
+        tree_verlet.calcForceAllAndWriteBackVerlet(CalcPairForce<Tvec, Treal>(), system, dinfo);
+        if(tree_verlet.isVerletListRebuilt()) n_rebuild++;
+        else n_reuse++;
+        copyForce(system, acc, n_ngb);
+
+        tree.calcForceAllAndWriteBack(CalcPairForce<Tvec, Treal>(), system, dinfo);
+        code = (checkSameForce(system, acc, n_ngb, tol)) ? code : (code | 1);
+    }
+    code = (n_reuse > 0 && n_rebuild > 1) ? code : (code | (1 << 1));
+
+    PS::Finalize();
+
+    return code;
+}
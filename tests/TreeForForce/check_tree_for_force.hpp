@@ -0,0 +1,219 @@
+#pragma once
+
+// A symmetric short-range pair force: a pair closer than
+// max(r_search_i, r_search_j) pushes i away from j by (r_max - r) (ri - rj).
+
+template <class Tvec>
+class PairForce {
+public:
+    Tvec     acc;
+    PS::S32  n_ngb;
+
+    void clear() {
+        this->acc   = 0.0;
+        this->n_ngb = 0;
+    }
+
+    void accumulate(const PairForce & f) {
+        this->acc   += f.acc;
+        this->n_ngb += f.n_ngb;
+    }
+};
+
+template <class Tvec, class Treal>
+class PairParticle {
+public:
+    PS::S64 id;
+    Tvec    pos;
+    Treal   r_search;
+    Tvec    acc;
+    PS::S32 n_ngb;
+
+    PS::F64vec getPos() const {
+        return this->pos;
+    }
+
+    void setPos(const PS::F64vec & pos) {
+        this->pos = pos;
+    }
+
+    PS::F64 getRSearch() const {
+        return this->r_search;
+    }
+
+    void copyFromForce(const PairForce<Tvec> & f) {
+        this->acc   = f.acc;
+        this->n_ngb = f.n_ngb;
+    }
+
+    void generateCube(PS::S64 i,
+                      PS::F64 length,
+                      PS::F64 r_search_min,
+                      PS::F64 r_search_max) {
+        this->id = i;
+        for(PS::S32 k = 0; k < PS::DIMENSION; k++)
+            this->pos[k] = length * PS::MT::genrand_real2();
+        this->r_search = r_search_min + (r_search_max - r_search_min) * PS::MT::genrand_real2();
+    }
+};
+
+// getRSearch() adds r_skin (Verlet lists) to the force cutoff r_search
+template <class Tvec, class Treal>
+class PairEssentialParticle {
+public:
+    static PS::F64 r_skin;
+    PS::S64 id;
+    Tvec    pos;
+    Treal   r_search;
+
+    PS::F64vec getPos() const {
+        return this->pos;
+    }
+
+    void setPos(const PS::F64vec & pos) {
+        this->pos = pos;
+    }
+
+    PS::F64 getRSearch() const {
+        return this->r_search + r_skin;
+    }
+
+    void copyFromFP(const PairParticle<Tvec, Treal> & fp) {
+        this->id       = fp.id;
+        this->pos      = fp.pos;
+        this->r_search = fp.r_search;
+    }
+};
+
+template <class Tvec, class Treal>
+PS::F64 PairEssentialParticle<Tvec, Treal>::r_skin = 0.0;
+
+template <class Tvec, class Treal>
+void calcPairForceOne(const PairEssentialParticle<Tvec, Treal> & epi,
+                      const PairEssentialParticle<Tvec, Treal> & epj,
+                      Tvec & dacc,
+                      bool & hit)
+{
+    const Tvec  dr    = epi.pos - epj.pos;
+    const Treal r2    = dr * dr;
+    const Treal r_max = (epi.r_search > epj.r_search) ? epi.r_search : epj.r_search;
+    hit = (epi.id != epj.id) && (r2 < r_max * r_max);
+    dacc = (hit) ? (r_max - std::sqrt(r2)) * dr : Tvec(0.0);
+}
+
+// every pair seen from i
+template <class Tvec, class Treal>
+struct CalcPairForce {
+    void operator () (const PairEssentialParticle<Tvec, Treal> * epi,
+                      const PS::S32 ni,
+                      const PairEssentialParticle<Tvec, Treal> * epj,
+                      const PS::S32 nj,
+                      PairForce<Tvec> * force) {
+        for(PS::S32 i = 0; i < ni; i++) {
+            for(PS::S32 j = 0; j < nj; j++) {
+                Tvec dacc;
+                bool hit;
+                calcPairForceOne(epi[i], epj[j], dacc, hit);
+                if(!hit) continue;
+                force[i].acc += dacc;
+                force[i].n_ngb++;
+            }
+        }
+    }
+};
+
+// each pair once, the reaction to j (epj[0..ni-1] are the i-particles)
+template <class Tvec, class Treal>
+struct CalcPairForceNewton3rd {
+    void operator () (const PairEssentialParticle<Tvec, Treal> * epi,
+                      const PS::S32 ni,
+                      const PairEssentialParticle<Tvec, Treal> * epj,
+                      const PS::S32 nj,
+                      PairForce<Tvec> * force_i,
+                      PairForce<Tvec> * force_j) {
+        for(PS::S32 i = 0; i < ni; i++) {
+            for(PS::S32 j = 0; j < nj; j++) {
+                if(j < ni && j <= i) continue;
+                Tvec dacc;
+                bool hit;
+                calcPairForceOne(epi[i], epj[j], dacc, hit);
+                if(!hit) continue;
+                force_i[i].acc += dacc;
+                force_i[i].n_ngb++;
+                force_j[j].acc -= dacc;
+                force_j[j].n_ngb++;
+            }
+        }
+    }
+};
+
+// the forces of both trees agree particle by particle
+template <class Tpsys, class Ttree>
+bool checkCalcForceNewton3rdSameForce(const Tpsys & system,
+                                      const Ttree & tree,
+                                      PS::F64 tolerance)
+{
+    bool success_loc = true;
+    PS::S32 nloc = system.getNumberOfParticleLocal();
+    for(PS::S32 i = 0; i < nloc; i++) {
+        const PS::F64vec acc0 = system[i].acc;
+        const PS::F64vec acc1 = tree.getForce(i).acc;
+        const PS::F64vec dacc = acc1 - acc0;
+        success_loc = success_loc && (system[i].n_ngb == tree.getForce(i).n_ngb);
+        success_loc = success_loc && (dacc * dacc <= tolerance * tolerance * (acc0 * acc0 + 1.0));
+    }
+    return PS::Comm::synchronizeConditionalBranchAND(success_loc);
+}
+
+// action equals reaction: the total force vanishes
+template <class Ttree>
+bool checkCalcForceNewton3rdZeroSum(const Ttree & tree,
+                                    PS::S32 nloc,
+                                    PS::F64 tolerance)
+{
+    PS::F64vec sum_loc = 0.0;
+    PS::F64    abs_loc = 0.0;
+    for(PS::S32 i = 0; i < nloc; i++) {
+        const PS::F64vec acc = tree.getForce(i).acc;
+        sum_loc += acc;
+        abs_loc += std::sqrt(acc * acc);
+    }
+    PS::F64vec sum_glb = 0.0;
+    for(PS::S32 k = 0; k < PS::DIMENSION; k++) sum_glb[k] = PS::Comm::getSum(sum_loc[k]);
+    PS::F64 abs_glb = PS::Comm::getSum(abs_loc);
+    return std::sqrt(sum_glb * sum_glb) <= tolerance * abs_glb;
+}
+
+// the forces written back to system agree with acc0 and n_ngb0
+template <class Tpsys, class Tvec>
+bool checkSameForce(const Tpsys & system,
+                    const std::vector<Tvec> & acc0,
+                    const std::vector<PS::S32> & n_ngb0,
+                    PS::F64 tolerance,
+                    bool check_n_ngb = true)
+{
+    bool success_loc = true;
+    PS::S32 nloc = system.getNumberOfParticleLocal();
+    for(PS::S32 i = 0; i < nloc; i++) {
+        const PS::F64vec acc_ref = acc0[i];
+        const PS::F64vec dacc    = PS::F64vec(system[i].acc) - acc_ref;
+        success_loc = success_loc && (!check_n_ngb || system[i].n_ngb == n_ngb0[i]);
+        success_loc = success_loc && (dacc * dacc <= tolerance * tolerance * (acc_ref * acc_ref + 1.0));
+    }
+    return PS::Comm::synchronizeConditionalBranchAND(success_loc);
+}
+
+// copy the forces written back to system
+template <class Tpsys, class Tvec>
+void copyForce(const Tpsys & system,
+               std::vector<Tvec> & acc,
+               std::vector<PS::S32> & n_ngb)
+{
+    PS::S32 nloc = system.getNumberOfParticleLocal();
+    acc.resize(nloc);
+    n_ngb.resize(nloc);
+    for(PS::S32 i = 0; i < nloc; i++) {
+        acc[i]   = system[i].acc;
+        n_ngb[i] = system[i].n_ngb;
+    }
+}